@@ -7,6 +7,7 @@ set(cnode_sources
 	src/cutil.cc
 	src/cnode_js.cc
 	src/cnode_watchdog.cc
+	src/cnode_shards.cc
 	src/cnode_contextify.cc
 	src/cnode_uv.cc
 	src/casync_wrap.cc
@@ -20,13 +21,23 @@ set(cnode_sources
 	src/cnode_os.cc
 	src/ctime_wrap.cc
 	src/cpipe_wrap.cc
+	src/cpipe_shm.cc
 	src/ctcp_wrap.cc
+	src/ctcp_pool.cc
+	src/ctcp_info.cc
+	src/ctcp_dispatch.cc
 	src/cudp_wrap.cc
 	src/cstream_wrap.cc
+	src/cslab_allocator.cc
+	src/crequest_pool.cc
+	src/cstream_pipe.cc
+	src/ctcp_zerocopy.cc
 	src/ctty_wrap.cc
 	src/cuv.cc
 	src/cnode_crypto_bio.cc
 	src/cnode_crypto_clienthello.cc
+	src/cnode_crypto_ktls.cc
+	src/cnode_crypto_session.cc
 	src/cnode_crypto.cc
 	src/ctls_wrap.cc
 )
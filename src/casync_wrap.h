@@ -45,6 +45,7 @@ namespace node {
     V(PROCESSWRAP)                                                              \
     V(QUERYWRAP)                                                                \
     V(REQWRAP)                                                                  \
+    V(SENDFILEWRAP)                                                             \
     V(SHUTDOWNWRAP)                                                             \
     V(SIGNALWRAP)                                                               \
     V(STATWATCHER)                                                              \
@@ -175,6 +175,11 @@ namespace node {
     return isolate_data()->event_loop();
   }
 
+  inline Environment* Environment::from_immediate_check_handle(
+      uv_check_t* handle) {
+    return ContainerOf(&Environment::immediate_check_handle_, handle);
+  }
+
   inline uv_check_t* Environment::immediate_check_handle() {
     return &immediate_check_handle_;
   }
@@ -217,6 +222,21 @@ namespace node {
     handle_cleanup_waiting_--;
   }
 
+  inline void Environment::CleanupHandles() {
+    while (!QUEUE_EMPTY(&handle_cleanup_queue_)) {
+      QUEUE* q = QUEUE_HEAD(&handle_cleanup_queue_);
+      QUEUE_REMOVE(q);
+      HandleCleanup* hc =
+          ContainerOf(&HandleCleanup::handle_cleanup_queue_, q);
+      handle_cleanup_waiting_++;
+      hc->cb_(this, hc->handle_, hc->arg_);
+      delete hc;
+    }
+
+    while (handle_cleanup_waiting_ != 0)
+      uv_run(event_loop(), UV_RUN_ONCE);
+  }
+
   inline Environment::Environment(Local<Context> context, uv_loop_t* loop)
   : isolate_(context->GetIsolate()),
       isolate_data_(IsolateData::GetOrCreate(context->GetIsolate(), loop)),
@@ -236,6 +256,8 @@ namespace node {
     QUEUE_INIT(&gc_tracker_queue_);
     QUEUE_INIT(&req_wrap_queue_);
     QUEUE_INIT(&handle_wrap_queue_);
+    QUEUE_INIT(&stream_check_queue_);
+    QUEUE_INIT(&stream_stats_queue_);
     QUEUE_INIT(&handle_cleanup_queue_);
     handle_cleanup_waiting_ = 0;
   }
@@ -273,6 +295,31 @@ namespace node {
     return &cares_timer_handle_;
   }
 
+  inline Environment* Environment::from_rtt_sampler_handle(
+      uv_timer_t* handle) {
+    return ContainerOf(&Environment::rtt_sampler_handle_, handle);
+  }
+
+  inline uv_timer_t* Environment::rtt_sampler_handle() {
+    return &rtt_sampler_handle_;
+  }
+
+  inline RTTHistogram* Environment::rtt_histogram() {
+    return &rtt_histogram_;
+  }
+
+  inline SlabAllocator* Environment::slab_allocator() {
+    return &slab_allocator_;
+  }
+
+  inline RequestPool* Environment::request_pool() {
+    return &request_pool_;
+  }
+
+  inline TCPPool* Environment::tcp_pool() {
+    return &tcp_pool_;
+  }
+
   inline ares_channel Environment::cares_channel() {
     return cares_channel_;
   }
@@ -28,6 +28,11 @@
 #include "uv.h"
 #include "ares.h"
 #include "ctree.h"
+#include "cslab_allocator.h"
+#include "crequest_pool.h"
+#include "ctcp_pool.h"
+#include "ctcp_info.h"
+#include "cstream_stats.h"
 // Caveat emptor: we're going slightly crazy with macros here but the end
 // hopefully justifies the means. We have a lot of per-context properties
 // and adding and maintaining their getters and setters by hand would be
@@ -91,6 +96,9 @@ namespace node {
   V(heap_size_limit_string,       "heap_size_limit")                          \
   V(heap_total_string,            "heapTotal")                                \
   V(heap_used_string,             "heapUsed")                                 \
+  V(hits_string,                  "hits")                                     \
+  V(misses_string,                "misses")                                   \
+  V(pooled_bytes_string,          "pooledBytes")                              \
   V(used_heap_size_string,        "used_heap_size")                           \
   V(total_physical_size_string,   "total_physical_size")                      \
   V(total_heap_size_executable_string, "total_heap_size_executable")          \
@@ -127,6 +135,7 @@ namespace node {
   V(debug_string,                 "debug")                                    \
   V(detached_string,              "detached")                                 \
   V(dev_string,                   "dev")                                      \
+  V(dispatched_string,            "dispatched")                               \
   V(disposed_string,              "_disposed")                                \
   V(domain_string,                "domain")                                   \
   V(exchange_string,              "exchange")                                 \
@@ -137,6 +146,7 @@ namespace node {
   V(env_string,                   "env")                                      \
   V(error_string,                 "error")                                    \
   V(events_string,                "_events")                                  \
+  V(evictions_string,             "evictions")                                \
   V(exec_argv_string,             "execArgv")                                 \
   V(exec_path_string,             "execPath")                                 \
   V(exiting_string,               "_exiting")                                 \
@@ -145,6 +155,7 @@ namespace node {
   V(exponent_string,              "exponent")                                 \
   V(exports_string,               "exports")                                  \
   V(ext_key_usage_string,         "ext_key_usage")                            \
+  V(failed_string,                "failed")                                   \
   V(family_string,                "family")                                   \
   V(fatal_exception_string,       "_fatalException")                          \
   V(fd_string,                    "fd")                                       \
@@ -157,6 +168,7 @@ namespace node {
   V(hostmaster_string,            "hostmaster")                               \
   V(ignore_string,                "ignore")                                   \
   V(immediate_callback_string,    "_immediateCallback")                       \
+  V(in_use_bytes_string,          "inUseBytes")                               \
   V(infoaccess_string,            "infoAccess")                               \
   V(inherit_string,               "inherit")                                  \
   V(ino_string,                   "ino")                                      \
@@ -168,6 +180,7 @@ namespace node {
   V(issuer_string,                "issuer")                                   \
   V(issuercert_string,            "issuerCertificate")                        \
   V(kill_signal_string,           "killSignal")                               \
+  V(length_string,                "length")                                   \
   V(mac_string,                   "mac")                                      \
   V(max_buffer_string,            "maxBuffer")                                \
   V(message_string,               "message")                                  \
@@ -190,16 +203,21 @@ namespace node {
   V(oncomplete_string,            "oncomplete")                               \
   V(onconnection_string,          "onconnection")                             \
   V(ondone_string,                "ondone")                                   \
+  V(ondrain_string,               "ondrain")                                  \
   V(onerror_string,               "onerror")                                  \
   V(onexit_string,                "onexit")                                   \
   V(onhandshakedone_string,       "onhandshakedone")                          \
   V(onhandshakestart_string,      "onhandshakestart")                         \
   V(onmessage_string,             "onmessage")                                \
+  V(onmessages_string,            "onmessages")                               \
   V(onnewsession_string,          "onnewsession")                             \
   V(onnewsessiondone_string,      "onnewsessiondone")                         \
   V(onocspresponse_string,        "onocspresponse")                           \
+  V(onpipeclose_string,           "onpipeclose")                              \
+  V(onpressure_string,            "onpressure")                               \
   V(onread_string,                "onread")                                   \
   V(onselect_string,              "onselect")                                 \
+  V(onshm_string,                 "onshm")                                    \
   V(onsignal_string,              "onsignal")                                 \
   V(onstop_string,                "onstop")                                   \
   V(output_string,                "output")                                   \
@@ -231,6 +249,8 @@ namespace node {
   V(service_string,               "service")                                  \
   V(servername_string,            "servername")                               \
   V(session_id_string,            "sessionId")                                \
+  V(shard_count_string,           "shardCount")                               \
+  V(shard_index_string,           "shardIndex")                               \
   V(should_keep_alive_string,     "shouldKeepAlive")                          \
   V(signal_string,                "signal")                                   \
   V(size_string,                  "size")                                     \
@@ -323,7 +343,9 @@ namespace node {
     static inline Environment* GetCurrent(Isolate* isolate);
     static inline Environment* GetCurrent(Local<Context> context);
     static inline Environment* New(Local<Context> context, uv_loop_t* loop);
-    //inline void CleanupHandles();
+    // Run the registered handle cleanups and wait for their closes.  Not
+    // from inside a loop callback, it runs the loop itself.
+    inline void CleanupHandles();
     inline void Dispose();
 
     // Defined in src/node_v8.cc.
@@ -353,11 +375,26 @@ namespace node {
     //Called in src/cares_wrap.cc.
     static inline Environment* from_cares_timer_handle(uv_timer_t* handle);
     inline uv_timer_t* cares_timer_handle();
+
+    //Called in src/ctcp_wrap.cc.
+    static inline Environment* from_rtt_sampler_handle(uv_timer_t* handle);
+    inline uv_timer_t* rtt_sampler_handle();
+    inline RTTHistogram* rtt_histogram();
     inline ares_channel cares_channel();
     inline ares_channel* cares_channel_ptr();
     inline ares_task_list* cares_task_list();
 
+    //Called in src/cstream_wrap.cc and src/cudp_wrap.cc.
+    inline SlabAllocator* slab_allocator();
+
+    //Called in src/cstream_wrap.cc, src/cudp_wrap.cc and src/cnode_file.cc.
+    inline RequestPool* request_pool();
+
+    //Called in src/ctcp_wrap.cc.
+    inline TCPPool* tcp_pool();
+
     //Called in src/cnode.cc.
+    static inline Environment* from_immediate_check_handle(uv_check_t* handle);
     inline uv_check_t* immediate_check_handle();
     inline uv_idle_t* immediate_idle_handle();
     inline uv_prepare_t* idle_prepare_handle();
@@ -395,6 +432,13 @@ namespace node {
 
     inline QUEUE* handle_wrap_queue() { return &handle_wrap_queue_; }
     inline QUEUE* req_wrap_queue() { return &req_wrap_queue_; }
+    // Streams with corked writes to flush at the end of the tick.
+    inline QUEUE* stream_check_queue() { return &stream_check_queue_; }
+    // Stats of streams that have them enabled, and of those that are gone.
+    inline QUEUE* stream_stats_queue() { return &stream_stats_queue_; }
+    inline StreamStats* retired_stream_stats() {
+      return &retired_stream_stats_;
+    }
 
     class AsyncHooks {
      public:
@@ -487,6 +531,8 @@ namespace node {
 
     QUEUE handle_wrap_queue_;
     QUEUE req_wrap_queue_;
+    QUEUE stream_check_queue_;
+    QUEUE stream_stats_queue_;
     QUEUE handle_cleanup_queue_;
     int handle_cleanup_waiting_;
 
@@ -495,6 +541,22 @@ namespace node {
     ares_channel cares_channel_;
     ares_task_list cares_task_list_;
 
+    //read buffers
+    SlabAllocator slab_allocator_;
+
+    //request storage
+    RequestPool request_pool_;
+
+    //idle client connections
+    TCPPool tcp_pool_;
+
+    //RTT sampling
+    uv_timer_t rtt_sampler_handle_;
+    RTTHistogram rtt_histogram_;
+
+    //stream statistics
+    StreamStats retired_stream_stats_;
+
     //domain
     DomainFlag domain_flag_;
     bool using_domains_;
@@ -76,9 +76,7 @@ namespace node {
     if (wrap == NULL || wrap->handle__ == NULL)
       return;
 
-    assert(!wrap->persistent().IsEmpty());
-    uv_close(wrap->handle__, OnClose);
-    wrap->handle__ = NULL;
+    wrap->CloseHandle();
 
     if (args[0]->IsFunction()) {
       wrap->object()->Set(env->close_string(), args[0]);
@@ -105,6 +103,15 @@ namespace node {
     QUEUE_REMOVE(&handle_wrap_queue_);
   }
 
+  void HandleWrap::CloseHandle() {
+    if (handle__ == NULL)
+      return;
+
+    assert(!persistent().IsEmpty());
+    uv_close(handle__, OnClose);
+    handle__ = NULL;
+  }
+
   void HandleWrap::OnClose(uv_handle_t* handle) {
     HandleWrap* wrap = static_cast<HandleWrap*>(handle->data);
     Environment* env = wrap->env();
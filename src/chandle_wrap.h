@@ -59,12 +59,17 @@ namespace node {
 
     inline uv_handle_t* GetHandle() { return handle__; }
 
+    // close() without a callback, for handles owned by native code.
+    void CloseHandle();
+
    protected:
     HandleWrap(Environment* env, v8::Handle<v8::Object> object, uv_handle_t* handle, AsyncWrap::ProviderType provider, AsyncWrap* parent = NULL);
     virtual ~HandleWrap();
 
    private:
     friend void GetActiveHandles(const v8::FunctionCallbackInfo<v8::Value>&);
+    friend class TCPWrap;  // The RTT sampler walks handle_wrap_queue_.
+    friend class LoopShards;  // Stop() closes every wrap.
     static void OnClose(uv_handle_t* handle);
     QUEUE handle_wrap_queue_;
     unsigned int flags_;
@@ -114,6 +114,8 @@ namespace node {
     int exec_argc,
     const char* const* exec_argv);
 
+  NODE_EXTERN void LoadEnvironment(Environment* env);
+
   enum encoding {ASCII, UTF8, BASE64, UCS2, BINARY, HEX, BUFFER};
   enum encoding ParseEncoding(Isolate* isolate, Handle<Value> encoding_v,enum encoding _default = BINARY);
 
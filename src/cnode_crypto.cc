@@ -96,6 +96,7 @@ namespace crypto {
   using v8::Isolate;
   using v8::Local;
   using v8::Null;
+  using v8::Number;
   using v8::Object;
   using v8::Persistent;
   using v8::PropertyAttribute;
@@ -285,6 +286,15 @@ namespace crypto {
     NODE_SET_PROTOTYPE_METHOD(t, "loadPKCS12", SecureContext::LoadPKCS12);
     NODE_SET_PROTOTYPE_METHOD(t, "getTicketKeys", SecureContext::GetTicketKeys);
     NODE_SET_PROTOTYPE_METHOD(t, "setTicketKeys", SecureContext::SetTicketKeys);
+    NODE_SET_PROTOTYPE_METHOD(t,
+                              "enableSessionCache",
+                              SecureContext::EnableSessionCache);
+    NODE_SET_PROTOTYPE_METHOD(t,
+                              "getSessionCacheStats",
+                              SecureContext::GetSessionCacheStats);
+    NODE_SET_PROTOTYPE_METHOD(t,
+                              "enableTicketKeyRotation",
+                              SecureContext::EnableTicketKeyRotation);
     NODE_SET_PROTOTYPE_METHOD(t,
                               "getCertificate",
                               SecureContext::GetCertificate<true>);
@@ -395,6 +405,7 @@ namespace crypto {
                                    SSL_SESS_CACHE_NO_AUTO_CLEAR);
     SSL_CTX_sess_set_get_cb(sc->ctx_, SSLWrap<Connection>::GetSessionCallback);
     SSL_CTX_sess_set_new_cb(sc->ctx_, SSLWrap<Connection>::NewSessionCallback);
+    SSL_CTX_set_app_data(sc->ctx_, sc);
 
     sc->ca_store_ = NULL;
   }
@@ -946,6 +957,11 @@ namespace crypto {
     SecureContext* wrap = Unwrap<SecureContext>(args.Holder());
 
     Local<Object> buff = Buffer::New(wrap->env(), 48);
+    if (wrap->ticket_keys_ != NULL) {
+      wrap->ticket_keys_->GetCurrent(
+          reinterpret_cast<unsigned char*>(Buffer::Data(buff)));
+      return args.GetReturnValue().Set(buff);
+    }
     if (SSL_CTX_get_tlsext_ticket_keys(wrap->ctx_,
                                        Buffer::Data(buff),
                                        Buffer::Length(buff)) != 1) {
@@ -968,6 +984,13 @@ namespace crypto {
       return wrap->env()->ThrowTypeError("Bad argument");
     }
 
+    // With rotation enabled the given keys become the current ones
+    if (wrap->ticket_keys_ != NULL) {
+      wrap->ticket_keys_->SetCurrent(
+          reinterpret_cast<const unsigned char*>(Buffer::Data(args[0])));
+      return args.GetReturnValue().Set(true);
+    }
+
     if (SSL_CTX_set_tlsext_ticket_keys(wrap->ctx_,
                                        Buffer::Data(args[0]),
                                        Buffer::Length(args[0])) != 1) {
@@ -979,6 +1002,92 @@ namespace crypto {
   }
 
 
+  void SecureContext::EnableSessionCache(
+      const FunctionCallbackInfo<Value>& args) {
+    HandleScope scope(args.GetIsolate());
+    SecureContext* wrap = Unwrap<SecureContext>(args.Holder());
+
+    if (args.Length() < 1 || !args[0]->IsNumber() || args[0]->NumberValue() < 1)
+      return wrap->env()->ThrowTypeError("Bad argument, expected byte limit");
+
+    // Offloaded handshakes may be inside the cache, resize it in place
+    size_t max_bytes = static_cast<size_t>(args[0]->NumberValue());
+    if (wrap->session_cache_ != NULL)
+      wrap->session_cache_->SetLimit(max_bytes);
+    else
+      wrap->session_cache_ = new SessionCache(max_bytes);
+  }
+
+
+  void SecureContext::GetSessionCacheStats(
+      const FunctionCallbackInfo<Value>& args) {
+    HandleScope scope(args.GetIsolate());
+    SecureContext* wrap = Unwrap<SecureContext>(args.Holder());
+    Environment* env = wrap->env();
+
+    SessionCache* cache = wrap->session_cache_;
+    if (cache == NULL)
+      return args.GetReturnValue().SetNull();
+
+    Local<Object> info = Object::New(env->isolate());
+    info->Set(env->hits_string(),
+              Number::New(env->isolate(), static_cast<double>(cache->hits())));
+    info->Set(env->misses_string(),
+              Number::New(env->isolate(),
+                          static_cast<double>(cache->misses())));
+    info->Set(env->bytes_string(),
+              Number::New(env->isolate(), static_cast<double>(cache->bytes())));
+    args.GetReturnValue().Set(info);
+  }
+
+
+  void SecureContext::EnableTicketKeyRotation(
+      const FunctionCallbackInfo<Value>& args) {
+  #if !defined(OPENSSL_NO_TLSEXT) && defined(SSL_CTX_set_tlsext_ticket_key_cb)
+    HandleScope scope(args.GetIsolate());
+    SecureContext* wrap = Unwrap<SecureContext>(args.Holder());
+
+    if (args.Length() < 2 || !args[0]->IsUint32() || !args[1]->IsUint32()) {
+      return wrap->env()->ThrowTypeError(
+          "Bad arguments, expected interval and grace in seconds");
+    }
+
+    // Offloaded handshakes may be inside the ring, re-key it in place
+    unsigned int interval = args[0]->Uint32Value();
+    unsigned int grace = args[1]->Uint32Value();
+    if (wrap->ticket_keys_ != NULL) {
+      if (!wrap->ticket_keys_->Reset(interval, grace))
+        return wrap->env()->ThrowError("Failed to generate tls ticket keys");
+    } else {
+      TicketKeyRing* keys = new TicketKeyRing(interval, grace);
+      if (!keys->Init()) {
+        delete keys;
+        return wrap->env()->ThrowError("Failed to generate tls ticket keys");
+      }
+      wrap->ticket_keys_ = keys;
+      SSL_CTX_set_tlsext_ticket_key_cb(wrap->ctx_, TicketKeyCallback);
+    }
+
+    args.GetReturnValue().Set(true);
+  #endif  // !def(OPENSSL_NO_TLSEXT) && def(SSL_CTX_set_tlsext_ticket_key_cb)
+  }
+
+
+  #if !defined(OPENSSL_NO_TLSEXT) && defined(SSL_CTX_set_tlsext_ticket_key_cb)
+  int SecureContext::TicketKeyCallback(SSL* s,
+                                       unsigned char* name,
+                                       unsigned char* iv,
+                                       EVP_CIPHER_CTX* ectx,
+                                       HMAC_CTX* hctx,
+                                       int enc) {
+    // Tickets are always handled by the context the connection started on
+    SecureContext* sc = FromCTX(s->initial_ctx);
+    assert(sc != NULL && sc->ticket_keys_ != NULL);
+    return sc->ticket_keys_->Handle(name, iv, ectx, hctx, enc);
+  }
+  #endif  // !def(OPENSSL_NO_TLSEXT) && def(SSL_CTX_set_tlsext_ticket_key_cb)
+
+
   void SecureContext::CtxGetter(Local<String> property,
                                 const PropertyCallbackInfo<Value>& info) {
     HandleScope scope(info.GetIsolate());
@@ -1083,6 +1192,15 @@ namespace crypto {
     SSL_SESSION* sess = w->next_sess_;
     w->next_sess_ = NULL;
 
+    // No session loaded from JS, try the native cache
+    if (sess == NULL && w->is_server()) {
+      SecureContext* sc = SecureContext::FromCTX(s->session_ctx);
+      if (sc != NULL && sc->session_cache_ != NULL) {
+        // Lookup() hands out a reference of our own, OpenSSL takes it
+        sess = sc->session_cache_->Lookup(key, len);
+      }
+    }
+
     return sess;
   }
 
@@ -1090,6 +1208,26 @@ namespace crypto {
   template <class Base>
   int SSLWrap<Base>::NewSessionCallback(SSL* s, SSL_SESSION* sess) {
     Base* w = static_cast<Base*>(SSL_get_app_data(s));
+
+    // Native cache takes precedence, the handshake never waits on JS
+    if (w->is_server()) {
+      SecureContext* sc = SecureContext::FromCTX(s->session_ctx);
+      if (sc != NULL && sc->session_cache_ != NULL) {
+        // Returning 1 hands our reference over to the cache
+        return sc->session_cache_->Add(sess) ? 1 : 0;
+      }
+    }
+
+    // Reported to JS once the offloaded step is back on the loop
+    if (w->handshake_offloaded_) {
+      if (!w->session_callbacks_)
+        return 0;
+      CRYPTO_add(&sess->references, 1, CRYPTO_LOCK_SSL_SESSION);
+      assert(w->offloaded_sess_ == NULL);
+      w->offloaded_sess_ = sess;
+      return 0;
+    }
+
     Environment* env = w->ssl_env();
     HandleScope handle_scope(env->isolate());
     Context::Scope context_scope(env->context());
@@ -1318,6 +1456,8 @@ namespace crypto {
     HandleScope scope(args.GetIsolate());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("getPeerCertificate"))
+      return;
     Environment* env = w->ssl_env();
 
     ClearErrorOnReturn clear_error_on_return;
@@ -1426,6 +1566,8 @@ namespace crypto {
     HandleScope scope(env->isolate());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("getSession"))
+      return;
 
     SSL_SESSION* sess = SSL_get_session(w->ssl_);
     if (sess == NULL)
@@ -1448,6 +1590,8 @@ namespace crypto {
     HandleScope scope(env->isolate());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("setSession"))
+      return;
 
     if (args.Length() < 1 ||
         (!args[0]->IsString() && !Buffer::HasInstance(args[0]))) {
@@ -1480,6 +1624,8 @@ namespace crypto {
     HandleScope scope(args.GetIsolate());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("loadSession"))
+      return;
     Environment* env = w->ssl_env();
 
     if (args.Length() >= 1 && Buffer::HasInstance(args[0])) {
@@ -1512,6 +1658,8 @@ namespace crypto {
   void SSLWrap<Base>::IsSessionReused(const FunctionCallbackInfo<Value>& args) {
     HandleScope scope(args.GetIsolate());
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("isSessionReused"))
+      return;
     bool yes = SSL_session_reused(w->ssl_);
     args.GetReturnValue().Set(yes);
   }
@@ -1530,6 +1678,8 @@ namespace crypto {
     HandleScope scope(args.GetIsolate());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("renegotiate"))
+      return;
 
     ClearErrorOnReturn clear_error_on_return;
     (void) &clear_error_on_return;  // Silence unused variable warning.
@@ -1544,6 +1694,8 @@ namespace crypto {
     HandleScope scope(args.GetIsolate());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("shutdown"))
+      return;
 
     int rv = SSL_shutdown(w->ssl_);
     args.GetReturnValue().Set(rv);
@@ -1555,6 +1707,8 @@ namespace crypto {
     HandleScope scope(args.GetIsolate());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("getTLSTicket"))
+      return;
     Environment* env = w->ssl_env();
 
     SSL_SESSION* sess = SSL_get_session(w->ssl_);
@@ -1574,6 +1728,8 @@ namespace crypto {
     HandleScope scope(args.GetIsolate());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("newSessionDone"))
+      return;
     w->new_session_wait_ = false;
     w->NewSessionDoneCb();
   }
@@ -1586,6 +1742,8 @@ namespace crypto {
     HandleScope scope(args.GetIsolate());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("setOCSPResponse"))
+      return;
     if (args.Length() < 1 || !Buffer::HasInstance(args[0]))
       return w->env()->ThrowTypeError("Must give a Buffer as first argument");
 
@@ -1601,6 +1759,8 @@ namespace crypto {
     HandleScope scope(args.GetIsolate());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("requestOCSP"))
+      return;
 
     SSL_set_tlsext_status_type(w->ssl_, TLSEXT_STATUSTYPE_ocsp);
   #endif  // NODE__HAVE_TLSEXT_STATUS_CB
@@ -1615,6 +1775,8 @@ namespace crypto {
     CHECK(args.Length() >= 1 && args[0]->IsNumber());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("setMaxSendFragment"))
+      return;
 
     int rv = SSL_set_max_send_fragment(w->ssl_, args[0]->Int32Value());
     args.GetReturnValue().Set(rv);
@@ -1626,6 +1788,8 @@ namespace crypto {
   void SSLWrap<Base>::IsInitFinished(const FunctionCallbackInfo<Value>& args) {
     HandleScope scope(args.GetIsolate());
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("isInitFinished"))
+      return;
     bool yes = SSL_is_init_finished(w->ssl_);
     args.GetReturnValue().Set(yes);
   }
@@ -1636,6 +1800,8 @@ namespace crypto {
     HandleScope scope(args.GetIsolate());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("verifyError"))
+      return;
 
     // XXX(bnoordhuis) The UNABLE_TO_GET_ISSUER_CERT error when there is no
     // peer certificate is questionable but it's compatible with what was
@@ -1701,6 +1867,8 @@ namespace crypto {
     HandleScope scope(args.GetIsolate());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("getCurrentCipher"))
+      return;
     Environment* env = w->ssl_env();
 
     OPENSSL_CONST SSL_CIPHER* c = SSL_get_current_cipher(w->ssl_);
@@ -1724,6 +1892,15 @@ namespace crypto {
                                                 unsigned int* len,
                                                 void* arg) {
     Base* w = static_cast<Base*>(SSL_get_app_data(s));
+
+    // Offloaded steps only run without NPN protocols, stay out of V8
+    if (w->handshake_offloaded_) {
+      assert(w->npn_protos_.IsEmpty());
+      *data = reinterpret_cast<const unsigned char*>("");
+      *len = 0;
+      return SSL_TLSEXT_ERR_OK;
+    }
+
     Environment* env = w->env();
     HandleScope handle_scope(env->isolate());
     Context::Scope context_scope(env->context());
@@ -1803,6 +1980,8 @@ namespace crypto {
     HandleScope scope(args.GetIsolate());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("getNegotiatedProtocol"))
+      return;
 
     if (w->is_client()) {
       if (w->selected_npn_proto_.IsEmpty() == false) {
@@ -1829,6 +2008,8 @@ namespace crypto {
     HandleScope scope(args.GetIsolate());
 
     Base* w = Unwrap<Base>(args.Holder());
+    if (w->ThrowIfHandshakeBusy("setNPNProtocols"))
+      return;
 
     if (args.Length() < 1 || !Buffer::HasInstance(args[0]))
       return w->env()->ThrowTypeError("Must give a Buffer as first argument");
@@ -1842,6 +2023,13 @@ namespace crypto {
   template <class Base>
   int SSLWrap<Base>::TLSExtStatusCallback(SSL* s, void* arg) {
     Base* w = static_cast<Base*>(SSL_get_app_data(s));
+
+    // Offloaded steps only run without a stapled response
+    if (w->handshake_offloaded_) {
+      assert(w->is_server() && w->ocsp_response_.IsEmpty());
+      return SSL_TLSEXT_ERR_NOACK;
+    }
+
     Environment* env = w->env();
     HandleScope handle_scope(env->isolate());
 
@@ -29,6 +29,7 @@
 
 #include "cnode_crypto_clienthello.h"  // ClientHelloParser
 #include "cnode_crypto_clienthello-inl.h"
+#include "cnode_crypto_session.h"
 
 #ifdef OPENSSL_NPN_NEGOTIATED
 #include "cnode_buffer.h"
@@ -81,9 +82,27 @@ namespace crypto {
     SSL_CTX* ctx_;
     X509* cert_;
     X509* issuer_;
+    SessionCache* session_cache_;
+    TicketKeyRing* ticket_keys_;
 
     static const int kMaxSessionSize = 10 * 1024;
 
+    static inline SecureContext* FromCTX(SSL_CTX* ctx) {
+      return static_cast<SecureContext*>(SSL_CTX_get_app_data(ctx));
+    }
+
+    // Offloaded handshake steps reach the SSL_CTX and the native session
+    // state from the threadpool, freeing them waits for the last one
+    inline void StepStarted() {
+      offloaded_steps_++;
+    }
+
+    inline void StepFinished() {
+      assert(offloaded_steps_ > 0);
+      if (--offloaded_steps_ == 0 && free_pending_)
+        FreeCTXMem();
+    }
+
    protected:
 
     static void New(const v8::FunctionCallbackInfo<v8::Value>& args);
@@ -105,6 +124,20 @@ namespace crypto {
     static void LoadPKCS12(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void GetTicketKeys(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void SetTicketKeys(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void EnableSessionCache(
+        const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void GetSessionCacheStats(
+        const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void EnableTicketKeyRotation(
+        const v8::FunctionCallbackInfo<v8::Value>& args);
+  #if !defined(OPENSSL_NO_TLSEXT) && defined(SSL_CTX_set_tlsext_ticket_key_cb)
+    static int TicketKeyCallback(SSL* s,
+                                 unsigned char* name,
+                                 unsigned char* iv,
+                                 EVP_CIPHER_CTX* ectx,
+                                 HMAC_CTX* hctx,
+                                 int enc);
+  #endif
     static void CtxGetter(v8::Local<v8::String> property,
                           const v8::PropertyCallbackInfo<v8::Value>& info);
 
@@ -116,11 +149,33 @@ namespace crypto {
           ca_store_(NULL),
           ctx_(NULL),
           cert_(NULL),
-          issuer_(NULL) {
+          issuer_(NULL),
+          session_cache_(NULL),
+          ticket_keys_(NULL),
+          offloaded_steps_(0),
+          free_pending_(false) {
       MakeWeak<SecureContext>(this);
     }
 
     void FreeCTXMem() {
+      if (offloaded_steps_ != 0) {
+        free_pending_ = true;
+        return;
+      }
+      free_pending_ = false;
+
+      if (ctx_) {
+        // Connections may outlive us, detach the native session state
+        SSL_CTX_set_app_data(ctx_, NULL);
+  #if !defined(OPENSSL_NO_TLSEXT) && defined(SSL_CTX_set_tlsext_ticket_key_cb)
+        if (ticket_keys_ != NULL)
+          SSL_CTX_set_tlsext_ticket_key_cb(ctx_, NULL);
+  #endif
+      }
+      delete session_cache_;
+      session_cache_ = NULL;
+      delete ticket_keys_;
+      ticket_keys_ = NULL;
       if (ctx_) {
         if (ctx_->cert_store == root_cert_store) {
           // SSL_CTX_free() will attempt to free the cert_store as well.
@@ -142,6 +197,11 @@ namespace crypto {
         assert(ca_store_ == NULL);
       }
     }
+
+   private:
+    unsigned int offloaded_steps_;
+    // Close() came while steps were in flight
+    bool free_pending_;
   };
 
   // SSLWrap implicitly depends on the inheriting class' handle having an
@@ -159,7 +219,9 @@ namespace crypto {
           kind_(kind),
           next_sess_(NULL),
           session_callbacks_(false),
-          new_session_wait_(false) {
+          new_session_wait_(false),
+          handshake_offloaded_(false),
+          offloaded_sess_(NULL) {
       ssl_ = SSL_new(sc->ctx_);
       assert(ssl_ != NULL);
     }
@@ -173,6 +235,10 @@ namespace crypto {
         SSL_SESSION_free(next_sess_);
         next_sess_ = NULL;
       }
+      if (offloaded_sess_ != NULL) {
+        SSL_SESSION_free(offloaded_sess_);
+        offloaded_sess_ = NULL;
+      }
 
   #ifdef OPENSSL_NPN_NEGOTIATED
       npn_protos_.Reset();
@@ -246,12 +312,25 @@ namespace crypto {
       return env_;
     }
 
+    // ssl_ belongs to the threadpool while a handshake step is offloaded,
+    // JS gets EBUSY until the step is back on the loop
+    inline bool ThrowIfHandshakeBusy(const char* syscall) const {
+      if (!handshake_offloaded_)
+        return false;
+      env_->ThrowUVException(UV_EBUSY, syscall);
+      return true;
+    }
+
     Environment* const env_;
     Kind kind_;
     SSL_SESSION* next_sess_;
     SSL* ssl_;
     bool session_callbacks_;
     bool new_session_wait_;
+    // A handshake step runs on the threadpool; callbacks must stay out of
+    // V8 and leave JS notifications for the loop thread
+    bool handshake_offloaded_;
+    SSL_SESSION* offloaded_sess_;
     ClientHelloParser hello_parser_;
 
   #ifdef NODE__HAVE_TLSEXT_STATUS_CB
@@ -21,9 +21,104 @@
 #include "cnode_crypto_bio.h"
 
 #include "openssl/bio.h"
+#include "uv.h"
+#include <stdlib.h>
 #include <string.h>
 
 namespace node {
+  // Free chunks are linked through their first bytes
+  struct FreeChunk {
+    FreeChunk* next;
+  };
+
+  static uv_once_t pool_once = UV_ONCE_INIT;
+  static uv_mutex_t pool_mutex;
+  static FreeChunk* pool_heads[5];  // 1k, 2k, 4k, 8k and 16k
+  static size_t pool_pooled_bytes;
+  static size_t pool_in_use_bytes;
+
+  static void InitPoolOnce() {
+    if (uv_mutex_init(&pool_mutex))
+      abort();
+  }
+
+
+  size_t NodeBIOPool::ClassOf(size_t len) {
+    size_t index = 0;
+    size_t size = kMinChunk;
+    while (size < len) {
+      size <<= 1;
+      index++;
+    }
+    return index;
+  }
+
+
+  char* NodeBIOPool::Allocate(size_t* len) {
+    uv_once(&pool_once, InitPoolOnce);
+
+    if (*len > kMaxChunk) {
+      uv_mutex_lock(&pool_mutex);
+      pool_in_use_bytes += *len;
+      uv_mutex_unlock(&pool_mutex);
+      return new char[*len];
+    }
+
+    size_t index = ClassOf(*len);
+    *len = kMinChunk << index;
+
+    uv_mutex_lock(&pool_mutex);
+    FreeChunk* chunk = pool_heads[index];
+    if (chunk != NULL) {
+      pool_heads[index] = chunk->next;
+      pool_pooled_bytes -= *len;
+    }
+    pool_in_use_bytes += *len;
+    uv_mutex_unlock(&pool_mutex);
+
+    if (chunk != NULL)
+      return reinterpret_cast<char*>(chunk);
+    return new char[*len];
+  }
+
+
+  void NodeBIOPool::Release(char* data, size_t len) {
+    uv_once(&pool_once, InitPoolOnce);
+
+    uv_mutex_lock(&pool_mutex);
+    pool_in_use_bytes -= len;
+    if (len <= kMaxChunk && pool_pooled_bytes + len <= kMaxPooledBytes) {
+      size_t index = ClassOf(len);
+      assert(len == (kMinChunk << index));
+      FreeChunk* chunk = reinterpret_cast<FreeChunk*>(data);
+      chunk->next = pool_heads[index];
+      pool_heads[index] = chunk;
+      pool_pooled_bytes += len;
+      data = NULL;
+    }
+    uv_mutex_unlock(&pool_mutex);
+
+    delete[] data;
+  }
+
+
+  size_t NodeBIOPool::pooled_bytes() {
+    uv_once(&pool_once, InitPoolOnce);
+    uv_mutex_lock(&pool_mutex);
+    size_t r = pool_pooled_bytes;
+    uv_mutex_unlock(&pool_mutex);
+    return r;
+  }
+
+
+  size_t NodeBIOPool::in_use_bytes() {
+    uv_once(&pool_once, InitPoolOnce);
+    uv_mutex_lock(&pool_mutex);
+    size_t r = pool_in_use_bytes;
+    uv_mutex_unlock(&pool_mutex);
+    return r;
+  }
+
   const BIO_METHOD NodeBIO::method = {
     BIO_TYPE_MEM,
     "node.js SSL buffer",
@@ -90,6 +185,10 @@ namespace node {
 
 
   char* NodeBIO::Peek(size_t* size) {
+    if (read_head_ == NULL) {
+      *size = 0;
+      return NULL;
+    }
     *size = read_head_->write_pos_ - read_head_->read_pos_;
     return read_head_->data_ + read_head_->read_pos_;
   }
@@ -449,7 +548,19 @@ namespace node {
   }
 
 
+  void NodeBIO::Release() {
+    if (length_ != 0)
+      return;
+    FreeAll();
+  }
+
+
   NodeBIO::~NodeBIO() {
+    FreeAll();
+  }
+
+
+  void NodeBIO::FreeAll() {
     if (read_head_ == NULL)
       return;
 
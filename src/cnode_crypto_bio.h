@@ -23,9 +23,31 @@
 #define SRC_NODE_CRYPTO_BIO_H_
 #include "openssl/bio.h"
 #include <assert.h>
+#include <stddef.h>
 
 namespace node {
-  
+
+  // Process-wide free lists for NodeBIO chunks, one per power-of-two size
+  // class between kMinChunk and kMaxChunk.  Larger chunks are not pooled.
+  class NodeBIOPool {
+   public:
+    // Round `*len` up to its size class and return a chunk of that size
+    static char* Allocate(size_t* len);
+    static void Release(char* data, size_t len);
+
+    // Bytes sitting on the free lists / handed out to live NodeBIOs
+    static size_t pooled_bytes();
+    static size_t in_use_bytes();
+
+   private:
+    static const size_t kMinChunk = 1024;
+    static const size_t kMaxChunk = 16384;
+    // Chunks released beyond this are returned to the system
+    static const size_t kMaxPooledBytes = 64 * 1024 * 1024;
+
+    static size_t ClassOf(size_t len);
+  };
+
   class NodeBIO {
    public:
     NodeBIO() : initial_(kInitialBufferLength),
@@ -66,6 +88,10 @@ namespace node {
     // Discard all available data
     void Reset();
 
+    // Return every chunk to NodeBIOPool if the buffer is empty, the next
+    // write allocates again
+    void Release();
+
     // Put `len` bytes from `data` into buffer
     void Write(const char* data, size_t size);
 
@@ -112,11 +138,11 @@ namespace node {
                                     write_pos_(0),
                                     len_(len),
                                     next_(NULL) {
-        data_ = new char[len];
+        data_ = NodeBIOPool::Allocate(&len_);
       }
 
       ~Buffer() {
-        delete[] data_;
+        NodeBIOPool::Release(data_, len_);
       }
 
       size_t read_pos_;
@@ -130,6 +156,8 @@ namespace node {
     size_t length_;
     Buffer* read_head_;
     Buffer* write_head_;
+
+    void FreeAll();
   };
 }//End Node Namespace
 
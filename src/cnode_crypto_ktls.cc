@@ -0,0 +1,310 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+#include "cnode_crypto_ktls.h"
+#include "uv.h"
+
+#if defined(__linux__)
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <stdint.h>
+
+// From <linux/tls.h>, which older build hosts lack
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef TLS_TX
+#define TLS_TX 1
+#endif
+#ifndef TLS_RX
+#define TLS_RX 2
+#endif
+#ifndef TLS_SET_RECORD_TYPE
+#define TLS_SET_RECORD_TYPE 1
+#endif
+#ifndef TLS_1_2_VERSION
+#define TLS_1_2_VERSION 0x0303
+#endif
+#ifndef TLS_CIPHER_AES_GCM_128
+#define TLS_CIPHER_AES_GCM_128 51
+#endif
+#ifndef TLS_CIPHER_AES_GCM_256
+#define TLS_CIPHER_AES_GCM_256 52
+#endif
+
+// From ssl_locl.h, the cipher's PRF digest bits in algorithm2
+#ifndef TLS1_PRF_SHA384
+#define TLS1_PRF_SHA384 (0x80 << 10)
+#endif
+#endif  // defined(__linux__)
+
+namespace node {
+
+#if defined(__linux__)
+  // struct tls12_crypto_info_aes_gcm_{128,256}
+  struct KTLSCryptoInfo128 {
+    uint16_t version;
+    uint16_t cipher_type;
+    unsigned char iv[8];
+    unsigned char key[16];
+    unsigned char salt[4];
+    unsigned char rec_seq[8];
+  };
+
+  struct KTLSCryptoInfo256 {
+    uint16_t version;
+    uint16_t cipher_type;
+    unsigned char iv[8];
+    unsigned char key[32];
+    unsigned char salt[4];
+    unsigned char rec_seq[8];
+  };
+
+  static const size_t kSaltLength = 4;
+  static const size_t kRandomLength = SSL3_RANDOM_SIZE;
+
+
+  static int KeyLength(SSL* ssl) {
+    if (ssl->enc_write_ctx == NULL)
+      return 0;
+    switch (EVP_CIPHER_CTX_nid(ssl->enc_write_ctx)) {
+      case NID_aes_128_gcm:
+        return 16;
+      case NID_aes_256_gcm:
+        return 32;
+      default:
+        return 0;
+    }
+  }
+
+
+  // TLS 1.2 PRF (RFC 5246, section 5)
+  static void PHash(const EVP_MD* md,
+                    const unsigned char* secret,
+                    size_t secret_len,
+                    const unsigned char* seed,
+                    size_t seed_len,
+                    unsigned char* out,
+                    size_t out_len) {
+    unsigned char a[EVP_MAX_MD_SIZE];
+    unsigned char block[EVP_MAX_MD_SIZE];
+    unsigned int a_len;
+    unsigned int block_len;
+    HMAC_CTX ctx;
+
+    HMAC_CTX_init(&ctx);
+    // A(1)
+    HMAC(md, secret, secret_len, seed, seed_len, a, &a_len);
+    while (out_len > 0) {
+      HMAC_Init_ex(&ctx, secret, secret_len, md, NULL);
+      HMAC_Update(&ctx, a, a_len);
+      HMAC_Update(&ctx, seed, seed_len);
+      HMAC_Final(&ctx, block, &block_len);
+
+      size_t n = block_len < out_len ? block_len : out_len;
+      memcpy(out, block, n);
+      out += n;
+      out_len -= n;
+
+      // A(i + 1)
+      HMAC_Init_ex(&ctx, secret, secret_len, md, NULL);
+      HMAC_Update(&ctx, a, a_len);
+      HMAC_Final(&ctx, a, &a_len);
+    }
+    HMAC_CTX_cleanup(&ctx);
+
+    OPENSSL_cleanse(a, sizeof(a));
+    OPENSSL_cleanse(block, sizeof(block));
+  }
+
+
+  // Fill one direction of the crypto info from the key block
+  template <typename Info>
+  static void FillInfo(Info* info,
+                       int cipher_type,
+                       const unsigned char* key,
+                       const unsigned char* salt,
+                       const unsigned char* seq) {
+    memset(info, 0, sizeof(*info));
+    info->version = TLS_1_2_VERSION;
+    info->cipher_type = cipher_type;
+    memcpy(info->key, key, sizeof(info->key));
+    memcpy(info->salt, salt, sizeof(info->salt));
+    memcpy(info->rec_seq, seq, sizeof(info->rec_seq));
+    // Explicit nonces continue from the record sequence number
+    memcpy(info->iv, seq, sizeof(info->iv));
+  }
+
+
+  template <typename Info>
+  static int Install(int fd,
+                     int direction,
+                     int cipher_type,
+                     const unsigned char* key,
+                     const unsigned char* salt,
+                     const unsigned char* seq) {
+    Info info;
+    FillInfo(&info, cipher_type, key, salt, seq);
+    int r = setsockopt(fd, SOL_TLS, direction, &info, sizeof(info));
+    OPENSSL_cleanse(&info, sizeof(info));
+    return r == -1 ? -errno : 0;
+  }
+
+
+  bool KernelTLS::Supported(SSL* ssl) {
+    return SSL_version(ssl) == TLS1_2_VERSION &&
+           SSL_is_init_finished(ssl) &&
+           KeyLength(ssl) != 0;
+  }
+
+
+  int KernelTLS::Enable(SSL* ssl, int fd, bool* rx_installed) {
+    *rx_installed = false;
+    if (!Supported(ssl))
+      return UV_ENOTSUP;
+
+    const int key_len = KeyLength(ssl);
+    const int cipher_type = key_len == 16 ? TLS_CIPHER_AES_GCM_128 :
+                                            TLS_CIPHER_AES_GCM_256;
+    // The PRF digest the handshake used, SHA-256 unless the suite says
+    // otherwise
+    const EVP_MD* md =
+        (ssl->s3->tmp.new_cipher->algorithm2 & TLS1_PRF_SHA384) != 0 ?
+            EVP_sha384() : EVP_sha256();
+
+    // key_block = client key, server key, client salt, server salt
+    static const char label[] = "key expansion";
+    unsigned char seed[sizeof(label) - 1 + 2 * kRandomLength];
+    memcpy(seed, label, sizeof(label) - 1);
+    memcpy(seed + sizeof(label) - 1, ssl->s3->server_random, kRandomLength);
+    memcpy(seed + sizeof(label) - 1 + kRandomLength,
+           ssl->s3->client_random,
+           kRandomLength);
+
+    unsigned char block[2 * 32 + 2 * kSaltLength];
+    size_t block_len = 2 * key_len + 2 * kSaltLength;
+    PHash(md,
+          ssl->session->master_key,
+          ssl->session->master_key_length,
+          seed,
+          sizeof(seed),
+          block,
+          block_len);
+
+    const unsigned char* client_key = block;
+    const unsigned char* server_key = block + key_len;
+    const unsigned char* client_salt = block + 2 * key_len;
+    const unsigned char* server_salt = client_salt + kSaltLength;
+    const bool server = ssl->server != 0;
+
+    int err = 0;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) == -1)
+      err = -errno;
+
+    // RX first: without it alerts and renegotiation from the peer would
+    // reach an OpenSSL that no longer owns the write side.  A socket with
+    // the ULP but no keys still passes data through untouched.
+    if (err == 0) {
+      const unsigned char* key = server ? client_key : server_key;
+      const unsigned char* salt = server ? client_salt : server_salt;
+      if (key_len == 16) {
+        err = Install<KTLSCryptoInfo128>(fd, TLS_RX, cipher_type, key, salt,
+                                         ssl->s3->read_sequence);
+      } else {
+        err = Install<KTLSCryptoInfo256>(fd, TLS_RX, cipher_type, key, salt,
+                                         ssl->s3->read_sequence);
+      }
+      *rx_installed = err == 0;
+    }
+
+    if (err == 0) {
+      const unsigned char* key = server ? server_key : client_key;
+      const unsigned char* salt = server ? server_salt : client_salt;
+      if (key_len == 16) {
+        err = Install<KTLSCryptoInfo128>(fd, TLS_TX, cipher_type, key, salt,
+                                         ssl->s3->write_sequence);
+      } else {
+        err = Install<KTLSCryptoInfo256>(fd, TLS_TX, cipher_type, key, salt,
+                                         ssl->s3->write_sequence);
+      }
+    }
+
+    OPENSSL_cleanse(block, sizeof(block));
+    return err;
+  }
+
+
+  int KernelTLS::SendCloseNotify(int fd) {
+    // Alert record: warning, close_notify
+    unsigned char alert[2] = { 1, 0 };
+    char control[CMSG_SPACE(sizeof(unsigned char))];
+    struct iovec iov;
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    iov.iov_base = alert;
+    iov.iov_len = sizeof(alert);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_TLS;
+    cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+    *CMSG_DATA(cmsg) = SSL3_RT_ALERT;
+
+    ssize_t r;
+    do {
+      r = sendmsg(fd, &msg, MSG_DONTWAIT);
+    } while (r == -1 && errno == EINTR);
+
+    return r == -1 ? -errno : 0;
+  }
+#else
+  bool KernelTLS::Supported(SSL* ssl) {
+    return false;
+  }
+
+
+  int KernelTLS::Enable(SSL* ssl, int fd, bool* rx_installed) {
+    *rx_installed = false;
+    return UV_ENOSYS;
+  }
+
+
+  int KernelTLS::SendCloseNotify(int fd) {
+    return UV_ENOSYS;
+  }
+#endif  // defined(__linux__)
+}//End Node Namespace
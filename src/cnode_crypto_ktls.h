@@ -0,0 +1,49 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+#ifndef SRC_NODE_CRYPTO_KTLS_H_
+#define SRC_NODE_CRYPTO_KTLS_H_
+
+#include <openssl/ssl.h>
+
+namespace node {
+
+  // Kernel TLS offload for established TLS 1.2 AES-GCM connections on
+  // Linux.  The record keys are re-derived from the master secret, the
+  // bundled OpenSSL keeps no copy of them after the handshake.
+  class KernelTLS {
+   public:
+    // Whether the negotiated version and cipher can be offloaded
+    static bool Supported(SSL* ssl);
+
+    // Attach the "tls" ULP to `fd` and install the receive keys, then the
+    // transmit keys.  Returns 0 once both are in, otherwise a uv error
+    // code; receive keys a failed TX install leaves behind are reported
+    // through `*rx_installed`.
+    static int Enable(SSL* ssl, int fd, bool* rx_installed);
+
+    // Send a close_notify alert through the kernel without blocking.
+    // Returns 0 or a uv error code, UV_EAGAIN with a full send buffer.
+    static int SendCloseNotify(int fd);
+  };
+}//End Node Namespace
+
+#endif //SRC_NODE_CRYPTO_KTLS_H_
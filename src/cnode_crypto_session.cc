@@ -0,0 +1,357 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+#include "cnode_crypto_session.h"
+
+#include <openssl/rand.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace node {
+
+  SessionCache::SessionCache(size_t max_bytes)
+      : max_bytes_(max_bytes),
+        bytes_(0),
+        hits_(0),
+        misses_(0),
+        lru_head_(NULL),
+        lru_tail_(NULL) {
+    if (uv_mutex_init(&mutex_))
+      abort();
+    unsigned int count = 64;
+    while (count < max_bytes / kAverageEntrySize && count < (1U << 20))
+      count <<= 1;
+    buckets_ = new Entry*[count];
+    memset(buckets_, 0, count * sizeof(*buckets_));
+    bucket_mask_ = count - 1;
+  }
+
+
+  SessionCache::~SessionCache() {
+    Clear();
+    delete[] buckets_;
+    uv_mutex_destroy(&mutex_);
+  }
+
+
+  unsigned int SessionCache::Hash(const unsigned char* id, unsigned int len) {
+    // FNV-1a, session IDs are random already
+    unsigned int hash = 2166136261U;
+    for (unsigned int i = 0; i < len; i++) {
+      hash ^= id[i];
+      hash *= 16777619U;
+    }
+    return hash;
+  }
+
+
+  SessionCache::Entry* SessionCache::Find(const unsigned char* id,
+                                          unsigned int len,
+                                          unsigned int hash) {
+    for (Entry* e = buckets_[hash & bucket_mask_]; e != NULL;
+         e = e->bucket_next) {
+      if (e->hash != hash)
+        continue;
+      unsigned int elen;
+      const unsigned char* eid = SSL_SESSION_get_id(e->sess, &elen);
+      if (elen == len && memcmp(eid, id, len) == 0)
+        return e;
+    }
+    return NULL;
+  }
+
+
+  void SessionCache::MoveToFront(Entry* e) {
+    if (lru_head_ == e)
+      return;
+
+    // Unlink
+    if (e->lru_prev != NULL)
+      e->lru_prev->lru_next = e->lru_next;
+    if (e->lru_next != NULL)
+      e->lru_next->lru_prev = e->lru_prev;
+    if (lru_tail_ == e)
+      lru_tail_ = e->lru_prev;
+
+    // Insert at head
+    e->lru_prev = NULL;
+    e->lru_next = lru_head_;
+    if (lru_head_ != NULL)
+      lru_head_->lru_prev = e;
+    lru_head_ = e;
+    if (lru_tail_ == NULL)
+      lru_tail_ = e;
+  }
+
+
+  void SessionCache::Remove(Entry* e) {
+    Entry** pos = &buckets_[e->hash & bucket_mask_];
+    while (*pos != e)
+      pos = &(*pos)->bucket_next;
+    *pos = e->bucket_next;
+
+    if (e->lru_prev != NULL)
+      e->lru_prev->lru_next = e->lru_next;
+    else
+      lru_head_ = e->lru_next;
+    if (e->lru_next != NULL)
+      e->lru_next->lru_prev = e->lru_prev;
+    else
+      lru_tail_ = e->lru_prev;
+
+    bytes_ -= e->size;
+    SSL_SESSION_free(e->sess);
+    delete e;
+  }
+
+
+  bool SessionCache::Add(SSL_SESSION* sess) {
+    unsigned int len;
+    const unsigned char* id = SSL_SESSION_get_id(sess, &len);
+    if (len == 0)
+      return false;
+
+    int der = i2d_SSL_SESSION(sess, NULL);
+    if (der <= 0)
+      return false;
+    size_t size = static_cast<size_t>(der) + sizeof(Entry);
+    if (size > max_bytes_)
+      return false;
+
+    unsigned int hash = Hash(id, len);
+    uv_mutex_lock(&mutex_);
+    Entry* old = Find(id, len, hash);
+    if (old != NULL)
+      Remove(old);
+
+    // Make room, oldest first
+    while (lru_tail_ != NULL && bytes_ + size > max_bytes_)
+      Remove(lru_tail_);
+
+    Entry* e = new Entry();
+    e->sess = sess;
+    e->size = size;
+    e->hash = hash;
+    e->bucket_next = buckets_[hash & bucket_mask_];
+    buckets_[hash & bucket_mask_] = e;
+    e->lru_prev = NULL;
+    e->lru_next = NULL;
+    MoveToFront(e);
+    bytes_ += size;
+    uv_mutex_unlock(&mutex_);
+
+    return true;
+  }
+
+
+  SSL_SESSION* SessionCache::Lookup(const unsigned char* id, unsigned int len) {
+    SSL_SESSION* sess = NULL;
+    uv_mutex_lock(&mutex_);
+    Entry* e = Find(id, len, Hash(id, len));
+    if (e != NULL) {
+      long expires = SSL_SESSION_get_time(e->sess) +
+                     SSL_SESSION_get_timeout(e->sess);
+      if (static_cast<long>(time(NULL)) >= expires) {
+        Remove(e);
+      } else {
+        MoveToFront(e);
+        // Taken under the lock, a concurrent Add() or eviction may free
+        // the entry's reference as soon as we unlock
+        sess = e->sess;
+        CRYPTO_add(&sess->references, 1, CRYPTO_LOCK_SSL_SESSION);
+      }
+    }
+    if (sess != NULL)
+      hits_++;
+    else
+      misses_++;
+    uv_mutex_unlock(&mutex_);
+    return sess;
+  }
+
+
+  void SessionCache::SetLimit(size_t max_bytes) {
+    uv_mutex_lock(&mutex_);
+    max_bytes_ = max_bytes;
+    while (lru_tail_ != NULL && bytes_ > max_bytes_)
+      Remove(lru_tail_);
+    uv_mutex_unlock(&mutex_);
+  }
+
+
+  void SessionCache::Clear() {
+    uv_mutex_lock(&mutex_);
+    while (lru_head_ != NULL)
+      Remove(lru_head_);
+    assert(bytes_ == 0);
+    uv_mutex_unlock(&mutex_);
+  }
+
+
+  TicketKeyRing::TicketKeyRing(unsigned int interval, unsigned int grace)
+      : interval_(interval),
+        grace_(grace),
+        count_(0) {
+    if (uv_mutex_init(&mutex_))
+      abort();
+  }
+
+
+  TicketKeyRing::~TicketKeyRing() {
+    uv_mutex_destroy(&mutex_);
+  }
+
+
+  bool TicketKeyRing::Generate(Key* key, time_t now) {
+    if (RAND_bytes(key->name, sizeof(key->name)) <= 0 ||
+        RAND_bytes(key->hmac, sizeof(key->hmac)) <= 0 ||
+        RAND_bytes(key->aes, sizeof(key->aes)) <= 0) {
+      return false;
+    }
+    key->created = now;
+    key->retired = 0;
+    return true;
+  }
+
+
+  bool TicketKeyRing::Init() {
+    if (!Generate(&keys_[0], time(NULL)))
+      return false;
+    count_ = 1;
+    return true;
+  }
+
+
+  bool TicketKeyRing::Reset(unsigned int interval, unsigned int grace) {
+    Key key;
+    if (!Generate(&key, time(NULL)))
+      return false;
+
+    uv_mutex_lock(&mutex_);
+    interval_ = interval;
+    grace_ = grace;
+    keys_[0] = key;
+    count_ = 1;
+    uv_mutex_unlock(&mutex_);
+    return true;
+  }
+
+
+  void TicketKeyRing::SetCurrent(const unsigned char* keys) {
+    time_t now = time(NULL);
+    uv_mutex_lock(&mutex_);
+    Retire(now);
+
+    Key* key = &keys_[0];
+    memcpy(key->name, keys, 16);
+    memcpy(key->hmac, keys + 16, 16);
+    memcpy(key->aes, keys + 32, 16);
+    key->created = now;
+    key->retired = 0;
+    uv_mutex_unlock(&mutex_);
+  }
+
+
+  void TicketKeyRing::GetCurrent(unsigned char* keys) {
+    uv_mutex_lock(&mutex_);
+    assert(count_ > 0);
+    memcpy(keys, keys_[0].name, 16);
+    memcpy(keys + 16, keys_[0].hmac, 16);
+    memcpy(keys + 32, keys_[0].aes, 16);
+    uv_mutex_unlock(&mutex_);
+  }
+
+
+  // Shift the current key into the grace list, leaving keys_[0] free
+  void TicketKeyRing::Retire(time_t now) {
+    if (count_ == 0) {
+      count_ = 1;
+      return;
+    }
+    if (count_ == kMaxKeys)
+      count_--;
+    memmove(&keys_[1], &keys_[0], count_ * sizeof(keys_[0]));
+    keys_[1].retired = now;
+    count_++;
+  }
+
+
+  void TicketKeyRing::Expire(time_t now) {
+    // Older keys were retired earlier, so trim from the end
+    while (count_ > 1 &&
+           now - keys_[count_ - 1].retired >= static_cast<time_t>(grace_)) {
+      count_--;
+    }
+  }
+
+
+  int TicketKeyRing::Handle(unsigned char* name,
+                            unsigned char* iv,
+                            EVP_CIPHER_CTX* ectx,
+                            HMAC_CTX* hctx,
+                            int enc) {
+    time_t now = time(NULL);
+    int r = 0;
+
+    uv_mutex_lock(&mutex_);
+    assert(count_ > 0);
+    Expire(now);
+
+    if (enc) {
+      // Rotation is checked whenever a new ticket is issued
+      if (interval_ != 0 &&
+          now - keys_[0].created >= static_cast<time_t>(interval_)) {
+        Key fresh;
+        if (Generate(&fresh, now)) {
+          Retire(now);
+          keys_[0] = fresh;
+        }
+      }
+
+      if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) <= 0) {
+        r = -1;
+      } else {
+        Key* key = &keys_[0];
+        memcpy(name, key->name, sizeof(key->name));
+        EVP_EncryptInit_ex(ectx, EVP_aes_128_cbc(), NULL, key->aes, iv);
+        HMAC_Init_ex(hctx, key->hmac, sizeof(key->hmac), EVP_sha256(), NULL);
+        r = 1;
+      }
+    } else {
+      // Unknown keys leave r at 0, a full handshake follows
+      for (int i = 0; i < count_; i++) {
+        Key* key = &keys_[i];
+        if (memcmp(name, key->name, sizeof(key->name)) != 0)
+          continue;
+        HMAC_Init_ex(hctx, key->hmac, sizeof(key->hmac), EVP_sha256(), NULL);
+        EVP_DecryptInit_ex(ectx, EVP_aes_128_cbc(), NULL, key->aes, iv);
+        // Ask for a fresh ticket when an old key was used
+        r = i == 0 ? 1 : 2;
+        break;
+      }
+    }
+    uv_mutex_unlock(&mutex_);
+
+    return r;
+  }
+}//End Node Namespace
@@ -0,0 +1,141 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+#ifndef SRC_NODE_CRYPTO_SESSION_H_
+#define SRC_NODE_CRYPTO_SESSION_H_
+
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include "uv.h"
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint64_t
+#include <time.h>    // time_t
+
+namespace node {
+
+  // Server side session store keyed by session ID.  Entries are kept in
+  // LRU order and evicted once their DER size exceeds the byte budget.
+  // Locked, offloaded handshakes reach it from the threadpool.
+  class SessionCache {
+   public:
+    explicit SessionCache(size_t max_bytes);
+    ~SessionCache();
+
+    // Takes over the caller's reference to `sess` on success
+    bool Add(SSL_SESSION* sess);
+
+    // Return a new reference to the session or NULL, the caller owns it.
+    // Expired sessions are dropped
+    SSL_SESSION* Lookup(const unsigned char* id, unsigned int len);
+
+    // Change the byte budget, evicting down to it.  The bucket count
+    // stays what the first budget made it
+    void SetLimit(size_t max_bytes);
+
+    void Clear();
+
+    inline uint64_t hits() const { return hits_; }
+    inline uint64_t misses() const { return misses_; }
+    inline size_t bytes() const { return bytes_; }
+
+   private:
+    // Rough per-entry size used to pick the bucket count
+    static const size_t kAverageEntrySize = 256;
+
+    struct Entry {
+      SSL_SESSION* sess;
+      size_t size;
+      unsigned int hash;
+      Entry* bucket_next;
+      Entry* lru_prev;
+      Entry* lru_next;
+    };
+
+    static unsigned int Hash(const unsigned char* id, unsigned int len);
+    Entry* Find(const unsigned char* id, unsigned int len, unsigned int hash);
+    void MoveToFront(Entry* e);
+    void Remove(Entry* e);
+
+    uv_mutex_t mutex_;
+    size_t max_bytes_;
+    size_t bytes_;
+    uint64_t hits_;
+    uint64_t misses_;
+    Entry** buckets_;
+    unsigned int bucket_mask_;
+    // Most recently used first
+    Entry* lru_head_;
+    Entry* lru_tail_;
+  };
+
+  // Session ticket keys that rotate every `interval` seconds.  Tickets
+  // are always sealed with the newest key, retired keys are still
+  // accepted for `grace` seconds and their tickets are renewed.
+  class TicketKeyRing {
+   public:
+    // Same layout as SSL_CTX_set_tlsext_ticket_keys: name, hmac, aes
+    static const size_t kKeysLength = 48;
+
+    TicketKeyRing(unsigned int interval, unsigned int grace);
+    ~TicketKeyRing();
+
+    // Generate the first key, false if the PRNG failed
+    bool Init();
+    // Start over with a fresh key and new periods, dropping retired keys.
+    // False if the PRNG failed, the ring is left alone then
+    bool Reset(unsigned int interval, unsigned int grace);
+    void SetCurrent(const unsigned char* keys);
+    void GetCurrent(unsigned char* keys);
+
+    // Body of the SSL_CTX_set_tlsext_ticket_key_cb callback
+    int Handle(unsigned char* name,
+               unsigned char* iv,
+               EVP_CIPHER_CTX* ectx,
+               HMAC_CTX* hctx,
+               int enc);
+
+   private:
+    static const int kMaxKeys = 4;
+
+    struct Key {
+      unsigned char name[16];
+      unsigned char hmac[16];
+      unsigned char aes[16];
+      time_t created;
+      time_t retired;
+    };
+
+    static bool Generate(Key* key, time_t now);
+    void Retire(time_t now);
+    void Expire(time_t now);
+
+    uv_mutex_t mutex_;
+    unsigned int interval_;
+    unsigned int grace_;
+    // keys_[0] is the current key, older keys follow
+    Key keys_[kMaxKeys];
+    int count_;
+  };
+}//End Node Namespace
+
+#endif //SRC_NODE_CRYPTO_SESSION_H_
@@ -69,9 +69,12 @@ namespace node {
 
   class FSReqWrap: public ReqWrap<uv_fs_t> {
    public:
-    void* operator new(size_t size) { return new char[size]; }
     void* operator new(size_t size, char* storage) { return storage; }
 
+    // This is just to keep the compiler happy. It should never be called, since
+    // we don't use exceptions in node.
+    void operator delete(void* ptr, char* storage) { assert(0); }
+
     FSReqWrap(Environment* env,
               Local<Object> req,
               const char* syscall,
@@ -99,6 +102,10 @@ namespace node {
     const char* syscall_;
     char* data_;
     unsigned int dest_len_;
+    // Storage comes from the environment's RequestPool, see ASYNC_DEST_CALL.
+    void* operator new(size_t size) { assert(0); }
+    void operator delete(void* ptr) { assert(0); }
+
     char dest_[1];
   };
 
@@ -253,7 +260,8 @@ namespace node {
     req_wrap->MakeCallback(env->oncomplete_string(), argc, argv);
 
     uv_fs_req_cleanup(&req_wrap->req_);
-    delete req_wrap;
+    req_wrap->~FSReqWrap();
+    env->request_pool()->Free(reinterpret_cast<char*>(req_wrap));
   }
 
   // This struct is only used on sync fs calls.
@@ -272,7 +280,8 @@ namespace node {
     FSReqWrap* req_wrap;                                                        \
     char* dest_str = (dest_path);                                               \
     int dest_len = dest_str == NULL ? 0 : strlen(dest_str);                     \
-    char* storage = new char[sizeof(*req_wrap) + dest_len];                     \
+    char* storage =                                                             \
+        env->request_pool()->Allocate(sizeof(*req_wrap) + dest_len);            \
     CHECK(req->IsObject());                                                     \
     req_wrap = new(storage) FSReqWrap(env, req.As<Object>(), #func);            \
     req_wrap->dest_len(dest_len);                                               \
@@ -894,8 +903,11 @@ namespace node {
       return args.GetReturnValue().Set(SYNC_RESULT);
     }
 
-    FSReqWrap* req_wrap =
-        new FSReqWrap(env, req.As<Object>(), "write", must_free ? buf : NULL);
+    char* storage = env->request_pool()->Allocate(sizeof(FSReqWrap));
+    FSReqWrap* req_wrap = new(storage) FSReqWrap(env,
+                                                 req.As<Object>(),
+                                                 "write",
+                                                 must_free ? buf : NULL);
     int err = uv_fs_write(env->event_loop(),
                           &req_wrap->req_,
                           fd,
@@ -87,6 +87,9 @@ namespace node{
   // If |info| is omitted, a new object is returned.
   Local<Object> AddressToJS(Environment* env,  const sockaddr* addr, Local<Object> info = Handle<Object>());
 
+  // Same family, address and port. Only AF_INET and AF_INET6 compare equal.
+  bool SameAddress(const sockaddr* a, const sockaddr* b);
+
   enum Endianness {
     kLittleEndian,  // _Not_ LITTLE_ENDIAN, clashes with endian.h.
     kBigEndian
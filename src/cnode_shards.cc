@@ -0,0 +1,198 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#include "cnode_shards.h"
+#include "cenv.h"
+#include "cenv-inl.h"
+#include "chandle_wrap.h"
+#include "cqueue.h"
+#include "cutil.h"
+#include "cutil-inl.h"
+
+namespace node {
+  using v8::Context;
+  using v8::HandleScope;
+  using v8::Integer;
+  using v8::Isolate;
+  using v8::Local;
+  using v8::Locker;
+  using v8::Object;
+
+  LoopShards::LoopShards(int count,
+                         int argc,
+                         const char* const* argv,
+                         int exec_argc,
+                         const char* const* exec_argv,
+                         ShardMain main,
+                         void* arg)
+      : count_(count),
+        argc_(argc),
+        argv_(argv),
+        exec_argc_(exec_argc),
+        exec_argv_(exec_argv),
+        main_(main),
+        arg_(arg),
+        shards_(NULL) {
+    CHECK_GT(count, 0);
+  }
+
+
+  LoopShards::~LoopShards() {
+    Stop();
+  }
+
+
+  // V8 must already be initialized; each shard creates its own isolate.
+  int LoopShards::Start() {
+    CHECK_EQ(shards_, NULL);
+    shards_ = new Shard[count_];
+
+    for (int i = 0; i < count_; i++) {
+      Shard* shard = &shards_[i];
+      shard->parent = this;
+      shard->index = i;
+      shard->env = NULL;
+      shard->started = false;
+
+      int err = uv_loop_init(&shard->loop);
+      if (err == 0) {
+        err = uv_async_init(&shard->loop, &shard->stop_async, OnStop);
+        if (err != 0)
+          uv_loop_close(&shard->loop);
+      }
+      if (err == 0) {
+        err = uv_thread_create(&shard->thread, Run, shard);
+        if (err != 0) {
+          uv_close(reinterpret_cast<uv_handle_t*>(&shard->stop_async), NULL);
+          uv_run(&shard->loop, UV_RUN_DEFAULT);
+          uv_loop_close(&shard->loop);
+        }
+      }
+      if (err != 0) {
+        Stop();
+        return err;
+      }
+      shard->started = true;
+    }
+
+    return 0;
+  }
+
+
+  void LoopShards::Stop() {
+    if (shards_ == NULL)
+      return;
+
+    for (int i = 0; i < count_; i++) {
+      if (shards_[i].started)
+        uv_async_send(&shards_[i].stop_async);
+    }
+
+    for (int i = 0; i < count_; i++) {
+      if (shards_[i].started)
+        uv_thread_join(&shards_[i].thread);
+    }
+
+    delete[] shards_;
+    shards_ = NULL;
+  }
+
+
+  void LoopShards::Run(void* arg) {
+    Shard* shard = static_cast<Shard*>(arg);
+    LoopShards* self = shard->parent;
+
+    Isolate* isolate = Isolate::New();
+    {
+      Locker locker(isolate);
+      Isolate::Scope isolate_scope(isolate);
+      HandleScope handle_scope(isolate);
+      Local<Context> context = Context::New(isolate);
+      Environment* env = CreateEnvironment(isolate,
+                                           &shard->loop,
+                                           context,
+                                           self->argc_,
+                                           self->argv_,
+                                           self->exec_argc_,
+                                           self->exec_argv_);
+      Context::Scope context_scope(context);
+      shard->env = env;
+
+      Local<Object> process_object = env->process_object();
+      process_object->Set(env->shard_index_string(),
+                          Integer::New(isolate, shard->index));
+      process_object->Set(env->shard_count_string(),
+                          Integer::New(isolate, self->count_));
+
+      if (self->main_ != NULL)
+        self->main_(env, shard->index, self->arg_);
+      else
+        LoadEnvironment(env);
+
+      // stop_async keeps the loop alive until Stop(); OnStop then closes
+      // every handle wrap and the loop drains here.
+      uv_run(&shard->loop, UV_RUN_DEFAULT);
+
+      // The environment's own handles (immediate/idle watchers, the TCP
+      // pool timer, the RTT sampler, ...) go through their cleanups.
+      // Anything still open after that has no owner to tell.
+      env->CleanupHandles();
+      uv_walk(&shard->loop, CloseHandle, NULL);
+      uv_run(&shard->loop, UV_RUN_DEFAULT);
+
+      env->Dispose();
+    }
+    isolate->Dispose();
+
+    int err = uv_loop_close(&shard->loop);
+    CHECK_EQ(0, err);
+  }
+
+
+  // Handle wraps close through HandleWrap::OnClose() so they free their
+  // callbacks, requests and SSL state.  Everything else only stops keeping
+  // the loop alive, Run() hands it to the registered cleanups.
+  void LoopShards::OnStop(uv_async_t* async) {
+    Shard* shard = ContainerOf(&Shard::stop_async, async);
+    Environment* env = shard->env;
+
+    QUEUE* q;
+    QUEUE_FOREACH(q, env->handle_wrap_queue()) {
+      HandleWrap* wrap = ContainerOf(&HandleWrap::handle_wrap_queue_, q);
+      wrap->CloseHandle();
+    }
+
+    uv_close(reinterpret_cast<uv_handle_t*>(async), NULL);
+    uv_walk(async->loop, UnrefHandle, NULL);
+  }
+
+
+  void LoopShards::UnrefHandle(uv_handle_t* handle, void* arg) {
+    uv_unref(handle);
+  }
+
+
+  void LoopShards::CloseHandle(uv_handle_t* handle, void* arg) {
+    if (!uv_is_closing(handle))
+      uv_close(handle, NULL);
+  }
+}//End Node Namespace
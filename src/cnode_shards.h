@@ -0,0 +1,82 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#ifndef SRC_NODE_SHARDS_H_
+#define SRC_NODE_SHARDS_H_
+
+#include "cnode.h"
+#include "v8.h"
+#include "uv.h"
+
+namespace node {
+  // Runs the same program on N threads, each with its own loop, isolate and
+  // Environment.  Every shard sees process.shardIndex/shardCount and is
+  // expected to bind its listener with reusePort so the kernel spreads
+  // connections across the shards.
+  class LoopShards {
+   public:
+    // Called on the shard thread in place of LoadEnvironment() when set.
+    typedef void (*ShardMain)(Environment* env, int index, void* arg);
+
+    LoopShards(int count,
+               int argc,
+               const char* const* argv,
+               int exec_argc,
+               const char* const* exec_argv,
+               ShardMain main = NULL,
+               void* arg = NULL);
+    ~LoopShards();
+
+    int Start();
+    // Stops every loop and joins the threads.  Safe to call more than once.
+    void Stop();
+
+    inline int count() const { return count_; }
+
+   private:
+    struct Shard {
+      LoopShards* parent;
+      int index;
+      uv_thread_t thread;
+      uv_loop_t loop;
+      uv_async_t stop_async;
+      Environment* env;  // Set by the shard thread once created.
+      bool started;
+    };
+
+    static void Run(void* arg);
+    static void OnStop(uv_async_t* async);
+    static void UnrefHandle(uv_handle_t* handle, void* arg);
+    static void CloseHandle(uv_handle_t* handle, void* arg);
+
+    const int count_;
+    const int argc_;
+    const char* const* argv_;
+    const int exec_argc_;
+    const char* const* exec_argv_;
+    ShardMain main_;
+    void* arg_;
+    Shard* shards_;
+  };
+}//End Node Namespace
+
+#endif //SRC_NODE_SHARDS_H_
@@ -0,0 +1,741 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#include "cpipe_shm.h"
+#include "cenv.h"
+#include "cenv-inl.h"
+#include "cutil.h"
+#include "cutil-inl.h"
+
+#include <assert.h>
+#include <string.h>  // memcpy(), memset()
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MFD_CLOEXEC
+# define MFD_CLOEXEC 1
+#endif
+#ifndef MFD_ALLOW_SEALING
+# define MFD_ALLOW_SEALING 2
+#endif
+#ifndef F_ADD_SEALS
+# define F_ADD_SEALS 1033
+# define F_GET_SEALS 1034
+# define F_SEAL_SEAL 1
+# define F_SEAL_SHRINK 2
+# define F_SEAL_GROW 4
+#endif
+#endif  // defined(__linux__)
+
+namespace node {
+#if defined(__linux__)
+  using v8::Context;
+  using v8::HandleScope;
+  using v8::Integer;
+  using v8::Local;
+  using v8::Value;
+
+  // Control block at the start of each ring, `capacity` bytes of data
+  // follow. head and tail count bytes since the start, each on its own
+  // cache line. The peer can write either, so every access checks that
+  // they are at most `capacity` apart and fails with UV_EPROTO otherwise.
+  struct ShmCallbacks::Ring {
+    uint64_t head;  // Written by the producer.
+    char pad0[56];
+    uint64_t tail;  // Written by the consumer.
+    char pad1[56];
+    uint32_t reader_waiting;  // The consumer wants a wakeup on new data.
+    uint32_t writer_waiting;  // The producer wants a wakeup on free space.
+    char pad2[56];
+
+    inline char* data() {
+      return reinterpret_cast<char*>(this + 1);
+    }
+
+    // Copies in as much as fits, returns the number of bytes.
+    ssize_t Write(size_t capacity, const char* src, size_t len) {
+      uint64_t head = __atomic_load_n(&this->head, __ATOMIC_RELAXED);
+      uint64_t tail = __atomic_load_n(&this->tail, __ATOMIC_ACQUIRE);
+      if (head - tail > capacity)
+        return UV_EPROTO;
+      size_t space = capacity - static_cast<size_t>(head - tail);
+      if (len > space)
+        len = space;
+      size_t offset = head & (capacity - 1);
+      size_t first = capacity - offset < len ? capacity - offset : len;
+      memcpy(data() + offset, src, first);
+      memcpy(data(), src + first, len - first);
+      __atomic_store_n(&this->head, head + len, __ATOMIC_RELEASE);
+      return len;
+    }
+
+    // Copies out up to `len` bytes, returns the number of bytes.
+    ssize_t Read(size_t capacity, char* dst, size_t len) {
+      uint64_t head = __atomic_load_n(&this->head, __ATOMIC_ACQUIRE);
+      uint64_t tail = __atomic_load_n(&this->tail, __ATOMIC_RELAXED);
+      if (head - tail > capacity)
+        return UV_EPROTO;
+      size_t avail = static_cast<size_t>(head - tail);
+      if (len > avail)
+        len = avail;
+      size_t offset = tail & (capacity - 1);
+      size_t first = capacity - offset < len ? capacity - offset : len;
+      memcpy(dst, data() + offset, first);
+      memcpy(dst + first, data(), len - first);
+      __atomic_store_n(&this->tail, tail + len, __ATOMIC_RELEASE);
+      return len;
+    }
+
+    inline ssize_t Available(size_t capacity) {
+      uint64_t head = __atomic_load_n(&this->head, __ATOMIC_ACQUIRE);
+      uint64_t tail = __atomic_load_n(&this->tail, __ATOMIC_RELAXED);
+      if (head - tail > capacity)
+        return UV_EPROTO;
+      return static_cast<ssize_t>(head - tail);
+    }
+  };
+
+  struct ShmCallbacks::Poll {
+    uv_poll_t handle;
+    int fd;  // Owned, closed along with the handle.
+    ShmCallbacks* callbacks;  // NULL once the callbacks are gone.
+  };
+
+  struct ShmCallbacks::Pending {
+    QUEUE member;  // Member of ShmCallbacks::pending_.
+    WriteWrap* w;
+    uv_write_cb cb;
+    uv_buf_t* bufs;  // What is left to copy, from `index` on.
+    size_t count;
+    size_t index;
+  };
+
+  // Sent over the pipe along with the memfd and both eventfds.
+  struct ShmOffer {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+  };
+
+  static const uint32_t kOfferMagic = 0x4d485343;  // "CSHM"
+  static const uint32_t kOfferVersion = 1;
+  // The size can't change under either side's mapping, a shrunk file
+  // would SIGBUS the next ring access.
+  static const int kOfferSeals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+  static const size_t kReadChunk = 64 * 1024;
+  static const unsigned int kMaxReadsPerWakeup = 16;
+
+
+  ShmCallbacks::ShmCallbacks(StreamWrap* wrap)
+      : StreamWrapCallbacks(wrap),
+        map_(NULL),
+        map_size_(0),
+        capacity_(0),
+        out_(NULL),
+        in_(NULL),
+        accept_poll_(NULL),
+        doorbell_(NULL),
+        peer_fd_(-1),
+        error_(0),
+        shutdown_req_(NULL),
+        shutdown_cb_(NULL) {
+    QUEUE_INIT(&pending_);
+  }
+
+
+  ShmCallbacks::~ShmCallbacks() {
+    // The stream is gone, drop the writes that never completed, like
+    // ~StreamWrap does with corked ones.
+    RequestPool* pool = wrap()->env()->request_pool();
+    while (!QUEUE_EMPTY(&pending_)) {
+      QUEUE* q = QUEUE_HEAD(&pending_);
+      QUEUE_REMOVE(q);
+      Pending* pending = ContainerOf(&Pending::member, q);
+      pending->w->~WriteWrap();
+      pool->Free(reinterpret_cast<char*>(pending->w));
+      delete[] pending->bufs;
+      delete pending;
+    }
+    if (shutdown_req_ != NULL) {
+      shutdown_req_->~ShutdownWrap();
+      pool->Free(reinterpret_cast<char*>(shutdown_req_));
+    }
+
+    ClosePoll(accept_poll_);
+    ClosePoll(doorbell_);
+    if (peer_fd_ != -1)
+      close(peer_fd_);
+    if (map_ != NULL)
+      munmap(map_, map_size_);
+  }
+
+
+  int ShmCallbacks::Offer(size_t capacity) {
+  #if defined(SYS_memfd_create)
+    int fds[3];  // The memfd, then side 0's and side 1's eventfd.
+    int err = 0;
+
+    fds[0] = syscall(SYS_memfd_create,
+                     "cnode-shm",
+                     MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fds[0] == -1)
+      return -errno;
+
+    if (ftruncate(fds[0], 2 * (sizeof(Ring) + capacity)) == -1)
+      err = -errno;
+    if (err == 0 && fcntl(fds[0], F_ADD_SEALS, kOfferSeals) == -1)
+      err = -errno;
+    if (err == 0)
+      err = Map(fds[0], capacity, 0);
+
+    fds[1] = -1;
+    if (err == 0 && (fds[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1)
+      err = -errno;
+    if (err == 0 && (peer_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1)
+      err = -errno;
+    fds[2] = peer_fd_;
+
+    if (err == 0) {
+      err = StartPoll(fds[1], OnDoorbell, &doorbell_);
+    } else if (fds[1] != -1) {
+      close(fds[1]);
+    }
+
+    if (err == 0) {
+      ShmOffer offer;
+      memset(&offer, 0, sizeof(offer));
+      offer.magic = kOfferMagic;
+      offer.version = kOfferVersion;
+      offer.capacity = capacity;
+
+      iovec iov;
+      iov.iov_base = &offer;
+      iov.iov_len = sizeof(offer);
+
+      char control[CMSG_SPACE(sizeof(fds))];
+      memset(control, 0, sizeof(control));
+      msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+
+      cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+      memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+      ssize_t r;
+      do {
+        r = sendmsg(wrap()->stream()->io_watcher.fd,
+                    &msg,
+                    MSG_DONTWAIT | MSG_NOSIGNAL);
+      } while (r == -1 && errno == EINTR);
+
+      if (r == -1)
+        err = -errno;
+      else if (r != sizeof(offer))
+        err = UV_EIO;  // Half an offer, the pipe is unusable now.
+    }
+
+    // The mapping stays, the peer has its own copy of the descriptor.
+    close(fds[0]);
+    return err;
+  #else
+    return UV_ENOSYS;
+  #endif
+  }
+
+
+  int ShmCallbacks::Accept() {
+    int fd = dup(wrap()->stream()->io_watcher.fd);
+    if (fd == -1)
+      return -errno;
+    return StartPoll(fd, OnOffer, &accept_poll_);
+  }
+
+
+  int ShmCallbacks::Map(int fd, size_t capacity, int side) {
+    size_t size = 2 * (sizeof(Ring) + capacity);
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+      return -errno;
+
+    map_ = static_cast<char*>(base);
+    map_size_ = size;
+    capacity_ = capacity;
+
+    // Side 0 writes the first ring, side 1 the second.
+    Ring* first = reinterpret_cast<Ring*>(map_);
+    Ring* second = reinterpret_cast<Ring*>(map_ + sizeof(Ring) + capacity);
+    out_ = side == 0 ? first : second;
+    in_ = side == 0 ? second : first;
+    return 0;
+  }
+
+
+  // Takes ownership of `fd`, also on failure.
+  int ShmCallbacks::StartPoll(int fd, uv_poll_cb cb, Poll** poll) {
+    Poll* p = new Poll;
+    p->fd = fd;
+    p->callbacks = this;
+
+    int err = uv_poll_init(wrap()->env()->event_loop(), &p->handle, fd);
+    if (err) {
+      close(fd);
+      delete p;
+      return err;
+    }
+
+    err = uv_poll_start(&p->handle, UV_READABLE, cb);
+    if (err) {
+      ClosePoll(p);
+      return err;
+    }
+
+    *poll = p;
+    return 0;
+  }
+
+
+  void ShmCallbacks::ClosePoll(Poll* poll) {
+    if (poll == NULL)
+      return;
+    poll->callbacks = NULL;
+    uv_close(reinterpret_cast<uv_handle_t*>(&poll->handle), OnPollClose);
+  }
+
+
+  void ShmCallbacks::OnPollClose(uv_handle_t* handle) {
+    Poll* poll =
+        ContainerOf(&Poll::handle, reinterpret_cast<uv_poll_t*>(handle));
+    close(poll->fd);
+    delete poll;
+  }
+
+
+  void ShmCallbacks::Notify(int fd) {
+    uint64_t one = 1;
+    ssize_t r;
+    do {
+      r = write(fd, &one, sizeof(one));
+    } while (r == -1 && errno == EINTR);
+  }
+
+
+  // The waiting flags are set before the waiting side looks at the ring one
+  // last time, and tested after the other side updated it, so one of the
+  // two always notices.
+  void ShmCallbacks::SignalData() {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&out_->reader_waiting, 0, __ATOMIC_SEQ_CST))
+      Notify(peer_fd_);
+  }
+
+
+  void ShmCallbacks::SignalSpace() {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&in_->writer_waiting, 0, __ATOMIC_SEQ_CST))
+      Notify(peer_fd_);
+  }
+
+
+  void ShmCallbacks::OnOffer(uv_poll_t* handle, int status, int events) {
+    Poll* poll = ContainerOf(&Poll::handle, handle);
+    ShmCallbacks* callbacks = poll->callbacks;
+    if (callbacks == NULL)
+      return;
+    if (status < 0)
+      return callbacks->Fail(status);
+    callbacks->ReceiveOffer();
+  }
+
+
+  void ShmCallbacks::ReceiveOffer() {
+    ShmOffer offer;
+    int fds[3] = { -1, -1, -1 };
+    size_t received = 0;
+
+    iovec iov;
+    iov.iov_base = &offer;
+    iov.iov_len = sizeof(offer);
+
+    char control[CMSG_SPACE(sizeof(fds))];
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t r;
+    do {
+      r = recvmsg(accept_poll_->fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    } while (r == -1 && errno == EINTR);
+
+    if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+
+    int err = r == -1 ? -errno : 0;
+    if (r > 0) {
+      cmsghdr* cmsg;
+      for (cmsg = CMSG_FIRSTHDR(&msg);
+           cmsg != NULL;
+           cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+          continue;
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int* data = reinterpret_cast<int*>(CMSG_DATA(cmsg));
+        for (size_t i = 0; i < count; i++) {
+          if (received < ARRAY_SIZE(fds))
+            fds[received] = data[i];
+          else
+            close(data[i]);
+          received++;
+        }
+      }
+    }
+
+    if (r == 0) {
+      err = UV_EOF;
+    } else if (err == 0 &&
+               (r != sizeof(offer) ||
+                offer.magic != kOfferMagic ||
+                offer.version != kOfferVersion ||
+                received != ARRAY_SIZE(fds) ||
+                offer.capacity < 4096 ||
+                offer.capacity > kMaxCapacity ||
+                (offer.capacity & (offer.capacity - 1)) != 0)) {
+      err = UV_EPROTO;
+    }
+
+    // Sealed first, the size checked next can't change afterwards
+    if (err == 0) {
+      int seals = fcntl(fds[0], F_GET_SEALS);
+      if (seals == -1 || (seals & kOfferSeals) != kOfferSeals)
+        err = UV_EPROTO;
+    }
+
+    struct stat s;
+    if (err == 0 &&
+        (fstat(fds[0], &s) == -1 ||
+         static_cast<uint64_t>(s.st_size) <
+             2 * (sizeof(Ring) + offer.capacity))) {
+      err = UV_EPROTO;
+    }
+
+    if (err == 0)
+      err = Map(fds[0], offer.capacity, 1);
+    if (err == 0) {
+      peer_fd_ = fds[1];
+      fds[1] = -1;
+      err = StartPoll(fds[2], OnDoorbell, &doorbell_);
+      fds[2] = -1;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(fds); i++) {
+      if (fds[i] != -1)
+        close(fds[i]);
+    }
+    ClosePoll(accept_poll_);
+    accept_poll_ = NULL;
+
+    if (err)
+      return Fail(err);
+
+    // Writes made while waiting go out now, they complete from the
+    // doorbell.
+    Produce();
+    if (error_)
+      return Fail(error_);
+    Notify(doorbell_->fd);
+    Emit(0);
+  }
+
+
+  // Setup failed or the peer corrupted the rings, writes made so far and
+  // from now on fail with `err`.
+  void ShmCallbacks::Fail(int err) {
+    error_ = err;
+    ClosePoll(accept_poll_);
+    accept_poll_ = NULL;
+    ClosePoll(doorbell_);
+    doorbell_ = NULL;
+    Complete();
+    Emit(err);
+  }
+
+
+  void ShmCallbacks::Emit(int status) {
+    Environment* env = wrap()->env();
+    HandleScope handle_scope(env->isolate());
+    Context::Scope context_scope(env->context());
+    Local<Value> arg = Integer::New(env->isolate(), status);
+    wrap()->MakeCallback(env->onshm_string(), 1, &arg);
+  }
+
+
+  // Copies pending writes into the outgoing ring, returns true when all of
+  // them are in. A corrupt ring sets error_, the doorbell reports it.
+  bool ShmCallbacks::Produce() {
+    if (error_)
+      return false;
+    if (out_ == NULL)
+      return QUEUE_EMPTY(&pending_);
+
+    size_t total = 0;
+    bool full = false;
+    for (int attempt = 0; attempt < 2; attempt++) {
+      full = false;
+      QUEUE* q;
+      QUEUE_FOREACH(q, &pending_) {
+        Pending* pending = ContainerOf(&Pending::member, q);
+        while (pending->index < pending->count) {
+          uv_buf_t* buf = &pending->bufs[pending->index];
+          ssize_t n = out_->Write(capacity_, buf->base, buf->len);
+          if (n < 0) {
+            error_ = n;
+            return false;
+          }
+          total += n;
+          buf->base += n;
+          buf->len -= n;
+          if (buf->len != 0) {
+            full = true;
+            break;
+          }
+          pending->index++;
+        }
+        if (full)
+          break;
+      }
+      if (!full)
+        break;
+
+      // Ask for a wakeup once the peer made room, then look again in case
+      // it did so before it could see the flag.
+      __atomic_store_n(&out_->writer_waiting, 1, __ATOMIC_SEQ_CST);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+
+    if (total > 0)
+      SignalData();
+    return !full;
+  }
+
+
+  // Hands what the peer wrote to onread, while reading. Returns early after
+  // `limit` reads and leaves the rest to another wakeup.
+  void ShmCallbacks::Consume(unsigned int limit) {
+    if (in_ == NULL || error_)
+      return;
+
+    // libuv clears read_cb in uv_read_stop().
+    uv_stream_t* stream = wrap()->stream();
+    for (unsigned int i = 0; stream->read_cb != NULL; i++) {
+      if (i == limit) {
+        Notify(doorbell_->fd);
+        return;
+      }
+
+      ssize_t avail = in_->Available(capacity_);
+      if (avail == 0) {
+        __atomic_store_n(&in_->reader_waiting, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        avail = in_->Available(capacity_);
+        if (avail == 0)
+          return;
+      }
+      if (avail < 0) {
+        error_ = avail;
+        Notify(doorbell_->fd);
+        return;
+      }
+
+      uv_buf_t buf;
+      DoAlloc(reinterpret_cast<uv_handle_t*>(stream),
+              static_cast<size_t>(avail) < kReadChunk ? avail : kReadChunk,
+              &buf);
+      ssize_t n = in_->Read(capacity_, buf.base, buf.len);
+      if (n < 0) {
+        error_ = n;
+        StreamWrapCallbacks::DoRead(stream, 0, &buf, UV_UNKNOWN_HANDLE);
+        Notify(doorbell_->fd);
+        return;
+      }
+      SignalSpace();
+      StreamWrapCallbacks::DoRead(stream, n, &buf, UV_UNKNOWN_HANDLE);
+    }
+  }
+
+
+  // Finishes writes in order once all of their data is in the ring, or
+  // all of them after a failed setup.
+  void ShmCallbacks::Complete() {
+    while (!QUEUE_EMPTY(&pending_)) {
+      QUEUE* q = QUEUE_HEAD(&pending_);
+      Pending* pending = ContainerOf(&Pending::member, q);
+      if (error_ == 0 && pending->index < pending->count)
+        break;
+
+      QUEUE_REMOVE(q);
+      WriteWrap* w = pending->w;
+      uv_write_cb cb = pending->cb;
+      delete[] pending->bufs;
+      delete pending;
+
+      cb(&w->req_, error_);
+    }
+
+    if (QUEUE_EMPTY(&pending_) && shutdown_req_ != NULL) {
+      ShutdownWrap* req_wrap = shutdown_req_;
+      shutdown_req_ = NULL;
+      int err = StreamWrapCallbacks::DoShutdown(req_wrap, shutdown_cb_);
+      if (err) {
+        req_wrap->req_.handle = wrap()->stream();
+        shutdown_cb_(&req_wrap->req_, err);
+      }
+    }
+  }
+
+
+  void ShmCallbacks::OnDoorbell(uv_poll_t* handle, int status, int events) {
+    Poll* poll = ContainerOf(&Poll::handle, handle);
+    ShmCallbacks* callbacks = poll->callbacks;
+    if (callbacks == NULL || status < 0)
+      return;
+
+    // Resets the counter, the poll is level-triggered.
+    uint64_t value;
+    ssize_t r;
+    do {
+      r = read(poll->fd, &value, sizeof(value));
+    } while (r == -1 && errno == EINTR);
+
+    callbacks->Consume(kMaxReadsPerWakeup);
+    callbacks->Produce();
+    if (callbacks->error_)
+      return callbacks->Fail(callbacks->error_);
+    callbacks->Complete();
+  }
+
+
+  int ShmCallbacks::TryWrite(uv_buf_t** bufs, size_t* count) {
+    if (error_)
+      return error_;
+    // Earlier writes go first, DoWrite() queues until the offer arrived.
+    if (out_ == NULL || !QUEUE_EMPTY(&pending_))
+      return 0;
+
+    uv_buf_t* vbufs = *bufs;
+    size_t vcount = *count;
+    size_t total = 0;
+    while (vcount > 0) {
+      ssize_t n = out_->Write(capacity_, vbufs[0].base, vbufs[0].len);
+      if (n < 0) {
+        error_ = n;
+        Notify(doorbell_->fd);
+        return error_;
+      }
+      total += n;
+      if (static_cast<size_t>(n) < vbufs[0].len) {
+        vbufs[0].base += n;
+        vbufs[0].len -= n;
+        break;
+      }
+      vbufs++;
+      vcount--;
+    }
+
+    if (total > 0)
+      SignalData();
+
+    *bufs = vbufs;
+    *count = vcount;
+    return 0;
+  }
+
+
+  int ShmCallbacks::DoWrite(WriteWrap* w,
+                            uv_buf_t* bufs,
+                            size_t count,
+                            uv_stream_t* send_handle,
+                            uv_write_cb cb) {
+    if (send_handle != NULL)
+      return UV_ENOTSUP;
+    if (error_)
+      return error_;
+
+    Pending* pending = new Pending;
+    pending->w = w;
+    pending->cb = cb;
+    pending->bufs = new uv_buf_t[count > 0 ? count : 1];
+    memcpy(pending->bufs, bufs, count * sizeof(bufs[0]));
+    pending->count = count;
+    pending->index = 0;
+    QUEUE_INSERT_TAIL(&pending_, &pending->member);
+
+    // Completion is always asynchronous, from the doorbell, as is the
+    // report of a corrupt ring.
+    if (Produce() || error_)
+      Notify(doorbell_->fd);
+    return 0;
+  }
+
+
+  void ShmCallbacks::DoRead(uv_stream_t* handle,
+                            ssize_t nread,
+                            const uv_buf_t* buf,
+                            uv_handle_type pending) {
+    // Whatever the peer put in the ring came before its EOF.
+    if (nread < 0)
+      Consume(~0u);
+    StreamWrapCallbacks::DoRead(handle, nread, buf, pending);
+  }
+
+
+  int ShmCallbacks::DoShutdown(ShutdownWrap* req_wrap, uv_shutdown_cb cb) {
+    if (!QUEUE_EMPTY(&pending_)) {
+      shutdown_req_ = req_wrap;
+      shutdown_cb_ = cb;
+      return 0;
+    }
+    return StreamWrapCallbacks::DoShutdown(req_wrap, cb);
+  }
+
+
+  void ShmCallbacks::ReadStarted() {
+    if (doorbell_ != NULL)
+      Notify(doorbell_->fd);
+  }
+#endif  // defined(__linux__)
+
+}//End Node Namespace
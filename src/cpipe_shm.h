@@ -0,0 +1,106 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#ifndef SRC_PIPE_SHM_H_
+#define SRC_PIPE_SHM_H_
+
+#include "cstream_wrap.h"
+#include "cqueue.h"
+
+#include "uv.h"
+#include <stdint.h>
+
+namespace node {
+  // Shared-memory transport for a pipe between two processes on the same
+  // host. One side calls Offer(), which creates a pair of single-producer,
+  // single-consumer byte rings in a memfd and hands it to the peer over the
+  // pipe together with an eventfd per side; the other side calls Accept()
+  // while it is not reading from the pipe. After that writes are copied
+  // into the outgoing ring and reads come from the incoming one, through
+  // the usual onread/oncomplete callbacks. A side only gets an eventfd
+  // wakeup when the peer is waiting for data or space. The pipe itself
+  // stays open for the peer's EOF. Linux only.
+  class ShmCallbacks : public StreamWrapCallbacks {
+   public:
+    static const size_t kDefaultCapacity = 1 << 20;  // Per direction.
+    static const size_t kMaxCapacity = 1 << 30;
+
+    explicit ShmCallbacks(StreamWrap* wrap);
+    ~ShmCallbacks();
+
+    int Offer(size_t capacity);
+    // onshm(status) reports the outcome once the peer's offer arrived.
+    int Accept();
+
+    int TryWrite(uv_buf_t** bufs, size_t* count);
+    int DoWrite(WriteWrap* w,
+                uv_buf_t* bufs,
+                size_t count,
+                uv_stream_t* send_handle,
+                uv_write_cb cb);
+    void DoRead(uv_stream_t* handle,
+                ssize_t nread,
+                const uv_buf_t* buf,
+                uv_handle_type pending);
+    int DoShutdown(ShutdownWrap* req_wrap, uv_shutdown_cb cb);
+    void ReadStarted();
+
+    // Defined in cpipe_shm.cc.
+    struct Ring;
+    struct Poll;
+    struct Pending;
+
+   private:
+    int Map(int fd, size_t capacity, int side);
+    int StartPoll(int fd, uv_poll_cb cb, Poll** poll);
+    void ReceiveOffer();
+    void Fail(int err);
+    void Emit(int status);
+    bool Produce();
+    void Consume(unsigned int limit);
+    void Complete();
+    void SignalData();
+    void SignalSpace();
+
+    static void Notify(int fd);
+    static void ClosePoll(Poll* poll);
+    static void OnOffer(uv_poll_t* handle, int status, int events);
+    static void OnDoorbell(uv_poll_t* handle, int status, int events);
+    static void OnPollClose(uv_handle_t* handle);
+
+    char* map_;
+    size_t map_size_;
+    size_t capacity_;
+    struct Ring* out_;  // Written by this side.
+    struct Ring* in_;  // Written by the peer.
+    Poll* accept_poll_;  // Dup of the pipe, while waiting for the offer.
+    Poll* doorbell_;  // This side's eventfd.
+    int peer_fd_;  // The peer's eventfd.
+    int error_;  // Setup failed, writes fail with it.
+    QUEUE pending_;  // Writes not yet fully copied or not yet completed.
+    ShutdownWrap* shutdown_req_;  // Held back until pending_ is empty.
+    uv_shutdown_cb shutdown_cb_;
+  };
+
+}//End Node Namespace
+
+#endif //SRC_PIPE_SHM_H_
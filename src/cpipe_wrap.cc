@@ -20,6 +20,7 @@
 // USE OR OTHER DEALINGS IN THE SOFTWARE
 
 #include "cpipe_wrap.h"
+#include "cpipe_shm.h"
 #include "cenv.h"
 #include "cenv-inl.h"
 #include "cutil.h"
@@ -112,11 +113,23 @@ namespace node {
     NODE_SET_PROTOTYPE_METHOD(t,
                               "writeBinaryString",
                               StreamWrap::WriteBinaryString);
+    NODE_SET_PROTOTYPE_METHOD(t, "cork", StreamWrap::Cork);
+    NODE_SET_PROTOTYPE_METHOD(t, "uncork", StreamWrap::Uncork);
+    NODE_SET_PROTOTYPE_METHOD(t, "sendFile", StreamWrap::SendFile);
+    NODE_SET_PROTOTYPE_METHOD(t, "pipeTo", StreamWrap::PipeTo);
+    NODE_SET_PROTOTYPE_METHOD(t, "setReadBuffer", StreamWrap::SetReadBuffer);
+    NODE_SET_PROTOTYPE_METHOD(t, "setStatsEnabled", StreamWrap::SetStatsEnabled);
+    NODE_SET_PROTOTYPE_METHOD(t, "getStats", StreamWrap::GetStats);
+    NODE_SET_PROTOTYPE_METHOD(t, "setWriteWatermarks",
+                              StreamWrap::SetWriteWatermarks);
+    NODE_SET_PROTOTYPE_METHOD(t, "setAcceptBatch", StreamWrap::SetAcceptBatch);
 
     NODE_SET_PROTOTYPE_METHOD(t, "bind", Bind);
     NODE_SET_PROTOTYPE_METHOD(t, "listen", Listen);
     NODE_SET_PROTOTYPE_METHOD(t, "connect", Connect);
     NODE_SET_PROTOTYPE_METHOD(t, "open", Open);
+    NODE_SET_PROTOTYPE_METHOD(t, "shmOffer", ShmOffer);
+    NODE_SET_PROTOTYPE_METHOD(t, "shmAccept", ShmAccept);
 
   #ifdef _WIN32
     NODE_SET_PROTOTYPE_METHOD(t, "setPendingInstances", SetPendingInstances);
@@ -220,6 +233,8 @@ namespace node {
     };
 
     if (status != 0) {
+      // Keep the order, connections accepted before the error go first.
+      pipe_wrap->FlushAccepted();
       pipe_wrap->MakeCallback(env->onconnection_string(), ARRAY_SIZE(argv), argv);
       return;
     }
@@ -233,6 +248,9 @@ namespace node {
     if (uv_accept(handle, client_handle))
       return;
 
+    if (pipe_wrap->QueueAccepted(client_obj))
+      return;
+
     // Successful accept. Call the onconnection callback in JavaScript land.
     argv[1] = client_obj;
     pipe_wrap->MakeCallback(env->onconnection_string(), ARRAY_SIZE(argv), argv);
@@ -289,6 +307,80 @@ namespace node {
       env->isolate()->ThrowException(UVException(err, "uv_pipe_open"));
   }
 
+#if defined(__linux__)
+  // Shared-memory rings only replace a plain pipe's own reads and writes,
+  // and only before anything is queued on it.
+  static int ShmCheck(PipeWrap* wrap) {
+    if (wrap->is_named_pipe_ipc() || !wrap->has_default_callbacks())
+      return UV_ENOTSUP;
+    if (!wrap->is_idle())
+      return UV_EBUSY;
+    return 0;
+  }
+#endif
+
+  // shmOffer([capacity]) moves the pipe's data to shared-memory rings of
+  // `capacity` bytes each way, see ShmCallbacks. The peer calls
+  // shmAccept().
+  void PipeWrap::ShmOffer(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    PipeWrap* wrap = Unwrap<PipeWrap>(args.Holder());
+
+    size_t capacity = ShmCallbacks::kDefaultCapacity;
+    if (!args[0]->IsUndefined()) {
+      if (!args[0]->IsUint32())
+        return env->ThrowTypeError("capacity must be an unsigned integer");
+      capacity = args[0]->Uint32Value();
+    }
+    if (capacity < 4096 ||
+        capacity > ShmCallbacks::kMaxCapacity ||
+        (capacity & (capacity - 1)) != 0) {
+      return env->ThrowRangeError("capacity must be a power of two from 4096");
+    }
+
+  #if defined(__linux__)
+    int err = ShmCheck(wrap);
+    if (err == 0) {
+      ShmCallbacks* callbacks = new ShmCallbacks(wrap);
+      err = callbacks->Offer(capacity);
+      if (err == 0)
+        wrap->OverrideCallbacks(callbacks, false);
+      else
+        delete callbacks;
+    }
+    args.GetReturnValue().Set(err);
+  #else
+    args.GetReturnValue().Set(UV_ENOSYS);
+  #endif
+  }
+
+  // shmAccept() waits for the peer's shmOffer(), onshm(status) follows. The
+  // pipe must not be reading meanwhile, libuv would swallow the offer.
+  // Writes made before then are held back.
+  void PipeWrap::ShmAccept(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    PipeWrap* wrap = Unwrap<PipeWrap>(args.Holder());
+
+  #if defined(__linux__)
+    int err = ShmCheck(wrap);
+    if (err == 0) {
+      ShmCallbacks* callbacks = new ShmCallbacks(wrap);
+      err = callbacks->Accept();
+      if (err == 0)
+        wrap->OverrideCallbacks(callbacks, false);
+      else
+        delete callbacks;
+    }
+    args.GetReturnValue().Set(err);
+  #else
+    args.GetReturnValue().Set(UV_ENOSYS);
+  #endif
+  }
+
   void PipeWrap::Connect(const FunctionCallbackInfo<Value>& args) {
     HandleScope scope(args.GetIsolate());
     Environment* env = Environment::GetCurrent(args.GetIsolate());
@@ -40,6 +40,8 @@ namespace node {
     static void Listen(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void Connect(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void Open(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void ShmOffer(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void ShmAccept(const v8::FunctionCallbackInfo<v8::Value>& args);
 
   #ifdef _WIN32
     static void SetPendingInstances(
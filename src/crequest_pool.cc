@@ -0,0 +1,101 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#include "crequest_pool.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace node {
+
+  RequestPool::RequestPool() : hits_(0), misses_(0), pooled_bytes_(0) {
+    memset(free_, 0, sizeof(free_));
+    memset(free_count_, 0, sizeof(free_count_));
+  }
+
+
+  RequestPool::~RequestPool() {
+    for (size_t i = 0; i < kClassCount; i++) {
+      while (free_[i] != NULL) {
+        FreeBlock* block = free_[i];
+        free_[i] = block->next;
+        delete[] reinterpret_cast<char*>(block);
+      }
+    }
+  }
+
+
+  size_t RequestPool::ClassOf(size_t size) {
+    for (size_t i = 0; i < kClassCount; i++) {
+      if (size <= ClassSize(i))
+        return i;
+    }
+    return kUnpooled;
+  }
+
+
+  char* RequestPool::Allocate(size_t size) {
+    size_t size_class = ClassOf(size + kHeaderSize);
+    char* block;
+
+    if (size_class != kUnpooled && free_[size_class] != NULL) {
+      FreeBlock* head = free_[size_class];
+      free_[size_class] = head->next;
+      free_count_[size_class]--;
+      pooled_bytes_ -= ClassSize(size_class);
+      hits_++;
+      block = reinterpret_cast<char*>(head);
+    } else {
+      size_t length = size_class == kUnpooled ? size + kHeaderSize :
+                                                ClassSize(size_class);
+      block = new char[length];
+      misses_++;
+    }
+
+    // The header only needs the class, the rest keeps the payload aligned.
+    *reinterpret_cast<size_t*>(block) = size_class;
+    return block + kHeaderSize;
+  }
+
+
+  void RequestPool::Free(char* storage) {
+    if (storage == NULL)
+      return;
+
+    char* block = storage - kHeaderSize;
+    size_t size_class = *reinterpret_cast<size_t*>(block);
+    assert(size_class <= kUnpooled);
+
+    if (size_class == kUnpooled ||
+        free_count_[size_class] >= kMaxFreePerClass) {
+      delete[] block;
+      return;
+    }
+
+    FreeBlock* head = reinterpret_cast<FreeBlock*>(block);
+    head->next = free_[size_class];
+    free_[size_class] = head;
+    free_count_[size_class]++;
+    pooled_bytes_ += ClassSize(size_class);
+  }
+
+}//End Node Namespace
@@ -0,0 +1,74 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#ifndef SRC_REQUEST_POOL_H_
+#define SRC_REQUEST_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace node {
+
+  // Size-classed free lists for request storage (WriteWrap and its payload,
+  // ShutdownWrap, SendWrap, FSReqWrap). Requests are placement-new'd into
+  // the returned storage and handed back with Free() once destroyed.
+  class RequestPool {
+   public:
+    RequestPool();
+    ~RequestPool();
+
+    // Returned storage is 16 byte aligned.
+    char* Allocate(size_t size);
+    void Free(char* storage);
+
+    inline uint64_t hits() const { return hits_; }
+    inline uint64_t misses() const { return misses_; }
+    inline size_t pooled_bytes() const { return pooled_bytes_; }
+
+   private:
+    // Classes are powers of two from 256 bytes to 64 KB, anything larger
+    // goes straight to the heap.
+    static const size_t kMinClassShift = 8;
+    static const size_t kClassCount = 9;
+    static const size_t kUnpooled = kClassCount;
+    static const unsigned int kMaxFreePerClass = 64;
+    static const size_t kHeaderSize = 16;
+
+    struct FreeBlock {
+      FreeBlock* next;
+    };
+
+    static size_t ClassOf(size_t size);
+    static inline size_t ClassSize(size_t size_class) {
+      return static_cast<size_t>(1) << (size_class + kMinClassShift);
+    }
+
+    FreeBlock* free_[kClassCount];
+    unsigned int free_count_[kClassCount];
+    uint64_t hits_;
+    uint64_t misses_;
+    size_t pooled_bytes_;
+  };
+
+}//End Node Namespace
+
+#endif //SRC_REQUEST_POOL_H_
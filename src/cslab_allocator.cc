@@ -0,0 +1,101 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#include "cslab_allocator.h"
+#include "cnode_internal.h"
+#include "cnode_buffer.h"
+#include "cenv.h"
+#include "cenv-inl.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+namespace node {
+  using v8::Local;
+  using v8::Object;
+
+  // Slices handed to JS start on a 16 byte boundary.
+  static const size_t kSlabAlignment = 16;
+
+
+  SlabAllocator::~SlabAllocator() {
+    if (slab_ != NULL)
+      Unref(slab_);
+    slab_ = NULL;
+  }
+
+
+  SlabAllocator::Slab* SlabAllocator::NewSlab(size_t size) {
+    Slab* slab = new Slab;
+    slab->data = static_cast<char*>(malloc(size));
+    if (slab->data == NULL) {
+      FatalError("node::SlabAllocator::NewSlab(size_t)", "Out Of Memory");
+    }
+    slab->size = size;
+    slab->offset = 0;
+    slab->refs = 1;  // Owned by the allocator until it moves on.
+    return slab;
+  }
+
+
+  void SlabAllocator::Unref(Slab* slab) {
+    assert(slab->refs > 0);
+    if (--slab->refs > 0)
+      return;
+    free(slab->data);
+    delete slab;
+  }
+
+
+  void SlabAllocator::FreeCallback(char* data, void* hint) {
+    Slab* slab = static_cast<Slab*>(hint);
+    assert(data >= slab->data && data < slab->data + slab->size);
+    Unref(slab);
+  }
+
+
+  char* SlabAllocator::Allocate(size_t size) {
+    if (slab_ == NULL || slab_->size - slab_->offset < size) {
+      if (slab_ != NULL)
+        Unref(slab_);
+      slab_ = NewSlab(size > kSlabSize ? size : kSlabSize);
+    }
+    return slab_->data + slab_->offset;
+  }
+
+
+  Local<Object> SlabAllocator::Shrink(Environment* env,
+                                      char* data,
+                                      size_t length) {
+    assert(slab_ != NULL);
+    assert(data == slab_->data + slab_->offset);
+    assert(length > 0 && length <= slab_->size - slab_->offset);
+
+    slab_->offset += ROUND_UP(length, kSlabAlignment);
+    if (slab_->offset > slab_->size)
+      slab_->offset = slab_->size;
+    slab_->refs++;
+
+    return Buffer::New(env, data, length, FreeCallback, slab_);
+  }
+
+}//End Node Namespace
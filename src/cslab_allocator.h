@@ -0,0 +1,70 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#ifndef SRC_SLAB_ALLOCATOR_H_
+#define SRC_SLAB_ALLOCATOR_H_
+
+#include "v8.h"
+#include <stddef.h>
+
+namespace node {
+  class Environment;
+
+  // Hands out read buffers carved from large, reference counted slabs.
+  // Reads go into the unused tail of the current slab; Shrink() commits
+  // the bytes that were actually read and wraps them in a Buffer that
+  // keeps the slab alive until the Buffer is garbage collected.
+  class SlabAllocator {
+   public:
+    static const size_t kSlabSize = 1024 * 1024;
+
+    SlabAllocator() : slab_(NULL) {
+    }
+
+    ~SlabAllocator();
+
+    // Return `size` bytes of writable space. Nothing is committed until
+    // Shrink() is called, so a read that returns no data needs no cleanup.
+    char* Allocate(size_t size);
+
+    // Commit the first `length` bytes of the space returned by the last
+    // call to Allocate() and return a Buffer that points into the slab.
+    v8::Local<v8::Object> Shrink(Environment* env, char* data, size_t length);
+
+   private:
+    struct Slab {
+      char* data;
+      size_t size;
+      size_t offset;
+      unsigned int refs;
+    };
+
+    static Slab* NewSlab(size_t size);
+    static void Unref(Slab* slab);
+    static void FreeCallback(char* data, void* hint);
+
+    Slab* slab_;
+  };
+
+}//End Node Namespace
+
+#endif //SRC_SLAB_ALLOCATOR_H_
@@ -0,0 +1,549 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#include "cstream_pipe.h"
+#include "cnode_internal.h"
+#include "cnode_counters.h"
+#include "cenv.h"
+#include "cenv-inl.h"
+#include "cutil.h"
+#include "cutil-inl.h"
+
+#include <assert.h>
+#include <string.h>  // memcpy()
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>  // splice()
+#include <unistd.h>  // pipe2(), dup(), close()
+#endif
+
+namespace node {
+  using v8::Context;
+  using v8::HandleScope;
+  using v8::Integer;
+  using v8::Local;
+  using v8::Number;
+  using v8::Value;
+
+  // A read buffer and the write that forwards it, carved from one
+  // RequestPool block so a chunk costs a single pooled allocation.
+  struct StreamPipe::Chunk {
+    uv_write_t req;
+    QUEUE member;  // Member of StreamPipe::chunks_.
+    StreamPipe* pipe;  // NULL once the pipe is gone.
+    Environment* env;
+    size_t size;  // Pooled block size, counted against the high-water mark.
+  };
+
+  struct StreamPipe::ShutdownReq {
+    uv_shutdown_t req;
+    StreamPipe* pipe;
+    Environment* env;
+  };
+
+  // Block size is picked so that block plus pool header is exactly the
+  // largest pooled size class.
+  static const size_t kChunkBlockSize = 64 * 1024 - 16;
+  static const size_t kChunkHeaderSize =
+      ROUND_UP(sizeof(StreamPipe::Chunk), 16);
+
+  // Reads up to this size are copied into a block of their own so a trickle
+  // of small reads doesn't pin a full block each.
+  static const size_t kSmallReadSize = 4 * 1024;
+
+  static inline StreamPipe::Chunk* ChunkFromData(char* data) {
+    return reinterpret_cast<StreamPipe::Chunk*>(data - kChunkHeaderSize);
+  }
+
+  static inline char* ChunkData(StreamPipe::Chunk* chunk) {
+    return reinterpret_cast<char*>(chunk) + kChunkHeaderSize;
+  }
+
+  static void FreeChunk(StreamPipe::Chunk* chunk) {
+    chunk->env->request_pool()->Free(reinterpret_cast<char*>(chunk));
+  }
+
+
+  StreamPipe::StreamPipe(StreamWrap* source,
+                         StreamWrap* sink,
+                         size_t high_water_mark,
+                         size_t low_water_mark)
+      : StreamWrapCallbacks(source),
+        sink_(sink),
+        high_water_mark_(high_water_mark),
+        low_water_mark_(low_water_mark),
+        bytes_(0),
+        queued_bytes_(0),
+        paused_(false),
+        eof_(false),
+        detached_(false),
+        shutdown_(NULL),
+        splice_(NULL) {
+    QUEUE_INIT(&chunks_);
+  }
+
+
+  StreamPipe::~StreamPipe() {
+    // Deleted by the source's destructor while the pipe is still running.
+    Detach(false);
+  }
+
+
+  int StreamPipe::Start(bool use_splice) {
+    StreamWrap* source = this->source();
+    int err = UV_ENOSYS;
+
+  #if defined(__linux__)
+    // Data already queued on the sink has to go out first, copy mode keeps
+    // the order through libuv's write queue.
+    if (use_splice && sink_->stream()->write_queue_size == 0)
+      err = StartSplice();
+  #endif
+
+    if (err != 0) {
+      err = uv_read_start(source->stream(),
+                          StreamWrap::OnAlloc,
+                          StreamWrap::OnRead);
+      if (err) {
+        detached_ = true;  // Nothing to undo.
+        return err;
+      }
+    }
+
+    source->pipe_out_ = this;
+    sink_->pipe_in_ = this;
+    source->OverrideCallbacks(this, false);
+    return 0;
+  }
+
+
+  void StreamPipe::SinkClosed() {
+    sink_->pipe_in_ = NULL;
+    sink_ = NULL;
+    Finish(UV_ECANCELED);
+  }
+
+
+  void StreamPipe::DoAlloc(uv_handle_t* handle,
+                           size_t suggested_size,
+                           uv_buf_t* buf) {
+    Environment* env = source()->env();
+    char* storage = env->request_pool()->Allocate(kChunkBlockSize);
+    Chunk* chunk = reinterpret_cast<Chunk*>(storage);
+    chunk->pipe = NULL;
+    chunk->env = env;
+    chunk->size = kChunkBlockSize;
+    QUEUE_INIT(&chunk->member);
+    buf->base = ChunkData(chunk);
+    buf->len = kChunkBlockSize - kChunkHeaderSize;
+  }
+
+
+  void StreamPipe::DoRead(uv_stream_t* handle,
+                          ssize_t nread,
+                          const uv_buf_t* buf,
+                          uv_handle_type pending) {
+    assert(pending == UV_UNKNOWN_HANDLE);
+
+    if (nread <= 0) {
+      if (buf->base != NULL)
+        FreeChunk(ChunkFromData(buf->base));
+
+      if (nread == UV_EOF) {
+        eof_ = true;
+        uv_read_stop(source()->stream());
+        MaybeShutdown();
+      } else if (nread < 0) {
+        Finish(nread);
+      }
+      return;
+    }
+
+    bytes_ += nread;
+
+    Chunk* chunk = ChunkFromData(buf->base);
+    if (static_cast<size_t>(nread) <= kSmallReadSize) {
+      Environment* env = chunk->env;
+      size_t size = kChunkHeaderSize + nread;
+      Chunk* small = reinterpret_cast<Chunk*>(
+          env->request_pool()->Allocate(size));
+      small->pipe = NULL;
+      small->env = env;
+      small->size = size;
+      QUEUE_INIT(&small->member);
+      memcpy(ChunkData(small), buf->base, nread);
+      FreeChunk(chunk);
+      chunk = small;
+    }
+
+    Write(chunk, nread);
+  }
+
+
+  void StreamPipe::Write(Chunk* chunk, size_t length) {
+    uv_stream_t* stream = sink_->stream();
+    uv_buf_t buf = uv_buf_init(ChunkData(chunk), length);
+
+    if (sink_->is_tcp()) {
+      NODE_COUNT_NET_BYTES_SENT(length);
+    } else {
+      NODE_COUNT_PIPE_BYTES_SENT(length);
+    }
+
+    // Fails with UV_EAGAIN while earlier chunks are still queued, so the
+    // order is kept.
+    int err = uv_try_write(stream, &buf, 1);
+    if (err == UV_ENOSYS || err == UV_EAGAIN)
+      err = 0;
+    if (err >= 0 && static_cast<size_t>(err) < length) {
+      buf.base += err;
+      buf.len -= err;
+      err = uv_write(&chunk->req, stream, &buf, 1, AfterWrite);
+      if (err == 0) {
+        chunk->pipe = this;
+        QUEUE_INSERT_TAIL(&chunks_, &chunk->member);
+        queued_bytes_ += chunk->size;
+
+        // Queued chunks pin their whole block, not just the payload.
+        if (!paused_ && queued_bytes_ > high_water_mark_) {
+          uv_read_stop(source()->stream());
+          paused_ = true;
+        }
+        return;
+      }
+    }
+
+    FreeChunk(chunk);
+    if (err < 0)
+      Finish(err);
+  }
+
+
+  void StreamPipe::AfterWrite(uv_write_t* req, int status) {
+    Chunk* chunk = ContainerOf(&Chunk::req, req);
+    StreamPipe* pipe = chunk->pipe;
+    size_t size = chunk->size;
+
+    QUEUE_REMOVE(&chunk->member);
+    FreeChunk(chunk);
+
+    if (pipe == NULL)
+      return;
+
+    pipe->queued_bytes_ -= size;
+
+    if (status < 0)
+      return pipe->Finish(status);
+
+    if (pipe->paused_ &&
+        !pipe->eof_ &&
+        pipe->queued_bytes_ <= pipe->low_water_mark_) {
+      int err = uv_read_start(pipe->source()->stream(),
+                              StreamWrap::OnAlloc,
+                              StreamWrap::OnRead);
+      if (err)
+        return pipe->Finish(err);
+      pipe->paused_ = false;
+    }
+
+    pipe->MaybeShutdown();
+  }
+
+
+  // Passes the source's EOF on to the sink once everything read has been
+  // written.
+  void StreamPipe::MaybeShutdown() {
+    if (!eof_ || !QUEUE_EMPTY(&chunks_) || shutdown_ != NULL)
+      return;
+
+    Environment* env = source()->env();
+    char* storage = env->request_pool()->Allocate(sizeof(ShutdownReq));
+    shutdown_ = reinterpret_cast<ShutdownReq*>(storage);
+    shutdown_->pipe = this;
+    shutdown_->env = env;
+
+    int err = uv_shutdown(&shutdown_->req, sink_->stream(), AfterShutdown);
+    if (err) {
+      env->request_pool()->Free(storage);
+      shutdown_ = NULL;
+      Finish(err);
+    }
+  }
+
+
+  void StreamPipe::AfterShutdown(uv_shutdown_t* req, int status) {
+    ShutdownReq* shutdown = ContainerOf(&ShutdownReq::req, req);
+    StreamPipe* pipe = shutdown->pipe;
+
+    shutdown->env->request_pool()->Free(reinterpret_cast<char*>(shutdown));
+
+    if (pipe == NULL)
+      return;
+
+    pipe->shutdown_ = NULL;
+    pipe->Finish(status);
+  }
+
+
+  // Tears the pipe down and reports to JS. `this` is gone afterwards.
+  void StreamPipe::Finish(int status) {
+    StreamWrap* source = this->source();
+    Environment* env = source->env();
+
+    HandleScope handle_scope(env->isolate());
+    Context::Scope context_scope(env->context());
+
+    Local<Value> argv[] = {
+      Integer::New(env->isolate(), status),
+      Number::New(env->isolate(), static_cast<double>(bytes_))
+    };
+
+    Detach(true);
+    source->OverrideCallbacks(&source->default_callbacks_, false);
+
+    source->MakeCallback(env->onpipeclose_string(), ARRAY_SIZE(argv), argv);
+  }
+
+
+  void StreamPipe::Detach(bool source_alive) {
+    if (detached_)
+      return;
+    detached_ = true;
+
+    StreamWrap* source = this->source();
+    if (source_alive && splice_ == NULL)
+      uv_read_stop(source->stream());
+    source->pipe_out_ = NULL;
+
+    // Writes and the shutdown still in flight complete on their own.
+    while (!QUEUE_EMPTY(&chunks_)) {
+      QUEUE* q = QUEUE_HEAD(&chunks_);
+      QUEUE_REMOVE(q);
+      QUEUE_INIT(q);
+      Chunk* chunk = ContainerOf(&Chunk::member, q);
+      chunk->pipe = NULL;
+    }
+    if (shutdown_ != NULL) {
+      shutdown_->pipe = NULL;
+      shutdown_ = NULL;
+    }
+
+  #if defined(__linux__)
+    if (splice_ != NULL) {
+      CloseSplice(splice_);
+      splice_ = NULL;
+    }
+  #endif
+
+    if (sink_ != NULL) {
+      Environment* env = sink_->env();
+      HandleScope handle_scope(env->isolate());
+      Context::Scope context_scope(env->context());
+      sink_->pipe_in_ = NULL;
+      sink_->UpdateWriteQueueSize();
+      sink_->ReleaseHeldWrites();
+      sink_ = NULL;
+    }
+  }
+
+
+  #if defined(__linux__)
+  // splice(2) mode: the source's reads are stopped and both ends are polled
+  // through dups of their fds, data goes source -> kernel pipe -> sink.
+  struct StreamPipe::Splice {
+    StreamPipe* pipe;
+    int in_fd;
+    int out_fd;
+    int pipe_fds[2];
+    size_t buffered;  // Bytes sitting in the kernel pipe.
+    int polls;  // Initialized poll handles.
+    uv_poll_t in_poll;
+    uv_poll_t out_poll;
+  };
+
+  static const size_t kSpliceSize = 64 * 1024;  // Default pipe capacity.
+
+
+  int StreamPipe::StartSplice() {
+    uv_loop_t* loop = source()->env()->event_loop();
+    Splice* state = new Splice;
+    state->pipe = this;
+    state->in_fd = -1;
+    state->out_fd = -1;
+    state->pipe_fds[0] = -1;
+    state->pipe_fds[1] = -1;
+    state->buffered = 0;
+    state->polls = 0;
+
+    int err = 0;
+    if (pipe2(state->pipe_fds, O_NONBLOCK | O_CLOEXEC) ||
+        (state->in_fd = dup(source()->stream()->io_watcher.fd)) == -1 ||
+        (state->out_fd = dup(sink_->stream()->io_watcher.fd)) == -1) {
+      err = -errno;
+    }
+
+    if (err == 0)
+      err = uv_poll_init(loop, &state->in_poll, state->in_fd);
+    if (err == 0) {
+      state->in_poll.data = state;
+      state->polls++;
+      err = uv_poll_init(loop, &state->out_poll, state->out_fd);
+    }
+    if (err == 0) {
+      state->out_poll.data = state;
+      state->polls++;
+      err = uv_poll_start(&state->in_poll, UV_READABLE, OnSpliceReadable);
+    }
+
+    if (err) {
+      CloseSplice(state);
+      return err;
+    }
+
+    uv_read_stop(source()->stream());
+    splice_ = state;
+    return 0;
+  }
+
+
+  void StreamPipe::CloseSplice(Splice* state) {
+    state->pipe = NULL;
+    if (state->polls == 0)
+      return DestroySplice(state);
+    uv_close(reinterpret_cast<uv_handle_t*>(&state->in_poll), OnSpliceClose);
+    if (state->polls > 1) {
+      uv_close(reinterpret_cast<uv_handle_t*>(&state->out_poll),
+               OnSpliceClose);
+    }
+  }
+
+
+  void StreamPipe::OnSpliceClose(uv_handle_t* handle) {
+    Splice* state = static_cast<Splice*>(handle->data);
+    if (--state->polls == 0)
+      DestroySplice(state);
+  }
+
+
+  void StreamPipe::DestroySplice(Splice* state) {
+    if (state->in_fd != -1)
+      close(state->in_fd);
+    if (state->out_fd != -1)
+      close(state->out_fd);
+    if (state->pipe_fds[0] != -1)
+      close(state->pipe_fds[0]);
+    if (state->pipe_fds[1] != -1)
+      close(state->pipe_fds[1]);
+    delete state;
+  }
+
+
+  void StreamPipe::OnSpliceReadable(uv_poll_t* handle, int status, int events) {
+    Splice* state = static_cast<Splice*>(handle->data);
+    StreamPipe* pipe = state->pipe;
+    assert(pipe != NULL);
+
+    if (status < 0)
+      return pipe->Finish(status);
+
+    for (;;) {
+      ssize_t n = splice(state->in_fd,
+                         NULL,
+                         state->pipe_fds[1],
+                         NULL,
+                         kSpliceSize,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1 && errno == EAGAIN)
+        return;
+      if (n == -1)
+        return pipe->Finish(-errno);
+
+      if (n == 0) {
+        pipe->eof_ = true;
+        uv_poll_stop(&state->in_poll);
+        return pipe->MaybeShutdown();
+      }
+
+      state->buffered += n;
+      pipe->bytes_ += n;
+
+      int err = pipe->SpliceOut();
+      if (err)
+        return pipe->Finish(err);
+      if (state->buffered > 0)
+        return;  // Sink is full, OnSpliceWritable() takes over.
+    }
+  }
+
+
+  void StreamPipe::OnSpliceWritable(uv_poll_t* handle, int status, int events) {
+    Splice* state = static_cast<Splice*>(handle->data);
+    StreamPipe* pipe = state->pipe;
+    assert(pipe != NULL);
+
+    int err = status < 0 ? status : pipe->SpliceOut();
+    if (err)
+      return pipe->Finish(err);
+    if (state->buffered > 0)
+      return;
+
+    uv_poll_stop(&state->out_poll);
+    if (pipe->eof_)
+      return pipe->MaybeShutdown();
+
+    err = uv_poll_start(&state->in_poll, UV_READABLE, OnSpliceReadable);
+    if (err)
+      pipe->Finish(err);
+  }
+
+
+  // Drains the kernel pipe into the sink. When the sink fills up, reading
+  // stops until it is writable again, the pipe's capacity is the only
+  // buffering in this mode.
+  int StreamPipe::SpliceOut() {
+    Splice* state = splice_;
+
+    while (state->buffered > 0) {
+      ssize_t n = splice(state->pipe_fds[0],
+                         NULL,
+                         state->out_fd,
+                         NULL,
+                         state->buffered,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1 && errno == EAGAIN) {
+        uv_poll_stop(&state->in_poll);
+        return uv_poll_start(&state->out_poll, UV_WRITABLE, OnSpliceWritable);
+      }
+      if (n <= 0)
+        return n == 0 ? UV_EPIPE : -errno;
+      state->buffered -= n;
+    }
+
+    return 0;
+  }
+  #endif  // defined(__linux__)
+
+}//End Node Namespace
@@ -0,0 +1,110 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#ifndef SRC_STREAM_PIPE_H_
+#define SRC_STREAM_PIPE_H_
+
+#include "cstream_wrap.h"
+#include "cqueue.h"
+
+#include "uv.h"
+
+namespace node {
+  class Environment;
+
+  // Forwards everything read from one stream to another without going
+  // through JS. Installed as the source's callbacks: reads land in pooled
+  // chunks that are written to the sink as they are, reading pauses while
+  // the chunks waiting on the sink hold more than the high-water mark and
+  // resumes once they drop below the low-water mark. On Linux the bytes can instead be
+  // moved with splice(2) through a kernel pipe and never reach user space.
+  //
+  // JS hears about the pipe once, when it ends: onpipeclose(status, bytes)
+  // on the source, after the sink has been shut down on EOF or on the
+  // first error from either side.
+  class StreamPipe : public StreamWrapCallbacks {
+   public:
+    static const size_t kDefaultHighWaterMark = 1024 * 1024;
+    static const size_t kDefaultLowWaterMark = 256 * 1024;
+
+    StreamPipe(StreamWrap* source,
+               StreamWrap* sink,
+               size_t high_water_mark,
+               size_t low_water_mark);
+    ~StreamPipe();
+
+    // Starts moving data, the pipe owns itself from here on.
+    int Start(bool use_splice);
+
+    // The sink is going away underneath us.
+    void SinkClosed();
+
+    void DoAlloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
+    void DoRead(uv_stream_t* handle,
+                ssize_t nread,
+                const uv_buf_t* buf,
+                uv_handle_type pending);
+
+    // Defined in cstream_pipe.cc.
+    struct Chunk;
+    struct ShutdownReq;
+    struct Splice;
+
+   private:
+    inline StreamWrap* source() const {
+      return wrap();
+    }
+
+    void Write(Chunk* chunk, size_t length);
+    void MaybeShutdown();
+    void Finish(int status);
+    void Detach(bool source_alive);
+
+    static void AfterWrite(uv_write_t* req, int status);
+    static void AfterShutdown(uv_shutdown_t* req, int status);
+
+  #if defined(__linux__)
+    int StartSplice();
+    int SpliceOut();
+    static void CloseSplice(Splice* splice);
+    static void DestroySplice(Splice* splice);
+    static void OnSpliceReadable(uv_poll_t* handle, int status, int events);
+    static void OnSpliceWritable(uv_poll_t* handle, int status, int events);
+    static void OnSpliceClose(uv_handle_t* handle);
+  #endif
+
+    StreamWrap* sink_;
+    const size_t high_water_mark_;
+    const size_t low_water_mark_;
+    uint64_t bytes_;
+    size_t queued_bytes_;  // Pooled bytes held by chunks_.
+    bool paused_;
+    bool eof_;
+    bool detached_;
+    QUEUE chunks_;  // Chunks waiting for their write to complete.
+    ShutdownReq* shutdown_;
+    Splice* splice_;
+  };
+
+}//End Node Namespace
+
+#endif //SRC_STREAM_PIPE_H_
@@ -0,0 +1,83 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#ifndef SRC_STREAM_STATS_H_
+#define SRC_STREAM_STATS_H_
+
+#include "cqueue.h"
+
+#include <string.h>  // memset()
+
+namespace node {
+
+  // Fields of a stream statistics snapshot, in Float64Array order. Times
+  // are in nanoseconds.
+  #define STREAM_STATS_FIELDS(V)                                              \
+    V(BYTES_READ, bytesRead)                                                  \
+    V(READS, reads)                                                           \
+    V(READ_CALLBACKS, readCallbacks)                                          \
+    V(BYTES_WRITTEN, bytesWritten)                                            \
+    V(WRITES, writes)                                                         \
+    V(PARTIAL_WRITES, partialWrites)                                          \
+    V(WRITE_COMPLETIONS, writeCompletions)                                    \
+    V(WRITE_LATENCY_TOTAL, writeLatencyTotal)                                 \
+    V(WRITE_LATENCY_MAX, writeLatencyMax)                                     \
+    V(WRITE_QUEUE_MAX, writeQueueMax)                                         \
+
+  // Counters of a single StreamWrap, only allocated while enabled.
+  struct StreamStats {
+    enum Field {
+    #define V(NAME, _) STATS_##NAME,
+      STREAM_STATS_FIELDS(V)
+    #undef V
+      kFieldCount
+    };
+
+    StreamStats() {
+      memset(fields, 0, sizeof(fields));
+      QUEUE_INIT(&member);
+    }
+
+    // Fold `other` into these counters, maxima stay maxima.
+    inline void Add(const StreamStats& other) {
+      for (int i = 0; i < kFieldCount; i++) {
+        if (i == STATS_WRITE_LATENCY_MAX || i == STATS_WRITE_QUEUE_MAX) {
+          if (other.fields[i] > fields[i])
+            fields[i] = other.fields[i];
+        } else {
+          fields[i] += other.fields[i];
+        }
+      }
+    }
+
+    inline void Max(Field field, double value) {
+      if (value > fields[field])
+        fields[field] = value;
+    }
+
+    double fields[kFieldCount];
+    QUEUE member;  // Member of env->stream_stats_queue().
+  };
+
+}//End Node Namespace
+
+#endif //SRC_STREAM_STATS_H_
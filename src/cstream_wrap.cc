@@ -20,6 +20,7 @@
 // USE OR OTHER DEALINGS IN THE SOFTWARE
 
 #include "cstream_wrap.h"
+#include "cstream_pipe.h"
 #include "cenv.h"
 #include "cenv-inl.h"
 #include "cnode_counters.h"
@@ -32,6 +33,11 @@
 #include <stdlib.h>  // abort()
 #include <string.h>  // memcpy()
 #include <limits.h>  // INT_MAX
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>  // fcntl()
+#include <unistd.h>  // dup(), close()
+#endif
 
 namespace node {
   using v8::Array;
@@ -51,6 +57,114 @@ namespace node {
   using v8::Undefined;
   using v8::Value;
 
+  // Request for StreamWrap::SendFile(). The socket fd is dup'ed so that it
+  // outlives the handle if the stream is closed while the file goes out.
+  class SendFileWrap : public ReqWrap<uv_fs_t> {
+   public:
+    SendFileWrap(Environment* env,
+                 Local<Object> obj,
+                 StreamWrap* wrap,
+                 int out_fd,
+                 uv_file in_fd,
+                 int64_t offset,
+                 size_t length)
+        : ReqWrap<uv_fs_t>(env, obj, AsyncWrap::PROVIDER_SENDFILEWRAP),
+          wrap_(wrap),
+          out_fd_(out_fd),
+          in_fd_(in_fd),
+          offset_(offset),
+          remaining_(length),
+          started_(false),
+          polling_(false) {
+      Wrap(obj, this);
+    }
+
+    void* operator new(size_t size, char* storage) { return storage; }
+
+    // This is just to keep the compiler happy. It should never be called, since
+    // we don't use exceptions in node.
+    void operator delete(void* ptr, char* storage) { assert(0); }
+
+    // Send as much as the socket takes without blocking.
+    int SendSome();
+
+    void Dispose();
+
+    static void NewSendFileWrap(const FunctionCallbackInfo<Value>& args) {
+      CHECK(args.IsConstructCall());
+    }
+
+    StreamWrap* wrap_;  // NULL once the stream is gone.
+    const int out_fd_;
+    const uv_file in_fd_;
+    int64_t offset_;
+    size_t remaining_;
+    bool started_;  // False while waiting for earlier writes to drain.
+    bool polling_;
+    uv_poll_t poll_;
+
+   private:
+    static void OnClose(uv_handle_t* handle);
+
+    // Storage comes from the environment's RequestPool.
+    void* operator new(size_t size) { assert(0); }
+    void operator delete(void* ptr) { assert(0); }
+  };
+
+  int SendFileWrap::SendSome() {
+    while (remaining_ > 0) {
+      uv_fs_t req;
+      int r = uv_fs_sendfile(env()->event_loop(),
+                             &req,
+                             out_fd_,
+                             in_fd_,
+                             offset_,
+                             remaining_,
+                             NULL);
+      uv_fs_req_cleanup(&req);
+      if (r == UV_EAGAIN)
+        return 0;
+      if (r < 0)
+        return r;
+      if (r == 0)
+        return UV_EOF;  // File is shorter than requested.
+      offset_ += r;
+      remaining_ -= r;
+    }
+    return 0;
+  }
+
+  void SendFileWrap::Dispose() {
+    if (polling_) {
+      uv_close(reinterpret_cast<uv_handle_t*>(&poll_), OnClose);
+      return;
+    }
+  #if !defined(_WIN32)
+    close(out_fd_);
+  #endif
+    uv_fs_req_cleanup(&req_);
+    Environment* env = this->env();
+    this->~SendFileWrap();
+    env->request_pool()->Free(reinterpret_cast<char*>(this));
+  }
+
+  void SendFileWrap::OnClose(uv_handle_t* handle) {
+    SendFileWrap* req_wrap =
+        ContainerOf(&SendFileWrap::poll_, reinterpret_cast<uv_poll_t*>(handle));
+    req_wrap->polling_ = false;
+    req_wrap->Dispose();
+  }
+
+  WriteWrap::WriteWrap(Environment* env, Local<Object> obj, StreamWrap* wrap)
+      : ReqWrap<uv_write_t>(env, obj, AsyncWrap::PROVIDER_WRITEWRAP),
+        wrap_(wrap),
+        corked_status_(0),
+        start_time_(wrap->stats() != NULL ? uv_hrtime() : 0) {
+    Wrap(obj, this);
+    QUEUE_INIT(&cork_queue_);
+    QUEUE_INIT(&batch_);
+  }
+
   void StreamWrap::Initialize(Handle<Object> target, Handle<Value> unused, Handle<Context> context) {
     Environment* env = Environment::GetCurrent(context);
 
@@ -63,13 +177,86 @@ namespace node {
     ww->InstanceTemplate()->SetInternalFieldCount(1);
     ww->SetClassName(FIXED_ONE_BYTE_STRING(env->isolate(), "WriteWrap"));
     target->Set(FIXED_ONE_BYTE_STRING(env->isolate(), "WriteWrap"),   ww->GetFunction());
+
+    Local<FunctionTemplate> sfw =
+        FunctionTemplate::New(env->isolate(), SendFileWrap::NewSendFileWrap);
+    sfw->InstanceTemplate()->SetInternalFieldCount(1);
+    sfw->SetClassName(FIXED_ONE_BYTE_STRING(env->isolate(), "SendFileWrap"));
+    target->Set(FIXED_ONE_BYTE_STRING(env->isolate(), "SendFileWrap"),
+                sfw->GetFunction());
+
+    NODE_SET_METHOD(target, "getRequestPoolStats", GetRequestPoolStats);
+    NODE_SET_METHOD(target, "getStreamStats", GetStreamStats);
+
+    // Field names of a stats snapshot, in order.
+    Local<Array> fields = Array::New(env->isolate(), StreamStats::kFieldCount);
+  #define V(NAME, name)                                                       \
+    fields->Set(StreamStats::STATS_##NAME,                                    \
+                FIXED_ONE_BYTE_STRING(env->isolate(), #name));
+    STREAM_STATS_FIELDS(V)
+  #undef V
+    target->Set(FIXED_ONE_BYTE_STRING(env->isolate(), "streamStatsFields"),
+                fields);
   }
 
 
   StreamWrap::StreamWrap(Environment* env, Local<Object> object, uv_stream_t* stream,
     AsyncWrap::ProviderType provider, AsyncWrap* parent)
   : HandleWrap(env, object, reinterpret_cast<uv_handle_t*>(stream), provider, parent),
-  stream_(stream), default_callbacks_(this), callbacks_(&default_callbacks_), callbacks_gc_(false) {
+  stream_(stream), default_callbacks_(this), callbacks_(&default_callbacks_), callbacks_gc_(false),
+  corked_(false), corked_bytes_(0), sendfile_(NULL),
+  high_water_mark_(0), low_water_mark_(0), pressure_(false),
+  pressure_pending_(false), reading_(false), read_paused_(false), stats_(NULL),
+  read_buffer_data_(NULL), read_buffer_length_(0), read_buffer_offset_(0),
+  accept_batch_(0), accepted_count_(0), pipe_out_(NULL), pipe_in_(NULL) {
+    QUEUE_INIT(&corked_queue_);
+    QUEUE_INIT(&flushed_queue_);
+    QUEUE_INIT(&check_queue_);
+  }
+
+  StreamWrap::~StreamWrap() {
+    QUEUE_REMOVE(&check_queue_);
+
+    // A pipe writing to this stream ends here, one reading from it is
+    // deleted along with the callbacks below.
+    if (pipe_in_ != NULL)
+      pipe_in_->SinkClosed();
+
+    // An in-flight sendfile owns a dup of the fd, let it wind down on its own.
+    if (sendfile_ != NULL) {
+      sendfile_->wrap_ = NULL;
+      if (sendfile_->polling_ || !sendfile_->started_)
+        sendfile_->Dispose();
+      sendfile_ = NULL;
+    }
+
+    // The handle is gone, drop writes that never made it to libuv.
+    if (!QUEUE_EMPTY(&flushed_queue_)) {
+      QUEUE_ADD(&corked_queue_, &flushed_queue_);
+      QUEUE_INIT(&flushed_queue_);
+    }
+    while (!QUEUE_EMPTY(&corked_queue_)) {
+      QUEUE* q = QUEUE_HEAD(&corked_queue_);
+      QUEUE_REMOVE(q);
+      WriteWrap* req_wrap = ContainerOf(&WriteWrap::cork_queue_, q);
+      if (!QUEUE_EMPTY(&req_wrap->batch_)) {
+        QUEUE_ADD(&corked_queue_, &req_wrap->batch_);
+        QUEUE_INIT(&req_wrap->batch_);
+      }
+      req_wrap->~WriteWrap();
+      env()->request_pool()->Free(reinterpret_cast<char*>(req_wrap));
+    }
+
+    if (!callbacks_gc_ && callbacks_ != &default_callbacks_) {
+      delete callbacks_;
+    }
+    callbacks_ = NULL;
+
+    read_buffer_.Reset();
+    paired_.Reset();
+    accepted_.Reset();
+
+    DisableStats();
   }
 
   void StreamWrap::GetFD(Local<String>, const PropertyCallbackInfo<Value>& args) {
@@ -85,20 +272,214 @@ namespace node {
   #endif
   }
 
+  inline size_t StreamWrap::write_queue_bytes() const {
+    return stream()->write_queue_size +
+           corked_bytes_ +
+           (sendfile_ != NULL ? sendfile_->remaining_ : 0);
+  }
+
   void StreamWrap::UpdateWriteQueueSize() {
+    if (stats_ != NULL) {
+      stats_->Max(StreamStats::STATS_WRITE_QUEUE_MAX,
+                  static_cast<double>(write_queue_bytes()));
+    }
+
+    // With watermarks set JS only hears about crossings, writeQueueSize
+    // is left alone.
+    if (high_water_mark_ != 0) {
+      if (!pressure_ && write_queue_bytes() > high_water_mark_)
+        OnPressure();
+      return;
+    }
+
     HandleScope scope(env()->isolate());
     Local<Integer> write_queue_size =
-        Integer::NewFromUnsigned(env()->isolate(), stream()->write_queue_size);
+        Integer::NewFromUnsigned(env()->isolate(), write_queue_bytes());
     object()->Set(env()->write_queue_size_string(), write_queue_size);
   }
 
+  // setWriteWatermarks(high, low[, paired]) reports the write queue going
+  // above `high` with onpressure() and falling back to `low` with
+  // ondrain(). Reads on the `paired` stream are stopped in between. The
+  // queue includes corked writes and a pending sendFile(). Zero for `high`
+  // turns this off again.
+  void StreamWrap::SetWriteWatermarks(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    StreamWrap* wrap = Unwrap<StreamWrap>(args.Holder());
+
+    if (!args[0]->IsUint32() || !args[1]->IsUint32())
+      return env->ThrowTypeError("watermarks must be unsigned integers");
+
+    size_t high = args[0]->Uint32Value();
+    size_t low = args[1]->Uint32Value();
+    if (low > high)
+      return env->ThrowRangeError("low watermark must not exceed high");
+
+    Local<Object> paired_obj;
+    if (args[2]->IsObject()) {
+      paired_obj = args[2].As<Object>();
+      if (!env->tcp_constructor_template()->HasInstance(paired_obj) &&
+          !env->pipe_constructor_template()->HasInstance(paired_obj)) {
+        return env->ThrowTypeError("paired must be a stream handle");
+      }
+    }
+
+    // Start over, resuming whatever the old settings paused.
+    if (wrap->pressure_) {
+      wrap->ResumePaired();
+      wrap->pressure_ = false;
+      wrap->pressure_pending_ = false;
+    }
+
+    wrap->high_water_mark_ = high;
+    wrap->low_water_mark_ = low;
+    if (paired_obj.IsEmpty())
+      wrap->paired_.Reset();
+    else
+      wrap->paired_.Reset(env->isolate(), paired_obj);
+
+    if (high == 0) {
+      wrap->UpdateWriteQueueSize();
+    } else if (wrap->write_queue_bytes() > high) {
+      wrap->OnPressure();
+    }
+  }
+
+  StreamWrap* StreamWrap::paired_stream() {
+    if (paired_.IsEmpty())
+      return NULL;
+    Local<Object> obj = PersistentToLocal(env()->isolate(), paired_);
+    StreamWrap* paired = Unwrap<StreamWrap>(obj);
+    // Closed or closing, or reading on behalf of a native pipe.
+    if (paired == NULL || paired->GetHandle() == NULL ||
+        paired->pipe_out_ != NULL) {
+      return NULL;
+    }
+    return paired;
+  }
+
+  void StreamWrap::OnPressure() {
+    pressure_ = true;
+    pressure_pending_ = true;
+
+    // Only reads JS has running are paused, and only those are resumed.
+    HandleScope scope(env()->isolate());
+    StreamWrap* paired = paired_stream();
+    if (paired != NULL &&
+        paired->reading_ &&
+        !paired->read_paused_ &&
+        uv_is_readable(paired->stream())) {
+      uv_read_stop(paired->stream());
+      paired->read_paused_ = true;
+    }
+
+    // We may be inside a write() call from JS, report from the check
+    // callback.
+    ScheduleCheck();
+  }
+
+  void StreamWrap::EmitPressure() {
+    if (!pressure_pending_)
+      return;
+    pressure_pending_ = false;
+    if (pressure_)
+      MakeCallback(env()->onpressure_string(), 0, NULL);
+  }
+
+  void StreamWrap::MaybeDrain() {
+    if (!pressure_ || write_queue_bytes() > low_water_mark_)
+      return;
+    pressure_ = false;
+    pressure_pending_ = false;
+
+    ResumePaired();
+
+    MakeCallback(env()->ondrain_string(), 0, NULL);
+  }
+
+  void StreamWrap::ResumePaired() {
+    HandleScope scope(env()->isolate());
+    StreamWrap* paired = paired_stream();
+    if (paired == NULL || !paired->read_paused_)
+      return;
+    paired->read_paused_ = false;
+    if (paired->reading_ && uv_is_readable(paired->stream()))
+      uv_read_start(paired->stream(), OnAlloc, OnRead);
+  }
+
+  // setAcceptBatch(n): a listener reports accepted connections as
+  // onconnection(0, clients), with up to `n` clients collected over one
+  // loop iteration.  Zero turns this off again.  An IPC pipe does the same
+  // with the handles a TCPDispatcher sends it.
+  void StreamWrap::SetAcceptBatch(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    StreamWrap* wrap = Unwrap<StreamWrap>(args.Holder());
+
+    if (!args[0]->IsUint32())
+      return env->ThrowTypeError("batch size must be an unsigned integer");
+
+    // Clients already collected still go out from the check callback.
+    wrap->accept_batch_ = args[0]->Uint32Value();
+  }
+
+  bool StreamWrap::QueueAccepted(Local<Object> client_obj) {
+    if (accept_batch_ == 0)
+      return false;
+
+    Isolate* isolate = env()->isolate();
+    Local<Array> accepted;
+    if (accepted_.IsEmpty()) {
+      accepted = Array::New(isolate);
+      accepted_.Reset(isolate, accepted);
+      // libuv keeps accepting until the backlog is empty, report once it
+      // is done.
+      ScheduleCheck();
+    } else {
+      accepted = PersistentToLocal(isolate, accepted_);
+    }
+
+    accepted->Set(accepted_count_++, client_obj);
+    if (accepted_count_ >= accept_batch_)
+      FlushAccepted();
+    return true;
+  }
+
+  void StreamWrap::FlushAccepted() {
+    if (accepted_.IsEmpty())
+      return;
+
+    Isolate* isolate = env()->isolate();
+    HandleScope scope(isolate);
+    Local<Value> argv[] = {
+      Integer::New(isolate, 0),
+      PersistentToLocal(isolate, accepted_)
+    };
+    accepted_.Reset();
+    accepted_count_ = 0;
+
+    MakeCallback(env()->onconnection_string(), ARRAY_SIZE(argv), argv);
+  }
+
   void StreamWrap::ReadStart(const FunctionCallbackInfo<Value>& args) {
     Environment* env = Environment::GetCurrent(args.GetIsolate());
     HandleScope scope(env->isolate());
 
     StreamWrap* wrap = Unwrap<StreamWrap>(args.Holder());
 
+    // Reading belongs to the pipe until it ends.
+    if (wrap->pipe_out_ != NULL)
+      return args.GetReturnValue().Set(UV_EBUSY);
+
     int err = uv_read_start(wrap->stream(), OnAlloc, OnRead);
+    if (err == 0) {
+      wrap->reading_ = true;
+      wrap->read_paused_ = false;
+      wrap->callbacks()->ReadStarted();
+    }
 
     args.GetReturnValue().Set(err);
   }
@@ -109,10 +490,61 @@ namespace node {
 
     StreamWrap* wrap = Unwrap<StreamWrap>(args.Holder());
 
+    if (wrap->pipe_out_ != NULL)
+      return args.GetReturnValue().Set(UV_EBUSY);
+
+    wrap->reading_ = false;
+    wrap->read_paused_ = false;
     int err = uv_read_stop(wrap->stream());
     args.GetReturnValue().Set(err);
   }
 
+  // setReadBuffer(buffer) switches the stream to read-into mode and rewinds
+  // to the start of `buffer`, setReadBuffer() switches back to a Buffer per
+  // read. JS owns the ring: data at an offset is only valid until the
+  // reads wrap around to it again.
+  void StreamWrap::SetReadBuffer(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    StreamWrap* wrap = Unwrap<StreamWrap>(args.Holder());
+
+    if (args[0]->IsUndefined() || args[0]->IsNull()) {
+      wrap->read_buffer_.Reset();
+      wrap->read_buffer_data_ = NULL;
+      wrap->read_buffer_length_ = 0;
+      wrap->read_buffer_offset_ = 0;
+      return;
+    }
+
+    if (!Buffer::HasInstance(args[0]))
+      return env->ThrowTypeError("argument must be a buffer");
+    if (Buffer::Length(args[0]) == 0)
+      return env->ThrowRangeError("buffer must not be empty");
+
+    Local<Object> buffer_obj = args[0].As<Object>();
+    wrap->read_buffer_.Reset(env->isolate(), buffer_obj);
+    wrap->read_buffer_data_ = Buffer::Data(buffer_obj);
+    wrap->read_buffer_length_ = Buffer::Length(buffer_obj);
+    wrap->read_buffer_offset_ = 0;
+  }
+
+  char* StreamWrap::ReadBufferSpace(size_t* size) {
+    assert(has_read_buffer());
+    if (read_buffer_offset_ == read_buffer_length_)
+      read_buffer_offset_ = 0;
+    *size = read_buffer_length_ - read_buffer_offset_;
+    return read_buffer_data_ + read_buffer_offset_;
+  }
+
+  size_t StreamWrap::CommitReadBuffer(char* data, size_t nread) {
+    assert(data == read_buffer_data_ + read_buffer_offset_);
+    assert(read_buffer_offset_ + nread <= read_buffer_length_);
+    size_t offset = read_buffer_offset_;
+    read_buffer_offset_ += nread;
+    return offset;
+  }
+
   void StreamWrap::OnAlloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
     StreamWrap* wrap = static_cast<StreamWrap*>(handle->data);
     assert(wrap->stream() == reinterpret_cast<uv_stream_t*>(handle));
@@ -140,6 +572,20 @@ namespace node {
     return scope.Escape(wrap_obj);
   }
 
+  static Local<Object> AcceptPending(Environment* env,
+                                     uv_stream_t* pipe,
+                                     AsyncWrap* parent,
+                                     uv_handle_type pending) {
+    if (pending == UV_TCP)
+      return AcceptHandle<TCPWrap, uv_tcp_t>(env, pipe, parent);
+    if (pending == UV_NAMED_PIPE)
+      return AcceptHandle<PipeWrap, uv_pipe_t>(env, pipe, parent);
+    if (pending == UV_UDP)
+      return AcceptHandle<UDPWrap, uv_udp_t>(env, pipe, parent);
+    assert(pending == UV_UNKNOWN_HANDLE);
+    return Local<Object>();
+  }
+
   void StreamWrap::OnReadCommon(uv_stream_t* handle,
                                 ssize_t nread,
                                 const uv_buf_t* buf,
@@ -158,6 +604,15 @@ namespace node {
       }
     }
 
+    StreamStats* stats = wrap->stats();
+    if (stats != NULL) {
+      stats->fields[StreamStats::STATS_READ_CALLBACKS]++;
+      if (nread > 0) {
+        stats->fields[StreamStats::STATS_READS]++;
+        stats->fields[StreamStats::STATS_BYTES_READ] += nread;
+      }
+    }
+
     wrap->callbacks()->DoRead(handle, nread, buf, pending);
   }
 
@@ -204,10 +659,22 @@ namespace node {
     uv_buf_t buf;
     WriteBuffer(buf_obj, &buf);
 
-    // Try writing immediately without allocation
     uv_buf_t* bufs = &buf;
     size_t count = 1;
-    int err = wrap->callbacks()->TryWrite(&bufs, &count);
+    int err = 0;
+
+    if (wrap->writes_held()) {
+      storage = env->request_pool()->Allocate(sizeof(WriteWrap));
+      req_wrap = new(storage) WriteWrap(env, req_wrap_obj, wrap);
+      // Keep the buffer alive until the batch has been written out.
+      req_wrap_obj->Set(env->buffer_string(), buf_obj);
+      wrap->QueueCorked(req_wrap, buf);
+      req_wrap_obj->Set(env->async(), True(env->isolate()));
+      goto done;
+    }
+
+    // Try writing immediately without allocation
+    err = wrap->callbacks()->TryWrite(&bufs, &count);
     if (err != 0)
       goto done;
     if (count == 0)
@@ -215,7 +682,7 @@ namespace node {
     assert(count == 1);
 
     // Allocate, or write rest
-    storage = new char[sizeof(WriteWrap)];
+    storage = env->request_pool()->Allocate(sizeof(WriteWrap));
     req_wrap = new(storage) WriteWrap(env, req_wrap_obj, wrap);
 
     err = wrap->callbacks()->DoWrite(req_wrap,
@@ -228,7 +695,7 @@ namespace node {
 
     if (err) {
       req_wrap->~WriteWrap();
-      delete[] storage;
+      env->request_pool()->Free(storage);
     }
 
    done:
@@ -240,6 +707,45 @@ namespace node {
     args.GetReturnValue().Set(err);
   }
 
+  // External strings whose backing store already is the encoded output are
+  // written straight from it. One-byte data is used as-is for ASCII, BINARY
+  // and UTF8, just like StringBytes::Write() does, two-byte data only for
+  // UCS2 on little endian hosts.
+  static bool GetExternalString(Environment* env,
+                                Handle<Value> val,
+                                enum encoding encoding,
+                                const char** data,
+                                size_t* len) {
+    if (!val->IsString())
+      return false;
+
+    Local<String> string = val.As<String>();
+    bool one_byte = string->IsExternalAscii();
+    if (!one_byte && !string->IsExternal())
+      return false;
+
+    switch (encoding) {
+      case ASCII:
+      case BINARY:
+      case UTF8:
+        if (!one_byte)
+          return false;
+        break;
+      case UCS2:
+        if (one_byte || IsBigEndian())
+          return false;
+        break;
+      default:
+        return false;
+    }
+
+    if (!StringBytes::GetExternalParts(env->isolate(), string, data, len))
+      return false;
+    if (encoding == UCS2)
+      *len *= sizeof(uint16_t);
+    return true;
+  }
+
   template <enum encoding encoding>
   void StreamWrap::WriteStringImpl(const FunctionCallbackInfo<Value>& args) {
     HandleScope handle_scope(args.GetIsolate());
@@ -254,11 +760,21 @@ namespace node {
     Local<Object> req_wrap_obj = args[0].As<Object>();
     Local<String> string = args[1].As<String>();
 
+    const char* external_data = NULL;
+    size_t external_size = 0;
+    bool is_external = GetExternalString(env,
+                                         string,
+                                         encoding,
+                                         &external_data,
+                                         &external_size);
+
     // Compute the size of the storage that the string will be flattened into.
     // For UTF8 strings that are very long, go ahead and take the hit for
     // computing their actual size, rather than tripling the storage.
     size_t storage_size;
-    if (encoding == UTF8 && string->Length() > 65535)
+    if (is_external)
+      storage_size = 0;
+    else if (encoding == UTF8 && string->Length() > 65535)
       storage_size = StringBytes::Size(env->isolate(), string, encoding);
     else
       storage_size = StringBytes::StorageSize(env->isolate(), string, encoding);
@@ -277,14 +793,20 @@ namespace node {
     uv_buf_t buf;
 
     bool try_write = storage_size + 15 <= sizeof(stack_storage) &&
-                     (!wrap->is_named_pipe_ipc() || !args[2]->IsObject());
+                     (!wrap->is_named_pipe_ipc() || !args[2]->IsObject()) &&
+                     !wrap->writes_held();
     if (try_write) {
-      data_size = StringBytes::Write(env->isolate(),
-                                     stack_storage,
-                                     storage_size,
-                                     string,
-                                     encoding);
-      buf = uv_buf_init(stack_storage, data_size);
+      if (is_external) {
+        data_size = external_size;
+        buf = uv_buf_init(const_cast<char*>(external_data), data_size);
+      } else {
+        data_size = StringBytes::Write(env->isolate(),
+                                       stack_storage,
+                                       storage_size,
+                                       string,
+                                       encoding);
+        buf = uv_buf_init(stack_storage, data_size);
+      }
 
       uv_buf_t* bufs = &buf;
       size_t count = 1;
@@ -302,28 +824,49 @@ namespace node {
       assert(count == 1);
     }
 
-    storage = new char[sizeof(WriteWrap) + storage_size + 15];
-    req_wrap = new(storage) WriteWrap(env, req_wrap_obj, wrap);
+    if (is_external) {
+      storage = env->request_pool()->Allocate(sizeof(WriteWrap));
+      req_wrap = new(storage) WriteWrap(env, req_wrap_obj, wrap);
 
-    data = reinterpret_cast<char*>(ROUND_UP(
-        reinterpret_cast<uintptr_t>(storage) + sizeof(WriteWrap), 16));
+      // Keep the string alive until the write completes, libuv writes
+      // straight from its backing store.
+      req_wrap_obj->Set(env->buffer_string(), string);
 
-    if (try_write) {
-      // Copy partial data
-      memcpy(data, buf.base, buf.len);
-      data_size = buf.len;
+      if (!try_write)
+        buf = uv_buf_init(const_cast<char*>(external_data), external_size);
+      data_size = external_size;
     } else {
-      // Write it
-      data_size = StringBytes::Write(env->isolate(),
-                                     data,
-                                     storage_size,
-                                     string,
-                                     encoding);
-    }
+      storage = env->request_pool()->Allocate(sizeof(WriteWrap) +
+                                              storage_size +
+                                              15);
+      req_wrap = new(storage) WriteWrap(env, req_wrap_obj, wrap);
+
+      data = reinterpret_cast<char*>(ROUND_UP(
+          reinterpret_cast<uintptr_t>(storage) + sizeof(WriteWrap), 16));
+
+      if (try_write) {
+        // Copy partial data
+        memcpy(data, buf.base, buf.len);
+        data_size = buf.len;
+      } else {
+        // Write it
+        data_size = StringBytes::Write(env->isolate(),
+                                       data,
+                                       storage_size,
+                                       string,
+                                       encoding);
+      }
+
+      assert(data_size <= storage_size);
 
-    assert(data_size <= storage_size);
+      buf = uv_buf_init(data, data_size);
+    }
 
-    buf = uv_buf_init(data, data_size);
+    if (wrap->writes_held()) {
+      wrap->QueueCorked(req_wrap, buf);
+      req_wrap->object()->Set(env->async(), True(env->isolate()));
+      goto done;
+    }
 
     if (!wrap->is_named_pipe_ipc()) {
       err = wrap->callbacks()->DoWrite(req_wrap,
@@ -357,7 +900,7 @@ namespace node {
 
     if (err) {
       req_wrap->~WriteWrap();
-      delete[] storage;
+      env->request_pool()->Free(storage);
     }
 
    done:
@@ -382,11 +925,19 @@ namespace node {
     Local<Array> chunks = args[1].As<Array>();
     size_t count = chunks->Length() >> 1;
 
+    // Corked writes go out first to keep the ordering intact.
+    int err = wrap->writes_blocked() ? UV_EBUSY : wrap->FlushCorked();
+    if (err) {
+      args.GetReturnValue().Set(err);
+      return;
+    }
+
     uv_buf_t bufs_[16];
     uv_buf_t* bufs = bufs_;
 
     // Determine storage size first
     size_t storage_size = 0;
+    bool has_external = false;
     for (size_t i = 0; i < count; i++) {
       Handle<Value> chunk = chunks->Get(i * 2);
 
@@ -395,10 +946,17 @@ namespace node {
         // Buffer chunk, no additional storage required
 
       // String chunk
-      Handle<String> string = chunk->ToString();
       enum encoding encoding = ParseEncoding(env->isolate(),
                                              chunks->Get(i * 2 + 1));
+      const char* data;
       size_t chunk_size;
+      if (GetExternalString(env, chunk, encoding, &data, &chunk_size)) {
+        // Written from the string itself, no additional storage required
+        has_external = true;
+        continue;
+      }
+
+      Handle<String> string = chunk->ToString();
       if (encoding == UTF8 && string->Length() > 65535)
         chunk_size = StringBytes::Size(env->isolate(), string, encoding);
       else
@@ -416,10 +974,15 @@ namespace node {
       bufs = new uv_buf_t[count];
 
     storage_size += sizeof(WriteWrap);
-    char* storage = new char[storage_size];
+    char* storage = env->request_pool()->Allocate(storage_size);
     WriteWrap* req_wrap =
         new(storage) WriteWrap(env, req_wrap_obj, wrap);
 
+    // External strings are referenced by the chunks array, keep it alive
+    // until the write completes.
+    if (has_external)
+      req_wrap_obj->Set(env->buffer_string(), chunks);
+
     uint32_t bytes = 0;
     size_t offset = sizeof(WriteWrap);
     for (size_t i = 0; i < count; i++) {
@@ -433,6 +996,19 @@ namespace node {
         continue;
       }
 
+      enum encoding encoding = ParseEncoding(env->isolate(),
+                                             chunks->Get(i * 2 + 1));
+
+      // Write external string in place
+      const char* data;
+      size_t data_size;
+      if (GetExternalString(env, chunk, encoding, &data, &data_size)) {
+        bufs[i].base = const_cast<char*>(data);
+        bufs[i].len = data_size;
+        bytes += data_size;
+        continue;
+      }
+
       // Write string
       offset = ROUND_UP(offset, 16);
       assert(offset < storage_size);
@@ -440,8 +1016,6 @@ namespace node {
       size_t str_size = storage_size - offset;
 
       Handle<String> string = chunk->ToString();
-      enum encoding encoding = ParseEncoding(env->isolate(),
-                                             chunks->Get(i * 2 + 1));
       str_size = StringBytes::Write(env->isolate(),
                                     str_storage,
                                     str_size,
@@ -453,11 +1027,11 @@ namespace node {
       bytes += str_size;
     }
 
-    int err = wrap->callbacks()->DoWrite(req_wrap,
-                                         bufs,
-                                         count,
-                                         NULL,
-                                         StreamWrap::AfterWrite);
+    err = wrap->callbacks()->DoWrite(req_wrap,
+                                     bufs,
+                                     count,
+                                     NULL,
+                                     StreamWrap::AfterWrite);
 
     // Deallocate space
     if (bufs != bufs_)
@@ -473,7 +1047,7 @@ namespace node {
 
     if (err) {
       req_wrap->~WriteWrap();
-      delete[] storage;
+      env->request_pool()->Free(storage);
     }
 
     args.GetReturnValue().Set(err);
@@ -507,18 +1081,579 @@ namespace node {
     args.GetReturnValue().Set(err);
   }
 
+  // Copies `stats` into the Float64Array `target`, false if it isn't one
+  // or is too short.
+  static bool CopyStats(const StreamStats& stats, Local<Value> target) {
+    if (!target->IsObject())
+      return false;
+    Local<Object> obj = target.As<Object>();
+    if (!obj->HasIndexedPropertiesInExternalArrayData() ||
+        obj->GetIndexedPropertiesExternalArrayDataType() !=
+            v8::kExternalFloat64Array ||
+        obj->GetIndexedPropertiesExternalArrayDataLength() <
+            StreamStats::kFieldCount) {
+      return false;
+    }
+    memcpy(obj->GetIndexedPropertiesExternalArrayData(),
+           stats.fields,
+           sizeof(stats.fields));
+    return true;
+  }
+
+  // setStatsEnabled(on) starts counting from zero, or stops and folds the
+  // counters into the environment's totals.
+  void StreamWrap::SetStatsEnabled(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    StreamWrap* wrap = Unwrap<StreamWrap>(args.Holder());
+
+    if (!args[0]->BooleanValue()) {
+      wrap->DisableStats();
+    } else if (wrap->stats_ == NULL) {
+      wrap->stats_ = new StreamStats();
+      QUEUE_INSERT_TAIL(env->stream_stats_queue(), &wrap->stats_->member);
+    }
+  }
+
+  void StreamWrap::DisableStats() {
+    if (stats_ == NULL)
+      return;
+    QUEUE_REMOVE(&stats_->member);
+    env()->retired_stream_stats()->Add(*stats_);
+    delete stats_;
+    stats_ = NULL;
+  }
+
+  // getStats(float64array) fills in a snapshot, fields are listed in
+  // streamStatsFields. Returns false while stats are disabled.
+  void StreamWrap::GetStats(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    StreamWrap* wrap = Unwrap<StreamWrap>(args.Holder());
+
+    if (wrap->stats_ == NULL)
+      return args.GetReturnValue().Set(false);
+    if (!CopyStats(*wrap->stats_, args[0]))
+      return env->ThrowTypeError("argument must be a large enough Float64Array");
+    args.GetReturnValue().Set(true);
+  }
+
+  // getStreamStats(float64array): the environment-wide aggregate of all
+  // streams that had stats enabled, closed ones included.
+  void StreamWrap::GetStreamStats(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    StreamStats total;
+    total.Add(*env->retired_stream_stats());
+    QUEUE* q;
+    QUEUE_FOREACH(q, env->stream_stats_queue()) {
+      StreamStats* stats = ContainerOf(&StreamStats::member, q);
+      total.Add(*stats);
+    }
+
+    if (!CopyStats(total, args[0]))
+      return env->ThrowTypeError("argument must be a large enough Float64Array");
+  }
+
+  void StreamWrap::GetRequestPoolStats(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    RequestPool* pool = env->request_pool();
+    Local<Object> info = Object::New(env->isolate());
+    info->Set(env->hits_string(),
+              Number::New(env->isolate(), static_cast<double>(pool->hits())));
+    info->Set(env->misses_string(),
+              Number::New(env->isolate(), static_cast<double>(pool->misses())));
+    info->Set(env->pooled_bytes_string(),
+              Number::New(env->isolate(),
+                          static_cast<double>(pool->pooled_bytes())));
+    args.GetReturnValue().Set(info);
+  }
+
+  void StreamWrap::Cork(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    StreamWrap* wrap = Unwrap<StreamWrap>(args.Holder());
+
+    // Handles sent over IPC pipes need a write of their own.
+    if (!wrap->is_named_pipe_ipc())
+      wrap->corked_ = true;
+  }
+
+  void StreamWrap::Uncork(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    StreamWrap* wrap = Unwrap<StreamWrap>(args.Holder());
+
+    wrap->corked_ = false;
+    args.GetReturnValue().Set(wrap->FlushCorked());
+  }
+
+  void StreamWrap::QueueCorked(WriteWrap* req_wrap, uv_buf_t buf) {
+    req_wrap->Dispatched();
+    req_wrap->corked_buf_ = buf;
+    QUEUE_INSERT_TAIL(&corked_queue_, &req_wrap->cork_queue_);
+    corked_bytes_ += buf.len;
+    UpdateWriteQueueSize();
+    ScheduleCheck();
+  }
+
+  // Write out everything corked so far with a single TryWrite()/DoWrite().
+  // The last WriteWrap carries the batch, the others are chained on its
+  // batch_ queue and complete with it. Errors are reported through the
+  // oncomplete callbacks since the writes have already been acknowledged
+  // to JS as asynchronous.
+  int StreamWrap::FlushCorked() {
+    // Held back until the file or pipe is done, see ReleaseHeldWrites().
+    if (writes_blocked())
+      return 0;
+
+    if (QUEUE_EMPTY(&corked_queue_))
+      return 0;
+
+    size_t count = 0;
+    QUEUE* q;
+    QUEUE_FOREACH(q, &corked_queue_) {
+      count++;
+    }
+
+    uv_buf_t bufs_[16];
+    uv_buf_t* bufs = bufs_;
+    if (ARRAY_SIZE(bufs_) < count)
+      bufs = new uv_buf_t[count];
+
+    size_t i = 0;
+    QUEUE_FOREACH(q, &corked_queue_) {
+      bufs[i++] = ContainerOf(&WriteWrap::cork_queue_, q)->corked_buf_;
+    }
+
+    q = QUEUE_PREV(&corked_queue_);
+    QUEUE_REMOVE(q);
+    QUEUE_INIT(q);
+    WriteWrap* carrier = ContainerOf(&WriteWrap::cork_queue_, q);
+    if (!QUEUE_EMPTY(&corked_queue_)) {
+      QUEUE_ADD(&carrier->batch_, &corked_queue_);
+      QUEUE_INIT(&corked_queue_);
+    }
+    corked_bytes_ = 0;
+
+    uv_buf_t* vbufs = bufs;
+    size_t vcount = count;
+    int err = callbacks()->TryWrite(&vbufs, &vcount);
+    if (err == 0 && vcount > 0) {
+      err = callbacks()->DoWrite(carrier,
+                                 vbufs,
+                                 vcount,
+                                 NULL,
+                                 StreamWrap::AfterWrite);
+    }
+
+    if (bufs != bufs_)
+      delete[] bufs;
+
+    if (err != 0 || vcount == 0) {
+      // Nothing left in flight, report from the check callback.
+      carrier->corked_status_ = err;
+      QUEUE_INSERT_TAIL(&flushed_queue_, &carrier->cork_queue_);
+      ScheduleCheck();
+    }
+
+    UpdateWriteQueueSize();
+    return 0;
+  }
+
+  void StreamWrap::FinishFlushed() {
+    while (!QUEUE_EMPTY(&flushed_queue_)) {
+      QUEUE* q = QUEUE_HEAD(&flushed_queue_);
+      QUEUE_REMOVE(q);
+      QUEUE_INIT(q);
+      WriteWrap* carrier = ContainerOf(&WriteWrap::cork_queue_, q);
+      FinishWrite(carrier, carrier->corked_status_);
+    }
+  }
+
+  void StreamWrap::ScheduleCheck() {
+    if (!QUEUE_EMPTY(&check_queue_))
+      return;
+
+    Environment* env = this->env();
+    if (QUEUE_EMPTY(env->stream_check_queue())) {
+      uv_check_start(env->immediate_check_handle(), OnCheck);
+      // Don't block in poll, the check callback is the end of this tick.
+      uv_idle_start(env->immediate_idle_handle(), OnIdle);
+    }
+    QUEUE_INSERT_TAIL(env->stream_check_queue(), &check_queue_);
+  }
+
+  void StreamWrap::OnCheck(uv_check_t* handle) {
+    Environment* env = Environment::from_immediate_check_handle(handle);
+    HandleScope handle_scope(env->isolate());
+    Context::Scope context_scope(env->context());
+
+    // Streams queued from the callbacks below are handled on the next pass.
+    QUEUE queue;
+    QUEUE* q;
+    if (!QUEUE_EMPTY(env->stream_check_queue())) {
+      q = QUEUE_HEAD(env->stream_check_queue());
+      QUEUE_SPLIT(env->stream_check_queue(), q, &queue);
+    } else {
+      QUEUE_INIT(&queue);
+    }
+
+    while (!QUEUE_EMPTY(&queue)) {
+      q = QUEUE_HEAD(&queue);
+      QUEUE_REMOVE(q);
+      QUEUE_INIT(q);
+
+      StreamWrap* wrap = ContainerOf(&StreamWrap::check_queue_, q);
+      wrap->FlushCorked();
+      wrap->FinishFlushed();
+      wrap->EmitPressure();
+      wrap->FlushAccepted();
+
+      // Writes held back by a sendfile or pipe are rescheduled when it ends.
+      if ((QUEUE_EMPTY(&wrap->corked_queue_) || wrap->writes_blocked()) &&
+          QUEUE_EMPTY(&wrap->flushed_queue_)) {
+        QUEUE_REMOVE(&wrap->check_queue_);
+        QUEUE_INIT(&wrap->check_queue_);
+      }
+    }
+
+    if (QUEUE_EMPTY(env->stream_check_queue())) {
+      uv_check_stop(env->immediate_check_handle());
+      uv_idle_stop(env->immediate_idle_handle());
+    }
+  }
+
+  void StreamWrap::OnIdle(uv_idle_t* handle) {
+    // Intentionally empty
+  }
+
+  // sendFile(req, fd, offset, length) pushes `length` bytes of the file
+  // straight from the page cache to the socket. Non-blocking sockets are
+  // fed with sendfile() whenever they're writable, blocking ones get a
+  // uv_fs_sendfile() on the threadpool. Writes already queued go out first,
+  // writes issued in the meantime are held back like corked writes and
+  // flushed once the file is out.
+  void StreamWrap::SendFile(const FunctionCallbackInfo<Value>& args) {
+    HandleScope handle_scope(args.GetIsolate());
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+
+    StreamWrap* wrap = Unwrap<StreamWrap>(args.Holder());
+
+    assert(args[0]->IsObject());
+    if (!args[1]->IsInt32())
+      return env->ThrowTypeError("fd must be an integer");
+    if (!args[2]->IsNumber() || !args[3]->IsNumber())
+      return env->ThrowTypeError("offset and length must be numbers");
+
+    Local<Object> req_wrap_obj = args[0].As<Object>();
+    uv_file fd = args[1]->Int32Value();
+    int64_t offset = args[2]->IntegerValue();
+    int64_t length = args[3]->IntegerValue();
+
+    if (offset < 0 || length < 0)
+      return env->ThrowRangeError("offset and length must be positive");
+
+  #if defined(_WIN32)
+    args.GetReturnValue().Set(UV_ENOSYS);
+  #else
+    char* storage;
+    SendFileWrap* req_wrap;
+    int out_fd;
+    int err;
+
+    // TLS outside the kernel and IPC pipes need the bytes in user space.
+    if ((!wrap->is_tcp() && !wrap->is_named_pipe()) ||
+        wrap->is_named_pipe_ipc() ||
+        !wrap->callbacks()->WritesRaw()) {
+      err = UV_ENOTSUP;
+      goto done;
+    }
+
+    // Only one file or pipe at a time feeds the stream.
+    if (wrap->writes_blocked()) {
+      err = UV_EBUSY;
+      goto done;
+    }
+
+    // Corked data goes out ahead of the file, the cork itself stays.
+    err = wrap->FlushCorked();
+    if (err)
+      goto done;
+
+    out_fd = dup(wrap->stream()->io_watcher.fd);
+    if (out_fd == -1) {
+      err = -errno;
+      goto done;
+    }
+
+    storage = env->request_pool()->Allocate(sizeof(SendFileWrap));
+    req_wrap = new(storage) SendFileWrap(env,
+                                         req_wrap_obj,
+                                         wrap,
+                                         out_fd,
+                                         fd,
+                                         offset,
+                                         static_cast<size_t>(length));
+    req_wrap->Dispatched();
+
+    // The file must not overtake writes libuv still has queued. Wait for
+    // them to drain, see MaybeStartSendFile(), and hold later writes back
+    // in the meantime.
+    if (wrap->stream()->write_queue_size != 0) {
+      wrap->sendfile_ = req_wrap;
+      req_wrap_obj->Set(env->async(), True(env->isolate()));
+      wrap->UpdateWriteQueueSize();
+      goto done;
+    }
+
+    err = wrap->StartSendFile(req_wrap);
+    if (err == 0 && req_wrap->remaining_ > 0) {
+      wrap->sendfile_ = req_wrap;
+      req_wrap_obj->Set(env->async(), True(env->isolate()));
+      wrap->UpdateWriteQueueSize();
+    } else {
+      // Done or failed without waiting, no callback.
+      req_wrap->Dispose();
+    }
+
+   done:
+    req_wrap_obj->Set(env->bytes_string(),
+                      Number::New(env->isolate(), static_cast<double>(length)));
+    args.GetReturnValue().Set(err);
+  #endif
+  }
+
+  int StreamWrap::StartSendFile(SendFileWrap* req_wrap) {
+    int err;
+
+    req_wrap->started_ = true;
+    if (req_wrap->remaining_ == 0)
+      return 0;
+
+  #if !defined(_WIN32)
+    int flags = fcntl(req_wrap->out_fd_, F_GETFL);
+    if (flags != -1 && !(flags & O_NONBLOCK)) {
+      return uv_fs_sendfile(env()->event_loop(),
+                            &req_wrap->req_,
+                            req_wrap->out_fd_,
+                            req_wrap->in_fd_,
+                            req_wrap->offset_,
+                            req_wrap->remaining_,
+                            AfterSendFile);
+    }
+  #endif
+
+    err = req_wrap->SendSome();
+    if (err == 0 && req_wrap->remaining_ > 0) {
+      err = uv_poll_init(env()->event_loop(),
+                         &req_wrap->poll_,
+                         req_wrap->out_fd_);
+      if (err == 0) {
+        req_wrap->polling_ = true;
+        err = uv_poll_start(&req_wrap->poll_,
+                            UV_WRITABLE,
+                            OnSendFileWritable);
+      }
+    }
+    return err;
+  }
+
+  // A sendFile() queued behind earlier writes starts once libuv is done
+  // with them. JS was told it's async, so the result comes as a callback.
+  void StreamWrap::MaybeStartSendFile() {
+    if (sendfile_ == NULL || sendfile_->started_)
+      return;
+    if (stream()->write_queue_size != 0)
+      return;
+
+    SendFileWrap* req_wrap = sendfile_;
+    int err = StartSendFile(req_wrap);
+    if (err != 0 || req_wrap->remaining_ == 0) {
+      if (req_wrap->polling_)
+        uv_poll_stop(&req_wrap->poll_);
+      FinishSendFile(req_wrap, err);
+      return;
+    }
+    UpdateWriteQueueSize();
+  }
+
+  void StreamWrap::OnSendFileWritable(uv_poll_t* handle,
+                                      int status,
+                                      int events) {
+    SendFileWrap* req_wrap = ContainerOf(&SendFileWrap::poll_, handle);
+    if (status == 0)
+      status = req_wrap->SendSome();
+    if (status == 0 && req_wrap->remaining_ > 0) {
+      req_wrap->wrap_->UpdateWriteQueueSize();
+      return;
+    }
+    uv_poll_stop(handle);
+    req_wrap->wrap_->FinishSendFile(req_wrap, status);
+  }
+
+  void StreamWrap::AfterSendFile(uv_fs_t* req) {
+    SendFileWrap* req_wrap = ContainerOf(&SendFileWrap::req_, req);
+    int status = req->result < 0 ? static_cast<int>(req->result) : 0;
+
+    if (req_wrap->wrap_ == NULL) {
+      req_wrap->Dispose();
+      return;
+    }
+
+    if (req->result > 0) {
+      req_wrap->offset_ += req->result;
+      req_wrap->remaining_ -= req->result;
+    } else if (req->result == 0 && req_wrap->remaining_ > 0) {
+      status = UV_EOF;  // File is shorter than requested.
+    }
+
+    if (status == 0 && req_wrap->remaining_ > 0) {
+      uv_fs_req_cleanup(req);
+      status = uv_fs_sendfile(req->loop,
+                              req,
+                              req_wrap->out_fd_,
+                              req_wrap->in_fd_,
+                              req_wrap->offset_,
+                              req_wrap->remaining_,
+                              AfterSendFile);
+      if (status == 0) {
+        req_wrap->wrap_->UpdateWriteQueueSize();
+        return;
+      }
+    }
+
+    req_wrap->wrap_->FinishSendFile(req_wrap, status);
+  }
+
+  void StreamWrap::FinishSendFile(SendFileWrap* req_wrap, int status) {
+    Environment* env = this->env();
+    HandleScope handle_scope(env->isolate());
+    Context::Scope context_scope(env->context());
+
+    assert(sendfile_ == req_wrap);
+    sendfile_ = NULL;
+    UpdateWriteQueueSize();
+
+    Local<Value> argv[] = {
+      Integer::New(env->isolate(), status),
+      object(),
+      req_wrap->object(),
+      Undefined(env->isolate())
+    };
+    req_wrap->MakeCallback(env->oncomplete_string(), ARRAY_SIZE(argv), argv);
+    req_wrap->Dispose();
+
+    ReleaseHeldWrites();
+    MaybeDrain();
+  }
+
+  // Writes that queued up behind a sendfile or pipe go out now, or at the
+  // end of the tick if the stream is corked.
+  void StreamWrap::ReleaseHeldWrites() {
+    if (writes_blocked() || QUEUE_EMPTY(&corked_queue_))
+      return;
+    if (corked_)
+      ScheduleCheck();
+    else
+      FlushCorked();
+  }
+
+  // pipeTo(sink, highWaterMark, lowWaterMark, splice) forwards everything
+  // read from this stream to `sink` in C++, see StreamPipe.
+  void StreamWrap::PipeTo(const FunctionCallbackInfo<Value>& args) {
+    HandleScope handle_scope(args.GetIsolate());
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+
+    StreamWrap* wrap = Unwrap<StreamWrap>(args.Holder());
+
+    if (!args[0]->IsObject())
+      return env->ThrowTypeError("sink must be a stream handle");
+
+    Local<Object> sink_obj = args[0].As<Object>();
+    if (!env->tcp_constructor_template()->HasInstance(sink_obj) &&
+        !env->pipe_constructor_template()->HasInstance(sink_obj)) {
+      return env->ThrowTypeError("sink must be a stream handle");
+    }
+    StreamWrap* sink = Unwrap<StreamWrap>(sink_obj);
+
+    size_t high = StreamPipe::kDefaultHighWaterMark;
+    size_t low = StreamPipe::kDefaultLowWaterMark;
+    if (args[1]->IsUint32())
+      high = args[1]->Uint32Value();
+    if (args[2]->IsUint32())
+      low = args[2]->Uint32Value();
+    if (low > high)
+      return env->ThrowRangeError("lowWaterMark must not exceed highWaterMark");
+    bool use_splice = args[3]->BooleanValue();
+
+    int err = 0;
+    if (sink == NULL || sink == wrap) {
+      err = UV_EINVAL;
+    } else if (wrap->is_named_pipe_ipc() ||
+               sink->is_named_pipe_ipc() ||
+               wrap->callbacks() != &wrap->default_callbacks_ ||
+               sink->callbacks() != &sink->default_callbacks_) {
+      // TLS and IPC streams need JS to look at the data.
+      err = UV_ENOTSUP;
+    } else if (wrap->pipe_out_ != NULL || sink->pipe_in_ != NULL ||
+               sink->writes_blocked()) {
+      err = UV_EBUSY;
+    }
+
+    // Corked data on the sink predates the pipe and goes out ahead of it.
+    if (err == 0)
+      err = sink->FlushCorked();
+
+    if (err == 0) {
+      StreamPipe* pipe = new StreamPipe(wrap, sink, high, low);
+      err = pipe->Start(use_splice);
+      if (err)
+        delete pipe;
+    }
+
+    args.GetReturnValue().Set(err);
+  }
+
   void StreamWrap::AfterWrite(uv_write_t* req, int status) {
     WriteWrap* req_wrap = ContainerOf(&WriteWrap::req_, req);
+    FinishWrite(req_wrap, status);
+  }
+
+  void StreamWrap::FinishWrite(WriteWrap* req_wrap, int status) {
     StreamWrap* wrap = req_wrap->wrap();
     Environment* env = wrap->env();
 
     HandleScope handle_scope(env->isolate());
     Context::Scope context_scope(env->context());
 
+    // Corked writes that rode on this one complete first, in order.
+    while (!QUEUE_EMPTY(&req_wrap->batch_)) {
+      QUEUE* q = QUEUE_HEAD(&req_wrap->batch_);
+      QUEUE_REMOVE(q);
+      QUEUE_INIT(q);
+      FinishWrite(ContainerOf(&WriteWrap::cork_queue_, q), status);
+    }
+
     // The wrap and request objects should still be there.
     assert(req_wrap->persistent().IsEmpty() == false);
     assert(wrap->persistent().IsEmpty() == false);
 
+    StreamStats* stats = wrap->stats();
+    if (stats != NULL && req_wrap->start_time_ != 0) {
+      double latency = static_cast<double>(uv_hrtime() - req_wrap->start_time_);
+      stats->fields[StreamStats::STATS_WRITE_COMPLETIONS]++;
+      stats->fields[StreamStats::STATS_WRITE_LATENCY_TOTAL] += latency;
+      stats->Max(StreamStats::STATS_WRITE_LATENCY_MAX, latency);
+    }
+
     // Unref handle property
     Local<Object> req_wrap_obj = req_wrap->object();
     req_wrap_obj->Delete(env->handle_string());
@@ -538,7 +1673,10 @@ namespace node {
     req_wrap->MakeCallback(env->oncomplete_string(), ARRAY_SIZE(argv), argv);
 
     req_wrap->~WriteWrap();
-    delete[] reinterpret_cast<char*>(req_wrap);
+    env->request_pool()->Free(reinterpret_cast<char*>(req_wrap));
+
+    wrap->MaybeStartSendFile();
+    wrap->MaybeDrain();
   }
 
   void StreamWrap::Shutdown(const FunctionCallbackInfo<Value>& args) {
@@ -550,11 +1688,22 @@ namespace node {
     assert(args[0]->IsObject());
     Local<Object> req_wrap_obj = args[0].As<Object>();
 
-    ShutdownWrap* req_wrap = new ShutdownWrap(env, req_wrap_obj);
-    int err = wrap->callbacks()->DoShutdown(req_wrap, AfterShutdown);
+    // Whatever is still corked has to go out before the FIN.
+    wrap->corked_ = false;
+    int err = wrap->writes_blocked() ? UV_EBUSY : wrap->FlushCorked();
+    if (err) {
+      args.GetReturnValue().Set(err);
+      return;
+    }
+
+    char* storage = env->request_pool()->Allocate(sizeof(ShutdownWrap));
+    ShutdownWrap* req_wrap = new(storage) ShutdownWrap(env, req_wrap_obj);
+    err = wrap->callbacks()->DoShutdown(req_wrap, AfterShutdown);
     req_wrap->Dispatched();
-    if (err)
-      delete req_wrap;
+    if (err) {
+      req_wrap->~ShutdownWrap();
+      env->request_pool()->Free(storage);
+    }
     args.GetReturnValue().Set(err);
   }
 
@@ -579,7 +1728,8 @@ namespace node {
 
     req_wrap->MakeCallback(env->oncomplete_string(), ARRAY_SIZE(argv), argv);
 
-    delete req_wrap;
+    req_wrap->~ShutdownWrap();
+    env->request_pool()->Free(reinterpret_cast<char*>(req_wrap));
   }
 
   const char* StreamWrapCallbacks::Error() {
@@ -605,6 +1755,19 @@ namespace node {
     // Slice off the buffers: skip all written buffers and slice the one that
     // was partially written.
     written = err;
+
+    StreamStats* stats = wrap()->stats();
+    if (stats != NULL && written > 0) {
+      stats->fields[StreamStats::STATS_BYTES_WRITTEN] += written;
+      // Done without a request, or the rest goes to DoWrite().
+      size_t total = 0;
+      for (size_t i = 0; i < vcount; i++)
+        total += vbufs[i].len;
+      if (written == total)
+        stats->fields[StreamStats::STATS_WRITES]++;
+      else
+        stats->fields[StreamStats::STATS_PARTIAL_WRITES]++;
+    }
     for (; written != 0 && vcount > 0; vbufs++, vcount--) {
       // Slice
       if (vbufs[0].len > written) {
@@ -642,6 +1805,12 @@ namespace node {
       } else if (wrap()->stream()->type == UV_NAMED_PIPE) {
         NODE_COUNT_PIPE_BYTES_SENT(bytes);
       }
+
+      StreamStats* stats = wrap()->stats();
+      if (stats != NULL) {
+        stats->fields[StreamStats::STATS_WRITES]++;
+        stats->fields[StreamStats::STATS_BYTES_WRITTEN] += bytes;
+      }
     }
 
     wrap()->UpdateWriteQueueSize();
@@ -654,14 +1823,17 @@ namespace node {
   }
 
   void StreamWrapCallbacks::DoAlloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
-    buf->base = static_cast<char*>(malloc(suggested_size));
-    buf->len = suggested_size;
-
-    if (buf->base == NULL && suggested_size > 0) {
-      FatalError(
-          "node::StreamWrapCallbacks::DoAlloc(uv_handle_t*, size_t, uv_buf_t*)",
-          "Out Of Memory");
+    if (wrap()->has_read_buffer()) {
+      size_t size;
+      buf->base = wrap()->ReadBufferSpace(&size);
+      buf->len = size;
+      return;
     }
+
+    // Read straight into the environment's slab, DoRead() commits what
+    // was actually read.
+    buf->base = wrap()->env()->slab_allocator()->Allocate(suggested_size);
+    buf->len = suggested_size;
   }
 
   void StreamWrapCallbacks::DoRead(uv_stream_t* handle, ssize_t nread, const uv_buf_t* buf, uv_handle_type pending) {
@@ -675,34 +1847,42 @@ namespace node {
       Undefined(env->isolate())
     };
 
+    // Nothing to free on error or EAGAIN, the slab space is simply
+    // handed out again on the next DoAlloc().
     if (nread < 0)  {
-      if (buf->base != NULL)
-        free(buf->base);
       wrap()->MakeCallback(env->onread_string(), ARRAY_SIZE(argv), argv);
       return;
     }
 
     if (nread == 0) {
-      if (buf->base != NULL)
-        free(buf->base);
       return;
     }
 
-    char* base = static_cast<char*>(realloc(buf->base, nread));
+    // An IPC pipe with accept batching receives handles from a
+    // TCPDispatcher: they go out in onconnection() batches like accepted
+    // connections, the bytes carrying them are dropped.
+    if (wrap()->accept_batch_ != 0 && wrap()->is_named_pipe_ipc()) {
+      uv_pipe_t* pipe = reinterpret_cast<uv_pipe_t*>(handle);
+      while (pending != UV_UNKNOWN_HANDLE) {
+        Local<Object> client_obj = AcceptPending(env, handle, wrap(), pending);
+        if (!client_obj.IsEmpty())
+          wrap()->QueueAccepted(client_obj);
+        pending = uv_pipe_pending_count(pipe) > 0 ? uv_pipe_pending_type(pipe) :
+                                                    UV_UNKNOWN_HANDLE;
+      }
+      return;
+    }
+
     assert(static_cast<size_t>(nread) <= buf->len);
-    argv[1] = Buffer::Use(env, base, nread);
-
-    Local<Object> pending_obj;
-    if (pending == UV_TCP) {
-      pending_obj = AcceptHandle<TCPWrap, uv_tcp_t>(env, handle, wrap());
-    } else if (pending == UV_NAMED_PIPE) {
-      pending_obj = AcceptHandle<PipeWrap, uv_pipe_t>(env, handle, wrap());
-    } else if (pending == UV_UDP) {
-      pending_obj = AcceptHandle<UDPWrap, uv_udp_t>(env, handle, wrap());
+    if (wrap()->has_read_buffer()) {
+      size_t offset = wrap()->CommitReadBuffer(buf->base, nread);
+      argv[1] = Integer::NewFromUnsigned(env->isolate(),
+                                         static_cast<uint32_t>(offset));
     } else {
-      assert(pending == UV_UNKNOWN_HANDLE);
+      argv[1] = env->slab_allocator()->Shrink(env, buf->base, nread);
     }
 
+    Local<Object> pending_obj = AcceptPending(env, handle, wrap(), pending);
     if (!pending_obj.IsEmpty()) {
       argv[2] = pending_obj;
     }
@@ -715,6 +1895,15 @@ namespace node {
     return uv_shutdown(&req_wrap->req_, wrap()->stream(), cb);
   }
 
+  // For callbacks with reads of their own, the stream delivers nothing
+  // by itself.
+  void StreamWrapCallbacks::ReadStarted() {
+  }
+
+  bool StreamWrapCallbacks::WritesRaw() {
+    return this == &wrap()->default_callbacks_;
+  }
+
 } //End Node Namespace
 
 //NODE_MODULE_CONTEXT_AWARE_BUILTIN(stream_wrap, node::StreamWrap::Initialize)
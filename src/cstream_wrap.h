@@ -24,6 +24,7 @@
 //#include "cenv.h"
 #include "chandle_wrap.h"
 #include "creq_wrap.h"
+#include "cstream_stats.h"
 //#include "cstring_bytes.h"
 //#include "cnode_buffer.h"
 
@@ -32,6 +33,8 @@
 
 namespace node {
   class StreamWrap;
+  class SendFileWrap;
+  class StreamPipe;
 
   class ShutdownWrap : public ReqWrap<uv_shutdown_t> {
    public:
@@ -42,20 +45,27 @@ namespace node {
       Wrap(req_wrap_obj, this);
     }
 
+    void* operator new(size_t size, char* storage) { return storage; }
+
+    // This is just to keep the compiler happy. It should never be called, since
+    // we don't use exceptions in node.
+    void operator delete(void* ptr, char* storage) { assert(0); }
+
     static void NewShutdownWrap(const v8::FunctionCallbackInfo<v8::Value>& args) {
       CHECK(args.IsConstructCall());
     }
+
+   private:
+    // Storage comes from the environment's RequestPool, see StreamWrap::Shutdown.
+    void* operator new(size_t size) { assert(0); }
+    void operator delete(void* ptr) { assert(0); }
   };
 
   class WriteWrap: public ReqWrap<uv_write_t> {
    public:
     // TODO(trevnorris): WrapWrap inherits from ReqWrap, which I've globbed
     // into the same provider. How should these be broken apart?
-    WriteWrap(Environment* env, v8::Local<v8::Object> obj, StreamWrap* wrap)
-        : ReqWrap<uv_write_t>(env, obj, AsyncWrap::PROVIDER_WRITEWRAP),
-          wrap_(wrap) {
-      Wrap(obj, this);
-    }
+    WriteWrap(Environment* env, v8::Local<v8::Object> obj, StreamWrap* wrap);
 
     void* operator new(size_t size, char* storage) { return storage; }
 
@@ -78,6 +88,16 @@ namespace node {
     void operator delete(void* ptr) { assert(0); }
 
     StreamWrap* const wrap_;
+
+    // Cork support, see StreamWrap::FlushCorked().
+    QUEUE cork_queue_;  // Member of StreamWrap::corked_queue_ or batch_.
+    QUEUE batch_;  // Earlier corked writes that ride on this one.
+    uv_buf_t corked_buf_;
+    int corked_status_;
+
+    uint64_t start_time_;  // For the write latency stats, zero if disabled.
+
+    friend class StreamWrap;
   };
 
   // Overridable callbacks' types
@@ -101,6 +121,11 @@ namespace node {
     virtual void DoAlloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
     virtual void DoRead(uv_stream_t* handle, ssize_t nread, const uv_buf_t* buf, uv_handle_type pending);
     virtual int DoShutdown(ShutdownWrap* req_wrap, uv_shutdown_cb cb);
+    virtual void ReadStarted();
+
+    // True when written bytes reach the wire unchanged, so sendfile may
+    // bypass DoWrite()
+    virtual bool WritesRaw();
 
    protected:
     inline StreamWrap* wrap() const {
@@ -142,10 +167,35 @@ namespace node {
 
     static void SetBlocking(const v8::FunctionCallbackInfo<v8::Value>& args);
 
+    static void Cork(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void Uncork(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+    static void SendFile(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void PipeTo(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void SetReadBuffer(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void SetWriteWatermarks(
+        const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void SetStatsEnabled(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void SetAcceptBatch(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void GetStats(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void GetStreamStats(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+    static void GetRequestPoolStats(
+        const v8::FunctionCallbackInfo<v8::Value>& args);
+
     inline StreamWrapCallbacks* callbacks() const {
       return callbacks_;
     }
 
+    inline bool has_default_callbacks() const {
+      return callbacks_ == &default_callbacks_;
+    }
+
+    // NULL unless enabled with setStatsEnabled().
+    inline StreamStats* stats() const {
+      return stats_;
+    }
+
     inline uv_stream_t* stream() const {
       return stream_;
     }
@@ -163,21 +213,45 @@ namespace node {
       return stream()->type == UV_TCP;
     }
 
+    // Nothing queued or held back, and no sendfile or pipe attached.
+    inline bool is_idle() const {
+      return stream()->write_queue_size == 0 &&
+             QUEUE_EMPTY(&corked_queue_) &&
+             QUEUE_EMPTY(&flushed_queue_) &&
+             !writes_blocked() &&
+             pipe_out_ == NULL;
+    }
+
+    // Read-into mode: reads land in the Buffer registered with
+    // setReadBuffer(), used as a ring, and onread gets the offset of the
+    // data instead of a new Buffer.
+    inline bool has_read_buffer() const {
+      return read_buffer_data_ != NULL;
+    }
+
+    // Writable space at the current offset, wrapping to the start of the
+    // buffer once the end is reached.
+    char* ReadBufferSpace(size_t* size);
+
+    // Consume `nread` bytes read into `data`, returns their offset.
+    size_t CommitReadBuffer(char* data, size_t nread);
+
    protected:
     static size_t WriteBuffer(v8::Handle<v8::Value> val, uv_buf_t* buf);
 
     StreamWrap(Environment* env,v8::Local<v8::Object> object, uv_stream_t* stream, AsyncWrap::ProviderType provider,
       AsyncWrap* parent = NULL);
 
-    ~StreamWrap() {
-      if (!callbacks_gc_ && callbacks_ != &default_callbacks_) {
-        delete callbacks_;
-      }
-      callbacks_ = NULL;
-    }
+    ~StreamWrap();
 
     void StateChange() { }
     void UpdateWriteQueueSize();
+    void DisableStats();
+
+    // Accept batching for listeners.  QueueAccepted() returns false when
+    // it is off and the caller reports the connection itself.
+    bool QueueAccepted(v8::Local<v8::Object> client_obj);
+    void FlushAccepted();
 
    private:
     // Callbacks for libuv
@@ -191,11 +265,79 @@ namespace node {
     template <enum encoding encoding>
     static void WriteStringImpl(const v8::FunctionCallbackInfo<v8::Value>& args);
 
+    // Cork support
+    void QueueCorked(WriteWrap* req_wrap, uv_buf_t buf);
+    int FlushCorked();
+    void FinishFlushed();
+    void ScheduleCheck();
+    static void FinishWrite(WriteWrap* req_wrap, int status);
+    static void OnCheck(uv_check_t* handle);
+    static void OnIdle(uv_idle_t* handle);
+
+    // Writes are queued instead of being written while corked, and while
+    // a sendfile or a pipe into this stream is in progress.
+    inline bool writes_held() const {
+      return corked_ || writes_blocked();
+    }
+
+    inline bool writes_blocked() const {
+      return sendfile_ != NULL || pipe_in_ != NULL;
+    }
+
+    void ReleaseHeldWrites();
+
+    // Write queue watermarks
+    inline size_t write_queue_bytes() const;
+    void OnPressure();
+    void EmitPressure();
+    void MaybeDrain();
+    StreamWrap* paired_stream();
+    void ResumePaired();
+
+    // sendfile support
+    int StartSendFile(SendFileWrap* req_wrap);
+    void MaybeStartSendFile();
+    void FinishSendFile(SendFileWrap* req_wrap, int status);
+    static void OnSendFileWritable(uv_poll_t* handle, int status, int events);
+    static void AfterSendFile(uv_fs_t* req);
+
     uv_stream_t* const stream_;
     StreamWrapCallbacks default_callbacks_;
     StreamWrapCallbacks* callbacks_;  // Overridable callbacks
     bool callbacks_gc_;
 
+    bool corked_;
+    size_t corked_bytes_;
+    QUEUE corked_queue_;  // Writes waiting for uncork or the end of the tick.
+    QUEUE flushed_queue_;  // Batches written synchronously, not yet reported.
+    QUEUE check_queue_;  // Member of env->stream_check_queue().
+
+    SendFileWrap* sendfile_;  // In progress sendFile(), if any.
+    friend class SendFileWrap;
+
+    size_t high_water_mark_;  // Zero when watermarks are off.
+    size_t low_water_mark_;
+    bool pressure_;  // Above the high-water mark, not yet drained.
+    bool pressure_pending_;  // onpressure waiting for the check callback.
+    v8::Persistent<v8::Object> paired_;  // Reads paused under pressure.
+    bool reading_;  // Between readStart() and readStop() from JS.
+    bool read_paused_;  // Stopped by a paired stream's backpressure.
+
+    StreamStats* stats_;
+
+    v8::Persistent<v8::Object> read_buffer_;
+    char* read_buffer_data_;
+    size_t read_buffer_length_;
+    size_t read_buffer_offset_;
+
+    uint32_t accept_batch_;  // Connections per onconnection, zero when off.
+    uint32_t accepted_count_;
+    v8::Persistent<v8::Array> accepted_;  // Not yet reported.
+
+    StreamPipe* pipe_out_;  // Pipe reading from this stream.
+    StreamPipe* pipe_in_;  // Pipe writing to this stream.
+    friend class StreamPipe;
+
     friend class StreamWrapCallbacks;
   };
 
@@ -0,0 +1,219 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#include "ctcp_dispatch.h"
+#include "cenv.h"
+#include "cenv-inl.h"
+#include "cutil.h"
+#include "cutil-inl.h"
+
+#include <assert.h>
+#if !defined(_WIN32)
+#include <unistd.h>  // dup()
+#endif
+
+namespace node {
+  // Installed on each pipe, reads acknowledgements instead of handing
+  // them to JS. Deleted along with the pipe.
+  class TCPDispatcher::Channel : public StreamWrapCallbacks {
+   public:
+    explicit Channel(StreamWrap* wrap)
+        : StreamWrapCallbacks(wrap),
+          inflight_(0),
+          ack_length_(0) {
+      QUEUE_INIT(&member_);
+    }
+
+    ~Channel() {
+      Detach();
+    }
+
+    inline uv_stream_t* stream() const {
+      return wrap()->stream();
+    }
+
+    inline bool writable() const {
+      return !uv_is_closing(reinterpret_cast<uv_handle_t*>(stream())) &&
+             uv_is_writable(stream());
+    }
+
+    void Detach() {
+      QUEUE_REMOVE(&member_);
+      QUEUE_INIT(&member_);
+    }
+
+    void DoRead(uv_stream_t* handle,
+                ssize_t nread,
+                const uv_buf_t* buf,
+                uv_handle_type pending);
+
+    QUEUE member_;  // Member of TCPDispatcher::channels_, if attached.
+    uint32_t inflight_;  // Sent and not yet acknowledged.
+    unsigned char ack_[4];  // Partial acknowledgement.
+    size_t ack_length_;
+  };
+
+  struct TCPDispatcher::Carrier {
+    uv_write_t req;
+    uv_tcp_t client;
+  };
+
+  static char kCarrierByte = 'H';
+
+
+  void TCPDispatcher::Channel::DoRead(uv_stream_t* handle,
+                                      ssize_t nread,
+                                      const uv_buf_t* buf,
+                                      uv_handle_type pending) {
+    // The worker is gone, JS still hears about it.
+    if (nread < 0) {
+      Detach();
+      return StreamWrapCallbacks::DoRead(handle, nread, buf, pending);
+    }
+
+    // The slab space is simply handed out again, nothing to commit.
+    const unsigned char* data = reinterpret_cast<unsigned char*>(buf->base);
+    for (ssize_t i = 0; i < nread; i++) {
+      ack_[ack_length_++] = data[i];
+      if (ack_length_ < sizeof(ack_))
+        continue;
+      ack_length_ = 0;
+      uint32_t count = ack_[0] | (ack_[1] << 8) | (ack_[2] << 16) |
+                       (static_cast<uint32_t>(ack_[3]) << 24);
+      inflight_ = count < inflight_ ? inflight_ - count : 0;
+    }
+  }
+
+
+  TCPDispatcher::TCPDispatcher()
+      : least_loaded_(false),
+        dispatched_(0),
+        failed_(0) {
+    QUEUE_INIT(&channels_);
+  }
+
+
+  // The channels stay installed on their pipes and keep reading
+  // acknowledgements, they just have nothing to report them to.
+  TCPDispatcher::~TCPDispatcher() {
+    while (!QUEUE_EMPTY(&channels_)) {
+      Channel* channel = ContainerOf(&Channel::member_, QUEUE_HEAD(&channels_));
+      channel->Detach();
+    }
+  }
+
+
+  int TCPDispatcher::AddPipe(StreamWrap* pipe) {
+    if (!pipe->is_named_pipe_ipc())
+      return UV_EINVAL;
+    if (!pipe->has_default_callbacks())
+      return UV_EBUSY;
+
+    Channel* channel = new Channel(pipe);
+    pipe->OverrideCallbacks(channel, false);
+    QUEUE_INSERT_TAIL(&channels_, &channel->member_);
+    return 0;
+  }
+
+
+  // The chosen channel moves to the back, so that ties go round too.
+  TCPDispatcher::Channel* TCPDispatcher::Pick() {
+    Channel* picked = NULL;
+    QUEUE* q;
+    QUEUE_FOREACH(q, &channels_) {
+      Channel* channel = ContainerOf(&Channel::member_, q);
+      if (!channel->writable())
+        continue;
+      if (picked == NULL || channel->inflight_ < picked->inflight_)
+        picked = channel;
+      if (!least_loaded_)
+        break;
+    }
+
+    if (picked != NULL) {
+      QUEUE_REMOVE(&picked->member_);
+      QUEUE_INSERT_TAIL(&channels_, &picked->member_);
+    }
+    return picked;
+  }
+
+
+  bool TCPDispatcher::Dispatch(uv_stream_t* server, int* fd) {
+    *fd = -1;
+
+    Channel* channel = Pick();
+    if (channel == NULL)
+      return false;
+
+    Carrier* carrier = new Carrier;
+    int r = uv_tcp_init(server->loop, &carrier->client);
+    assert(r == 0);  // can't fail anyway
+
+    uv_stream_t* client = reinterpret_cast<uv_stream_t*>(&carrier->client);
+    uv_handle_t* client_handle = reinterpret_cast<uv_handle_t*>(client);
+
+    // Nothing to accept after all.
+    if (uv_accept(server, client)) {
+      uv_close(client_handle, OnClientClose);
+      return true;
+    }
+
+    uv_buf_t buf = uv_buf_init(&kCarrierByte, 1);
+    int err = uv_write2(&carrier->req,
+                        channel->stream(),
+                        &buf,
+                        1,
+                        client,
+                        AfterWrite);
+    if (err == 0) {
+      channel->inflight_++;
+      dispatched_++;
+      return true;
+    }
+
+    // The connection stays here, on a descriptor of its own since the
+    // carrier handle closes asynchronously.
+    failed_++;
+  #if !defined(_WIN32)
+    uv_os_fd_t client_fd;
+    if (uv_fileno(client_handle, &client_fd) == 0)
+      *fd = dup(client_fd);
+  #endif
+    uv_close(client_handle, OnClientClose);
+    return *fd == -1;
+  }
+
+
+  // The worker has its own descriptor now, or never will.
+  void TCPDispatcher::AfterWrite(uv_write_t* req, int status) {
+    Carrier* carrier = ContainerOf(&Carrier::req, req);
+    uv_close(reinterpret_cast<uv_handle_t*>(&carrier->client), OnClientClose);
+  }
+
+
+  void TCPDispatcher::OnClientClose(uv_handle_t* handle) {
+    Carrier* carrier =
+        ContainerOf(&Carrier::client, reinterpret_cast<uv_tcp_t*>(handle));
+    delete carrier;
+  }
+
+}//End Node Namespace
@@ -0,0 +1,83 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#ifndef SRC_TCP_DISPATCH_H_
+#define SRC_TCP_DISPATCH_H_
+
+#include "cstream_wrap.h"
+#include "cqueue.h"
+
+#include "uv.h"
+#include <stdint.h>
+
+namespace node {
+  // Hands connections accepted on a listening TCPWrap to worker processes
+  // over IPC pipes without calling into JS. Each connection goes out as a
+  // one-byte write carrying the handle, to the next pipe in turn or to the
+  // one with the fewest unacknowledged connections. Workers receive them
+  // in batches with setAcceptBatch() on their end and acknowledge finished
+  // connections by writing 32-bit little-endian counts. The pipes carry
+  // nothing else; a pipe leaves the rotation at EOF or when it is closed.
+  class TCPDispatcher {
+   public:
+    TCPDispatcher();
+    ~TCPDispatcher();
+
+    inline void set_least_loaded(bool least_loaded) {
+      least_loaded_ = least_loaded;
+    }
+
+    int AddPipe(StreamWrap* pipe);
+
+    // Accepts the next connection on `server` and sends it on. False when
+    // there is no pipe to send it to, the connection is left to the caller.
+    // If sending failed it has been accepted already and *fd, otherwise -1,
+    // is a descriptor for it that the caller takes over.
+    bool Dispatch(uv_stream_t* server, int* fd);
+
+    inline uint64_t dispatched() const {
+      return dispatched_;
+    }
+
+    inline uint64_t failed() const {
+      return failed_;
+    }
+
+    // Defined in ctcp_dispatch.cc.
+    class Channel;
+    struct Carrier;
+
+   private:
+    Channel* Pick();
+
+    static void AfterWrite(uv_write_t* req, int status);
+    static void OnClientClose(uv_handle_t* handle);
+
+    QUEUE channels_;  // In dispatch order.
+    bool least_loaded_;
+    uint64_t dispatched_;
+    uint64_t failed_;  // Sends that failed, accepted locally instead.
+  };
+
+}//End Node Namespace
+
+#endif //SRC_TCP_DISPATCH_H_
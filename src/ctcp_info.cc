@@ -0,0 +1,76 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#include "ctcp_info.h"
+
+#if defined(__linux__)
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#endif
+
+namespace node {
+
+#if defined(__linux__) && defined(TCP_INFO)
+  // tcpi_delivery_rate (4.9+) is past the end of older libc definitions of
+  // struct tcp_info, read it from the kernel's layout.
+  static const size_t kDeliveryRateOffset = 160;
+  static const size_t kRawInfoSize = 256;
+#endif
+
+  int TCPInfo::Read(const uv_tcp_t* handle, double* fields) {
+  #if defined(__linux__) && defined(TCP_INFO)
+    int fd = handle->io_watcher.fd;
+    if (fd == -1)
+      return UV_EBADF;
+
+    union {
+      struct tcp_info info;
+      char raw[kRawInfoSize];
+    } u;
+    memset(&u, 0, sizeof(u));
+    socklen_t len = sizeof(u);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &u, &len))
+      return -errno;
+
+    fields[INFO_RTT] = u.info.tcpi_rtt;
+    fields[INFO_RTT_VAR] = u.info.tcpi_rttvar;
+    fields[INFO_SND_CWND] = u.info.tcpi_snd_cwnd;
+    fields[INFO_TOTAL_RETRANS] = u.info.tcpi_total_retrans;
+    fields[INFO_UNACKED] = u.info.tcpi_unacked;
+
+    uint64_t delivery_rate = 0;
+    if (len >= kDeliveryRateOffset + sizeof(delivery_rate)) {
+      memcpy(&delivery_rate,
+             u.raw + kDeliveryRateOffset,
+             sizeof(delivery_rate));
+    }
+    fields[INFO_DELIVERY_RATE] = static_cast<double>(delivery_rate);
+    return 0;
+  #else
+    return UV_ENOTSUP;
+  #endif
+  }
+
+}//End Node Namespace
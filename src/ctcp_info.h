@@ -0,0 +1,82 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#ifndef SRC_TCP_INFO_H_
+#define SRC_TCP_INFO_H_
+
+#include "uv.h"
+
+#include <string.h>  // memset()
+
+namespace node {
+
+  // Fields filled in by getTCPInfo(), in Float64Array order. Times are in
+  // microseconds, the delivery rate in bytes per second.
+  #define TCP_INFO_FIELDS(V)                                                  \
+    V(RTT, rtt)                                                               \
+    V(RTT_VAR, rttVar)                                                        \
+    V(SND_CWND, sndCwnd)                                                      \
+    V(TOTAL_RETRANS, totalRetrans)                                            \
+    V(UNACKED, unacked)                                                       \
+    V(DELIVERY_RATE, deliveryRate)                                            \
+
+  struct TCPInfo {
+    enum Field {
+    #define V(NAME, _) INFO_##NAME,
+      TCP_INFO_FIELDS(V)
+    #undef V
+      kFieldCount
+    };
+
+    // getsockopt(TCP_INFO), fields the kernel does not report are zero.
+    // UV_ENOTSUP where TCP_INFO is not available.
+    static int Read(const uv_tcp_t* handle, double* fields);
+  };
+
+  // RTTs sampled across all TCP handles of an environment. Bucket i counts
+  // RTTs in [2^i, 2^(i+1)) microseconds, the first one also takes zero.
+  struct RTTHistogram {
+    static const int kBucketCount = 32;
+
+    RTTHistogram() {
+      Reset();
+    }
+
+    inline void Reset() {
+      memset(buckets, 0, sizeof(buckets));
+    }
+
+    inline void Record(unsigned int rtt_us) {
+      int bucket = 0;
+      while (rtt_us > 1 && bucket < kBucketCount - 1) {
+        rtt_us >>= 1;
+        bucket++;
+      }
+      buckets[bucket]++;
+    }
+
+    double buckets[kBucketCount];
+  };
+
+}//End Node Namespace
+
+#endif //SRC_TCP_INFO_H_
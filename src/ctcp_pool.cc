@@ -0,0 +1,289 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#include "ctcp_pool.h"
+#include "ctcp_wrap.h"
+#include "cnode_internal.h"
+#include "cenv.h"
+#include "cenv-inl.h"
+#include "cutil.h"
+#include "cutil-inl.h"
+
+#include <assert.h>
+#include <string.h>  // memcpy(), memset()
+#if !defined(_WIN32)
+#include <errno.h>
+#include <sys/socket.h>
+#endif
+
+namespace node {
+  using v8::Context;
+  using v8::EscapableHandleScope;
+  using v8::HandleScope;
+  using v8::Local;
+  using v8::Object;
+
+  TCPPool::TCPPool()
+      : env_(NULL),
+        max_idle_ms_(kDefaultMaxIdleMs),
+        max_per_host_(kDefaultMaxPerHost),
+        idle_count_(0),
+        hits_(0),
+        misses_(0),
+        evictions_(0) {
+    QUEUE_INIT(&hosts_);
+  }
+
+
+  // The handles themselves go away with the loop.
+  TCPPool::~TCPPool() {
+    while (!QUEUE_EMPTY(&hosts_)) {
+      QUEUE* hq = QUEUE_HEAD(&hosts_);
+      Host* host = ContainerOf(&Host::member, hq);
+      while (!QUEUE_EMPTY(&host->idle)) {
+        Entry* entry = ContainerOf(&Entry::member, QUEUE_HEAD(&host->idle));
+        RemoveEntry(host, entry);
+      }
+      QUEUE_REMOVE(hq);
+      delete host;
+    }
+  }
+
+
+  void TCPPool::Initialize(Environment* env) {
+    env_ = env;
+    uv_timer_init(env->event_loop(), &timer_);
+    // Idle connections must not keep the process alive.
+    uv_unref(reinterpret_cast<uv_handle_t*>(&timer_));
+    env->RegisterHandleCleanup(reinterpret_cast<uv_handle_t*>(&timer_),
+                               CloseTimer,
+                               this);
+  }
+
+
+  int TCPPool::Release(TCPWrap* wrap) {
+    assert(env_ != NULL);
+
+    if (wrap->GetHandle() == NULL)
+      return UV_EBADF;
+    if (max_per_host_ == 0)
+      return UV_ENOSPC;
+    // Only plain connections with nothing in flight can be reused.
+    if (!wrap->has_default_callbacks() || !wrap->is_idle())
+      return UV_EBUSY;
+
+    sockaddr_storage addr;
+    int len = sizeof(addr);
+    int err = uv_tcp_getpeername(wrap->UVHandle(),
+                                 reinterpret_cast<sockaddr*>(&addr),
+                                 &len);
+    if (err)
+      return err;
+
+    uv_read_stop(wrap->stream());
+    if (!IsAlive(wrap))
+      return UV_ECONNRESET;
+
+    Host* host = FindHost(reinterpret_cast<const sockaddr*>(&addr), true);
+    // Full, the connection idle the longest makes room.
+    if (host->count >= max_per_host_) {
+      Entry* oldest = ContainerOf(&Entry::member, QUEUE_PREV(&host->idle));
+      Evict(host, oldest);
+    }
+
+    Entry* entry = new Entry;
+    entry->idle_since = uv_now(env_->event_loop());
+    entry->object.Reset(env_->isolate(), wrap->object());
+    QUEUE_INSERT_HEAD(&host->idle, &entry->member);
+    host->count++;
+    idle_count_++;
+
+    uv_unref(wrap->GetHandle());
+    if (!uv_is_active(reinterpret_cast<uv_handle_t*>(&timer_)))
+      uv_timer_start(&timer_, OnTimer, kSweepIntervalMs, kSweepIntervalMs);
+
+    return 0;
+  }
+
+
+  Local<Object> TCPPool::Acquire(const sockaddr* addr) {
+    EscapableHandleScope scope(env_->isolate());
+
+    Host* host = FindHost(addr, false);
+    if (host == NULL) {
+      misses_++;
+      return Local<Object>();
+    }
+
+    Local<Object> object;
+    while (!QUEUE_EMPTY(&host->idle)) {
+      Entry* entry = ContainerOf(&Entry::member, QUEUE_HEAD(&host->idle));
+      TCPWrap* wrap = EntryWrap(entry);
+      if (wrap == NULL || !IsAlive(wrap)) {
+        Evict(host, entry);
+        continue;
+      }
+
+      object = PersistentToLocal(env_->isolate(), entry->object);
+      RemoveEntry(host, entry);
+      uv_ref(wrap->GetHandle());
+      break;
+    }
+
+    if (host->count == 0) {
+      QUEUE_REMOVE(&host->member);
+      delete host;
+    }
+
+    if (object.IsEmpty()) {
+      misses_++;
+      return Local<Object>();
+    }
+
+    hits_++;
+    return scope.Escape(object);
+  }
+
+
+  TCPPool::Host* TCPPool::FindHost(const sockaddr* addr, bool create) {
+    QUEUE* q;
+    QUEUE_FOREACH(q, &hosts_) {
+      Host* host = ContainerOf(&Host::member, q);
+      if (SameAddress(addr, reinterpret_cast<const sockaddr*>(&host->addr)))
+        return host;
+    }
+
+    if (!create)
+      return NULL;
+
+    Host* host = new Host;
+    QUEUE_INIT(&host->idle);
+    memset(&host->addr, 0, sizeof(host->addr));
+    memcpy(&host->addr,
+           addr,
+           addr->sa_family == AF_INET6 ? sizeof(sockaddr_in6) :
+                                         sizeof(sockaddr_in));
+    host->count = 0;
+    QUEUE_INSERT_TAIL(&hosts_, &host->member);
+    return host;
+  }
+
+
+  // NULL once the handle was closed from JS while it sat in the pool.
+  TCPWrap* TCPPool::EntryWrap(Entry* entry) {
+    Local<Object> object = PersistentToLocal(env_->isolate(), entry->object);
+    TCPWrap* wrap = Unwrap<TCPWrap>(object);
+    if (wrap == NULL || wrap->GetHandle() == NULL)
+      return NULL;
+    return wrap;
+  }
+
+
+  // An idle connection has nothing to say: EOF means the peer closed it,
+  // data means a stray response that would confuse the next user.
+  bool TCPPool::IsAlive(TCPWrap* wrap) {
+  #if !defined(_WIN32)
+    char c;
+    ssize_t r;
+    do {
+      r = recv(wrap->UVHandle()->io_watcher.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    } while (r == -1 && errno == EINTR);
+    return r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  #else
+    // No probe, the idle limit takes care of stale connections.
+    return true;
+  #endif
+  }
+
+
+  // Leaves an empty host in place, callers may still be walking it.
+  void TCPPool::RemoveEntry(Host* host, Entry* entry) {
+    QUEUE_REMOVE(&entry->member);
+    entry->object.Reset();
+    delete entry;
+    host->count--;
+    idle_count_--;
+  }
+
+
+  void TCPPool::Evict(Host* host, Entry* entry) {
+    TCPWrap* wrap = EntryWrap(entry);
+    RemoveEntry(host, entry);
+    if (wrap != NULL) {
+      wrap->CloseHandle();
+      evictions_++;
+    }
+  }
+
+
+  void TCPPool::Sweep() {
+    uint64_t now = uv_now(env_->event_loop());
+
+    QUEUE* hq = QUEUE_HEAD(&hosts_);
+    while (hq != &hosts_) {
+      Host* host = ContainerOf(&Host::member, hq);
+      hq = QUEUE_NEXT(hq);
+
+      QUEUE* q = QUEUE_HEAD(&host->idle);
+      while (q != &host->idle) {
+        Entry* entry = ContainerOf(&Entry::member, q);
+        q = QUEUE_NEXT(q);
+
+        TCPWrap* wrap = EntryWrap(entry);
+        if (wrap == NULL ||
+            now - entry->idle_since >= max_idle_ms_ ||
+            !IsAlive(wrap)) {
+          Evict(host, entry);
+        }
+      }
+
+      if (host->count == 0) {
+        QUEUE_REMOVE(&host->member);
+        delete host;
+      }
+    }
+
+    if (idle_count_ == 0)
+      uv_timer_stop(&timer_);
+  }
+
+
+  void TCPPool::OnTimer(uv_timer_t* handle) {
+    TCPPool* pool = ContainerOf(&TCPPool::timer_, handle);
+    Environment* env = pool->env_;
+    HandleScope handle_scope(env->isolate());
+    Context::Scope context_scope(env->context());
+    pool->Sweep();
+  }
+
+
+  void TCPPool::CloseTimer(Environment* env, uv_handle_t* handle, void* arg) {
+    uv_close(handle, OnTimerClose);
+  }
+
+
+  void TCPPool::OnTimerClose(uv_handle_t* handle) {
+    TCPPool* pool =
+        ContainerOf(&TCPPool::timer_, reinterpret_cast<uv_timer_t*>(handle));
+    pool->env_->FinishHandleCleanup(handle);
+  }
+}//End Node Namespace
@@ -0,0 +1,100 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#ifndef SRC_TCP_POOL_H_
+#define SRC_TCP_POOL_H_
+
+#include "cqueue.h"
+#include "v8.h"
+#include "uv.h"
+
+#include <stdint.h>
+
+namespace node {
+  class Environment;
+  class TCPWrap;
+
+  // Idle keep-alive connections, keyed by peer address.  poolRelease()
+  // parks a connected TCP handle here and poolAcquire(address, port) hands
+  // it back out instead of a new connect().  Idle sockets are unref'd and
+  // probed with a peeking read so peer-closed ones are evicted.
+  class TCPPool {
+   public:
+    TCPPool();
+    ~TCPPool();
+
+    void Initialize(Environment* env);
+
+    int Release(TCPWrap* wrap);
+    // Empty on a miss.
+    v8::Local<v8::Object> Acquire(const sockaddr* addr);
+
+    inline void set_max_idle_ms(uint64_t ms) { max_idle_ms_ = ms; }
+    inline void set_max_per_host(uint32_t count) { max_per_host_ = count; }
+
+    inline uint64_t hits() const { return hits_; }
+    inline uint64_t misses() const { return misses_; }
+    inline uint64_t evictions() const { return evictions_; }
+    inline uint32_t idle_count() const { return idle_count_; }
+
+   private:
+    static const uint64_t kDefaultMaxIdleMs = 30000;
+    static const uint32_t kDefaultMaxPerHost = 16;
+    static const uint64_t kSweepIntervalMs = 1000;
+
+    struct Host {
+      QUEUE member;  // In hosts_.
+      QUEUE idle;  // Entry::member, most recently released first.
+      sockaddr_storage addr;
+      uint32_t count;
+    };
+
+    struct Entry {
+      QUEUE member;
+      uint64_t idle_since;
+      v8::Persistent<v8::Object> object;
+    };
+
+    Host* FindHost(const sockaddr* addr, bool create);
+    TCPWrap* EntryWrap(Entry* entry);
+    bool IsAlive(TCPWrap* wrap);
+    void RemoveEntry(Host* host, Entry* entry);
+    void Evict(Host* host, Entry* entry);
+    void Sweep();
+
+    static void OnTimer(uv_timer_t* handle);
+    static void CloseTimer(Environment* env, uv_handle_t* handle, void* arg);
+    static void OnTimerClose(uv_handle_t* handle);
+
+    Environment* env_;
+    uv_timer_t timer_;
+    QUEUE hosts_;
+    uint64_t max_idle_ms_;
+    uint32_t max_per_host_;
+    uint32_t idle_count_;
+    uint64_t hits_;
+    uint64_t misses_;
+    uint64_t evictions_;
+  };
+}//End Node Namespace
+
+#endif //SRC_TCP_POOL_H_
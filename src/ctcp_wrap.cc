@@ -20,13 +20,24 @@
 // USE OR OTHER DEALINGS IN THE SOFTWARE
 
 #include "ctcp_wrap.h"
+#include "ctcp_dispatch.h"
+#include "ctcp_zerocopy.h"
 //#include "cenv.h"
 //#include "cenv-inl.h"
 //#include "cutil.h"
 //#include "cutil-inl.h"
 //#include "creq_wrap.h"
 
+#include <string.h>  // memcmp(), memcpy()
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 namespace node {
+  using v8::Array;
   using v8::Context;
   using v8::EscapableHandleScope;
   using v8::External;
@@ -64,6 +75,270 @@ namespace node {
   }
 
 
+  // RFC 8305 "Connection Attempt Delay".
+  static const uint64_t kConnectAttemptDelay = 250;
+
+
+  // connectMany(): races connects to a list of addresses as in RFC 8305.
+  // Attempts start `delay` ms apart or as soon as the previous one fails,
+  // the first to connect wins and the rest are closed.  Owns itself, it is
+  // deleted once the timer and every attempt have wound down.
+  class ConnectRace {
+   public:
+    static const unsigned int kMaxAddresses = 16;
+
+    ConnectRace(Environment* env, Local<Object> req_wrap_obj, uint64_t delay);
+
+    int AddAddress(const char* ip_address, int port);
+    // Nonzero when no attempt could be started, nothing is reported then.
+    int Start();
+    // Winds down a race that was never started.
+    void Abort();
+
+   private:
+    struct Attempt {
+      uv_connect_t req;
+      QUEUE member;
+      ConnectRace* race;
+      TCPWrap* wrap;
+      v8::Persistent<Object> object;
+    };
+
+    ~ConnectRace() {}
+
+    void Interleave();
+    int StartNext();
+    void DeleteAttempt(Attempt* attempt, bool close);
+    void Finish(int status, Attempt* winner);
+    void MaybeDelete();
+
+    static void AfterConnect(uv_connect_t* req, int status);
+    static void OnTimer(uv_timer_t* handle);
+    static void OnTimerClose(uv_handle_t* handle);
+
+    Environment* env_;
+    TCPConnectWrap* req_wrap_;
+    uv_timer_t timer_;
+    uint64_t delay_;
+    sockaddr_storage addresses_[kMaxAddresses];
+    unsigned int count_;
+    unsigned int next_;
+    QUEUE attempts_;  // In flight.
+    int last_error_;
+    bool done_;
+    bool timer_closed_;
+  };
+
+
+  ConnectRace::ConnectRace(Environment* env,
+                           Local<Object> req_wrap_obj,
+                           uint64_t delay)
+      : env_(env),
+        req_wrap_(new TCPConnectWrap(env, req_wrap_obj)),
+        delay_(delay),
+        count_(0),
+        next_(0),
+        last_error_(UV_EINVAL),
+        done_(false),
+        timer_closed_(false) {
+    // Completion goes through the request object, its uv_connect_t is
+    // not used.
+    req_wrap_->Dispatched();
+    QUEUE_INIT(&attempts_);
+    uv_timer_init(env->event_loop(), &timer_);
+  }
+
+
+  int ConnectRace::AddAddress(const char* ip_address, int port) {
+    if (count_ == kMaxAddresses)
+      return UV_E2BIG;
+
+    sockaddr_storage* addr = &addresses_[count_];
+    if (uv_ip4_addr(ip_address, port, reinterpret_cast<sockaddr_in*>(addr)) &&
+        uv_ip6_addr(ip_address, port, reinterpret_cast<sockaddr_in6*>(addr))) {
+      return UV_EINVAL;
+    }
+    count_++;
+    return 0;
+  }
+
+
+  int ConnectRace::Start() {
+    Interleave();
+
+    int err = StartNext();
+    if (err != 0)
+      Abort();
+    return err;
+  }
+
+
+  void ConnectRace::Abort() {
+    done_ = true;
+    delete req_wrap_;
+    req_wrap_ = NULL;
+    uv_close(reinterpret_cast<uv_handle_t*>(&timer_), OnTimerClose);
+  }
+
+
+  // Alternate address families, starting with the family of the first.
+  void ConnectRace::Interleave() {
+    sockaddr_storage sorted[kMaxAddresses];
+    bool used[kMaxAddresses] = { false };
+    int family = count_ > 0 ? addresses_[0].ss_family : AF_INET;
+
+    for (unsigned int n = 0; n < count_; n++) {
+      unsigned int pick = count_;
+      for (unsigned int i = 0; i < count_; i++) {
+        if (used[i])
+          continue;
+        if (pick == count_)
+          pick = i;  // First unused, if the wanted family ran out.
+        if (addresses_[i].ss_family == family) {
+          pick = i;
+          break;
+        }
+      }
+      used[pick] = true;
+      sorted[n] = addresses_[pick];
+      family = sorted[n].ss_family == AF_INET6 ? AF_INET : AF_INET6;
+    }
+
+    memcpy(addresses_, sorted, count_ * sizeof(sorted[0]));
+  }
+
+
+  // Starts the next address that gets past uv_tcp_connect(), returns the
+  // last error once none are left.
+  int ConnectRace::StartNext() {
+    while (next_ < count_) {
+      const sockaddr* addr =
+          reinterpret_cast<const sockaddr*>(&addresses_[next_++]);
+
+      Attempt* attempt = new Attempt;
+      attempt->race = this;
+      Local<Object> object = TCPWrap::Instantiate(env_, req_wrap_);
+      attempt->object.Reset(env_->isolate(), object);
+      attempt->wrap = Unwrap<TCPWrap>(object);
+      QUEUE_INSERT_TAIL(&attempts_, &attempt->member);
+
+      int err = uv_tcp_connect(&attempt->req,
+                               attempt->wrap->UVHandle(),
+                               addr,
+                               AfterConnect);
+      if (err == 0) {
+        if (next_ < count_)
+          uv_timer_start(&timer_, OnTimer, delay_, 0);
+        return 0;
+      }
+
+      last_error_ = err;
+      DeleteAttempt(attempt, true);
+    }
+
+    return last_error_;
+  }
+
+
+  void ConnectRace::DeleteAttempt(Attempt* attempt, bool close) {
+    QUEUE_REMOVE(&attempt->member);
+    if (close)
+      attempt->wrap->CloseHandle();
+    attempt->object.Reset();
+    delete attempt;
+  }
+
+
+  void ConnectRace::Finish(int status, Attempt* winner) {
+    done_ = true;
+
+    // Losers still connecting come back with UV_ECANCELED.
+    QUEUE* q;
+    QUEUE_FOREACH(q, &attempts_) {
+      Attempt* attempt = ContainerOf(&Attempt::member, q);
+      if (attempt != winner)
+        attempt->wrap->CloseHandle();
+    }
+
+    Local<Object> req_wrap_obj = req_wrap_->object();
+    Local<Value> argv[5] = {
+      Integer::New(env_->isolate(), status),
+      Undefined(env_->isolate()),
+      req_wrap_obj,
+      v8::True(env_->isolate()),
+      v8::True(env_->isolate())
+    };
+    if (winner != NULL) {
+      argv[1] = PersistentToLocal(env_->isolate(), winner->object);
+      DeleteAttempt(winner, false);
+    }
+
+    uv_close(reinterpret_cast<uv_handle_t*>(&timer_), OnTimerClose);
+
+    req_wrap_->MakeCallback(env_->oncomplete_string(), ARRAY_SIZE(argv), argv);
+    delete req_wrap_;
+    req_wrap_ = NULL;
+  }
+
+
+  void ConnectRace::MaybeDelete() {
+    if (done_ && timer_closed_ && QUEUE_EMPTY(&attempts_))
+      delete this;
+  }
+
+
+  void ConnectRace::AfterConnect(uv_connect_t* req, int status) {
+    Attempt* attempt = ContainerOf(&Attempt::req, req);
+    ConnectRace* race = attempt->race;
+    Environment* env = race->env_;
+
+    HandleScope handle_scope(env->isolate());
+    Context::Scope context_scope(env->context());
+
+    if (race->done_) {
+      race->DeleteAttempt(attempt, false);
+      race->MaybeDelete();
+      return;
+    }
+
+    if (status == 0) {
+      race->Finish(0, attempt);
+      race->MaybeDelete();
+      return;
+    }
+
+    // Don't wait out the delay once an attempt has failed.
+    race->last_error_ = status;
+    race->DeleteAttempt(attempt, true);
+    uv_timer_stop(&race->timer_);
+    if (race->StartNext() != 0 && QUEUE_EMPTY(&race->attempts_))
+      race->Finish(race->last_error_, NULL);
+    race->MaybeDelete();
+  }
+
+
+  void ConnectRace::OnTimer(uv_timer_t* handle) {
+    ConnectRace* race = ContainerOf(&ConnectRace::timer_, handle);
+    Environment* env = race->env_;
+
+    HandleScope handle_scope(env->isolate());
+    Context::Scope context_scope(env->context());
+
+    if (race->StartNext() != 0 && QUEUE_EMPTY(&race->attempts_)) {
+      race->Finish(race->last_error_, NULL);
+      race->MaybeDelete();
+    }
+  }
+
+
+  void ConnectRace::OnTimerClose(uv_handle_t* handle) {
+    ConnectRace* race =
+        ContainerOf(&ConnectRace::timer_, reinterpret_cast<uv_timer_t*>(handle));
+    race->timer_closed_ = true;
+    race->MaybeDelete();
+  }
+
+
   Local<Object> TCPWrap::Instantiate(Environment* env, AsyncWrap* parent) {
     EscapableHandleScope handle_scope(env->isolate());
     assert(env->tcp_constructor_template().IsEmpty() == false);
@@ -124,6 +399,20 @@ namespace node {
                               "writeBinaryString",
                               StreamWrap::WriteBinaryString);
     NODE_SET_PROTOTYPE_METHOD(t, "writev", StreamWrap::Writev);
+    NODE_SET_PROTOTYPE_METHOD(t, "cork", StreamWrap::Cork);
+    NODE_SET_PROTOTYPE_METHOD(t, "uncork", StreamWrap::Uncork);
+    NODE_SET_PROTOTYPE_METHOD(t, "sendFile", StreamWrap::SendFile);
+    NODE_SET_PROTOTYPE_METHOD(t, "pipeTo", StreamWrap::PipeTo);
+    NODE_SET_PROTOTYPE_METHOD(t, "setReadBuffer", StreamWrap::SetReadBuffer);
+    NODE_SET_PROTOTYPE_METHOD(t, "setStatsEnabled", StreamWrap::SetStatsEnabled);
+    NODE_SET_PROTOTYPE_METHOD(t, "getStats", StreamWrap::GetStats);
+    NODE_SET_PROTOTYPE_METHOD(t, "setWriteWatermarks",
+                              StreamWrap::SetWriteWatermarks);
+    NODE_SET_PROTOTYPE_METHOD(t, "setZeroCopy", SetZeroCopy);
+    NODE_SET_PROTOTYPE_METHOD(t, "dispatchTo", DispatchTo);
+    NODE_SET_PROTOTYPE_METHOD(t, "getDispatchStats", GetDispatchStats);
+    NODE_SET_PROTOTYPE_METHOD(t, "setDispatchMode", SetDispatchMode);
+    NODE_SET_PROTOTYPE_METHOD(t, "setAcceptBatch", StreamWrap::SetAcceptBatch);
 
     NODE_SET_PROTOTYPE_METHOD(t, "open", Open);
     NODE_SET_PROTOTYPE_METHOD(t, "bind", Bind);
@@ -135,6 +424,8 @@ namespace node {
     NODE_SET_PROTOTYPE_METHOD(t, "getpeername", GetPeerName);
     NODE_SET_PROTOTYPE_METHOD(t, "setNoDelay", SetNoDelay);
     NODE_SET_PROTOTYPE_METHOD(t, "setKeepAlive", SetKeepAlive);
+    NODE_SET_PROTOTYPE_METHOD(t, "poolRelease", PoolRelease);
+    NODE_SET_PROTOTYPE_METHOD(t, "getTCPInfo", GetTCPInfo);
 
   #ifdef _WIN32
     NODE_SET_PROTOTYPE_METHOD(t,
@@ -152,6 +443,31 @@ namespace node {
     cwt->SetClassName(FIXED_ONE_BYTE_STRING(env->isolate(), "TCPConnectWrap"));
     target->Set(FIXED_ONE_BYTE_STRING(env->isolate(), "TCPConnectWrap"),
                 cwt->GetFunction());
+
+    env->tcp_pool()->Initialize(env);
+    NODE_SET_METHOD(target, "poolAcquire", PoolAcquire);
+    NODE_SET_METHOD(target, "setPoolOptions", SetPoolOptions);
+    NODE_SET_METHOD(target, "getPoolStats", GetPoolStats);
+    NODE_SET_METHOD(target, "connectMany", ConnectMany);
+
+    // Sampling is off until setRTTSampler(), and never keeps the loop alive.
+    uv_timer_init(env->event_loop(), env->rtt_sampler_handle());
+    uv_unref(reinterpret_cast<uv_handle_t*>(env->rtt_sampler_handle()));
+    env->RegisterHandleCleanup(
+        reinterpret_cast<uv_handle_t*>(env->rtt_sampler_handle()),
+        CloseRTTSampler,
+        NULL);
+    NODE_SET_METHOD(target, "setRTTSampler", SetRTTSampler);
+    NODE_SET_METHOD(target, "getRTTHistogram", GetRTTHistogram);
+
+    // Field names of a getTCPInfo() snapshot, in order.
+    Local<Array> fields = Array::New(env->isolate(), TCPInfo::kFieldCount);
+  #define V(NAME, name)                                                       \
+    fields->Set(TCPInfo::INFO_##NAME,                                         \
+                FIXED_ONE_BYTE_STRING(env->isolate(), #name));
+    TCP_INFO_FIELDS(V)
+  #undef V
+    target->Set(FIXED_ONE_BYTE_STRING(env->isolate(), "tcpInfoFields"), fields);
   }
 
   uv_tcp_t* TCPWrap::UVHandle() {
@@ -182,7 +498,9 @@ namespace node {
                    object,
                    reinterpret_cast<uv_stream_t*>(&handle_),
                    AsyncWrap::PROVIDER_TCPWRAP,
-                   parent) {
+                   parent),
+        zerocopy_(NULL),
+        dispatcher_(NULL) {
     int r = uv_tcp_init(env->event_loop(), &handle_);
     assert(r == 0);  // How do we proxy this error up to javascript?
                      // Suggestion: uv_tcp_init() returns void.
@@ -191,6 +509,7 @@ namespace node {
 
   TCPWrap::~TCPWrap() {
   assert(persistent().IsEmpty());
+  delete dispatcher_;
 }
 
 
@@ -266,6 +585,94 @@ void TCPWrap::SetKeepAlive(const FunctionCallbackInfo<Value>& args) {
 }
 
 
+// setZeroCopy(threshold) sends writes of at least `threshold` bytes with
+// MSG_ZEROCOPY, 0 turns it off again. Only once the socket exists, i.e.
+// after bind, connect or accept.
+void TCPWrap::SetZeroCopy(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args.GetIsolate());
+  HandleScope scope(env->isolate());
+
+  TCPWrap* wrap = Unwrap<TCPWrap>(args.Holder());
+
+  if (!args[0]->IsUint32())
+    return env->ThrowTypeError("threshold must be an unsigned integer");
+  size_t threshold = args[0]->Uint32Value();
+
+  int err = 0;
+  if (wrap->zerocopy_ != NULL && wrap->callbacks() == wrap->zerocopy_) {
+    wrap->zerocopy_->set_threshold(threshold);
+  } else if (threshold != 0) {
+    // TLS and native pipes have their own write path.
+    if (!wrap->has_default_callbacks())
+      err = UV_ENOTSUP;
+    else
+      err = ZeroCopyCallbacks::Enable(wrap->stream());
+    if (err == 0) {
+      wrap->zerocopy_ = new ZeroCopyCallbacks(wrap, threshold);
+      wrap->OverrideCallbacks(wrap->zerocopy_, false);
+    }
+  }
+
+  args.GetReturnValue().Set(err);
+}
+
+
+// dispatchTo(pipe) adds an IPC pipe to the workers this listener passes its
+// connections to, see TCPDispatcher.
+void TCPWrap::DispatchTo(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args.GetIsolate());
+  HandleScope scope(env->isolate());
+
+  TCPWrap* wrap = Unwrap<TCPWrap>(args.Holder());
+
+  if (!args[0]->IsObject() ||
+      !env->pipe_constructor_template()->HasInstance(args[0])) {
+    return env->ThrowTypeError("pipe must be a Pipe");
+  }
+  StreamWrap* pipe = Unwrap<StreamWrap>(args[0].As<Object>());
+
+  if (wrap->dispatcher_ == NULL)
+    wrap->dispatcher_ = new TCPDispatcher();
+  args.GetReturnValue().Set(wrap->dispatcher_->AddPipe(pipe));
+}
+
+
+// setDispatchMode(leastLoaded): round-robin by default, or the worker with
+// the fewest unacknowledged connections.
+void TCPWrap::SetDispatchMode(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args.GetIsolate());
+  HandleScope scope(env->isolate());
+
+  TCPWrap* wrap = Unwrap<TCPWrap>(args.Holder());
+
+  if (wrap->dispatcher_ == NULL)
+    wrap->dispatcher_ = new TCPDispatcher();
+  wrap->dispatcher_->set_least_loaded(args[0]->IsTrue());
+}
+
+
+// getDispatchStats(): connections handed to workers, and those that failed
+// to go out and were reported through onconnection() instead.
+void TCPWrap::GetDispatchStats(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args.GetIsolate());
+  HandleScope scope(env->isolate());
+
+  TCPWrap* wrap = Unwrap<TCPWrap>(args.Holder());
+  TCPDispatcher* dispatcher = wrap->dispatcher_;
+
+  Local<Object> info = Object::New(env->isolate());
+  info->Set(env->dispatched_string(),
+            Number::New(env->isolate(),
+                        dispatcher != NULL ?
+                            static_cast<double>(dispatcher->dispatched()) : 0));
+  info->Set(env->failed_string(),
+            Number::New(env->isolate(),
+                        dispatcher != NULL ?
+                            static_cast<double>(dispatcher->failed()) : 0));
+  args.GetReturnValue().Set(info);
+}
+
+
 #ifdef _WIN32
 void TCPWrap::SetSimultaneousAccepts(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args.GetIsolate());
@@ -289,6 +696,204 @@ void TCPWrap::Open(const FunctionCallbackInfo<Value>& args) {
 }
 
 
+// poolRelease() parks a connected, idle handle in the environment's pool.
+// On success the handle belongs to the pool and JS must drop it.
+void TCPWrap::PoolRelease(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args.GetIsolate());
+  HandleScope scope(env->isolate());
+
+  TCPWrap* wrap = Unwrap<TCPWrap>(args.Holder());
+  args.GetReturnValue().Set(env->tcp_pool()->Release(wrap));
+}
+
+
+// poolAcquire(address, port) returns a pooled handle connected to the
+// peer, or undefined.
+void TCPWrap::PoolAcquire(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args.GetIsolate());
+  HandleScope scope(env->isolate());
+
+  if (!args[0]->IsString())
+    return env->ThrowTypeError("address must be a string");
+  if (!args[1]->IsUint32())
+    return env->ThrowTypeError("port must be an unsigned integer");
+
+  node::Utf8Value ip_address(args[0]);
+  int port = args[1]->Uint32Value();
+
+  sockaddr_storage addr;
+  if (uv_ip4_addr(*ip_address, port, reinterpret_cast<sockaddr_in*>(&addr)) &&
+      uv_ip6_addr(*ip_address, port, reinterpret_cast<sockaddr_in6*>(&addr))) {
+    return;
+  }
+
+  Local<Object> object =
+      env->tcp_pool()->Acquire(reinterpret_cast<const sockaddr*>(&addr));
+  if (!object.IsEmpty())
+    args.GetReturnValue().Set(object);
+}
+
+
+// setPoolOptions(maxIdleMs, maxPerHost), zero for maxPerHost stops pooling.
+void TCPWrap::SetPoolOptions(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args.GetIsolate());
+  HandleScope scope(env->isolate());
+
+  if (!args[0]->IsUint32() || !args[1]->IsUint32())
+    return env->ThrowTypeError("pool options must be unsigned integers");
+
+  env->tcp_pool()->set_max_idle_ms(args[0]->Uint32Value());
+  env->tcp_pool()->set_max_per_host(args[1]->Uint32Value());
+}
+
+
+void TCPWrap::GetPoolStats(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args.GetIsolate());
+  HandleScope scope(env->isolate());
+
+  TCPPool* pool = env->tcp_pool();
+  Local<Object> info = Object::New(env->isolate());
+  info->Set(env->hits_string(),
+            Number::New(env->isolate(), static_cast<double>(pool->hits())));
+  info->Set(env->misses_string(),
+            Number::New(env->isolate(), static_cast<double>(pool->misses())));
+  info->Set(env->evictions_string(),
+            Number::New(env->isolate(),
+                        static_cast<double>(pool->evictions())));
+  info->Set(env->idle_string(),
+            Integer::NewFromUnsigned(env->isolate(), pool->idle_count()));
+  args.GetReturnValue().Set(info);
+}
+
+
+static double* Float64ArrayData(Local<Value> value, size_t min_length) {
+  if (!value->IsObject())
+    return NULL;
+  Local<Object> obj = value.As<Object>();
+  if (!obj->HasIndexedPropertiesInExternalArrayData() ||
+      obj->GetIndexedPropertiesExternalArrayDataType() !=
+          v8::kExternalFloat64Array ||
+      static_cast<size_t>(obj->GetIndexedPropertiesExternalArrayDataLength()) <
+          min_length) {
+    return NULL;
+  }
+  return static_cast<double*>(obj->GetIndexedPropertiesExternalArrayData());
+}
+
+
+// getTCPInfo(array) fills a Float64Array laid out as tcpInfoFields.
+void TCPWrap::GetTCPInfo(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args.GetIsolate());
+  HandleScope scope(env->isolate());
+
+  TCPWrap* wrap = Unwrap<TCPWrap>(args.Holder());
+
+  double* fields = Float64ArrayData(args[0], TCPInfo::kFieldCount);
+  if (fields == NULL)
+    return env->ThrowTypeError("argument must be a large enough Float64Array");
+
+  args.GetReturnValue().Set(TCPInfo::Read(&wrap->handle_, fields));
+}
+
+
+// setRTTSampler(intervalMs) records the RTT of every open TCP handle into
+// the environment's histogram each interval, zero stops it.
+void TCPWrap::SetRTTSampler(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args.GetIsolate());
+  HandleScope scope(env->isolate());
+
+  if (!args[0]->IsUint32())
+    return env->ThrowTypeError("interval must be an unsigned integer");
+
+  uint64_t interval = args[0]->Uint32Value();
+  if (interval == 0)
+    uv_timer_stop(env->rtt_sampler_handle());
+  else
+    uv_timer_start(env->rtt_sampler_handle(), OnRTTSample, interval, interval);
+}
+
+
+// getRTTHistogram(array[, reset]) copies the RTTHistogram buckets.
+void TCPWrap::GetRTTHistogram(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args.GetIsolate());
+  HandleScope scope(env->isolate());
+
+  double* buckets = Float64ArrayData(args[0], RTTHistogram::kBucketCount);
+  if (buckets == NULL)
+    return env->ThrowTypeError("argument must be a large enough Float64Array");
+
+  RTTHistogram* histogram = env->rtt_histogram();
+  memcpy(buckets, histogram->buckets, sizeof(histogram->buckets));
+  if (args[1]->IsTrue())
+    histogram->Reset();
+}
+
+
+void TCPWrap::OnRTTSample(uv_timer_t* handle) {
+  Environment* env = Environment::from_rtt_sampler_handle(handle);
+  RTTHistogram* histogram = env->rtt_histogram();
+  double fields[TCPInfo::kFieldCount];
+
+  QUEUE* q;
+  QUEUE_FOREACH(q, env->handle_wrap_queue()) {
+    HandleWrap* wrap = ContainerOf(&HandleWrap::handle_wrap_queue_, q);
+    uv_handle_t* h = wrap->GetHandle();
+    if (h == NULL || h->type != UV_TCP)
+      continue;
+    // Listeners and sockets without a measurement yet report zero.
+    if (TCPInfo::Read(reinterpret_cast<uv_tcp_t*>(h), fields) == 0 &&
+        fields[TCPInfo::INFO_RTT] > 0) {
+      histogram->Record(static_cast<unsigned int>(fields[TCPInfo::INFO_RTT]));
+    }
+  }
+}
+
+
+void TCPWrap::CloseRTTSampler(Environment* env,
+                              uv_handle_t* handle,
+                              void* arg) {
+  uv_close(handle, OnRTTSamplerClose);
+}
+
+
+void TCPWrap::OnRTTSamplerClose(uv_handle_t* handle) {
+  Environment* env = Environment::from_rtt_sampler_handle(
+      reinterpret_cast<uv_timer_t*>(handle));
+  env->FinishHandleCleanup(handle);
+}
+
+
+// bind(address, port, reusePort): with reusePort the socket is created here
+// so SO_REUSEPORT is on before uv_tcp_bind() binds it.  Listeners bound
+// this way on other loops share the port and the kernel spreads incoming
+// connections across them.
+static int OpenReusePort(uv_tcp_t* handle, int family) {
+#if !defined(_WIN32) && defined(SO_REUSEPORT)
+  if (handle->io_watcher.fd != -1)
+    return UV_EBUSY;
+
+  int fd = socket(family, SOCK_STREAM, 0);
+  if (fd == -1)
+    return -errno;
+
+  int on = 1;
+  int err = 0;
+  if (fcntl(fd, F_SETFD, FD_CLOEXEC) ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))) {
+    err = -errno;
+  } else {
+    err = uv_tcp_open(handle, fd);
+  }
+
+  if (err != 0)
+    close(fd);
+  return err;
+#else
+  return UV_ENOTSUP;
+#endif
+}
+
+
 void TCPWrap::Bind(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args.GetIsolate());
   HandleScope scope(env->isolate());
@@ -300,6 +905,8 @@ void TCPWrap::Bind(const FunctionCallbackInfo<Value>& args) {
 
   sockaddr_in addr;
   int err = uv_ip4_addr(*ip_address, port, &addr);
+  if (err == 0 && args[2]->IsTrue())
+    err = OpenReusePort(&wrap->handle_, AF_INET);
   if (err == 0) {
     err = uv_tcp_bind(&wrap->handle_,
                       reinterpret_cast<const sockaddr*>(&addr),
@@ -321,6 +928,8 @@ void TCPWrap::Bind6(const FunctionCallbackInfo<Value>& args) {
 
   sockaddr_in6 addr;
   int err = uv_ip6_addr(*ip6_address, port, &addr);
+  if (err == 0 && args[2]->IsTrue())
+    err = OpenReusePort(&wrap->handle_, AF_INET6);
   if (err == 0) {
     err = uv_tcp_bind(&wrap->handle_,
                       reinterpret_cast<const sockaddr*>(&addr),
@@ -350,6 +959,15 @@ void TCPWrap::OnConnection(uv_stream_t* handle, int status) {
   assert(&tcp_wrap->handle_ == reinterpret_cast<uv_tcp_t*>(handle));
   Environment* env = tcp_wrap->env();
 
+  // Straight to a worker, JS only hears about errors and about
+  // connections no worker could take.
+  int fd = -1;
+  if (status == 0 &&
+      tcp_wrap->dispatcher_ != NULL &&
+      tcp_wrap->dispatcher_->Dispatch(handle, &fd)) {
+    return;
+  }
+
   HandleScope handle_scope(env->isolate());
   Context::Scope context_scope(env->context());
 
@@ -370,11 +988,27 @@ void TCPWrap::OnConnection(uv_stream_t* handle, int status) {
     // Unwrap the client javascript object.
     TCPWrap* wrap = Unwrap<TCPWrap>(client_obj);
     uv_stream_t* client_handle = reinterpret_cast<uv_stream_t*>(&wrap->handle_);
-    if (uv_accept(handle, client_handle))
+#if !defined(_WIN32)
+    if (fd != -1) {
+      // Already accepted for a worker that couldn't be reached.
+      if (uv_tcp_open(&wrap->handle_, fd)) {
+        close(fd);
+        return;
+      }
+    } else
+#endif
+    if (uv_accept(handle, client_handle)) {
+      return;
+    }
+
+    if (tcp_wrap->QueueAccepted(client_obj))
       return;
 
     // Successful accept. Call the onconnection callback in JavaScript land.
     argv[1] = client_obj;
+  } else {
+    // Keep the order, connections accepted before the error go first.
+    tcp_wrap->FlushAccepted();
   }
 
   tcp_wrap->MakeCallback(env->onconnection_string(), ARRAY_SIZE(argv), argv);
@@ -473,6 +1107,42 @@ void TCPWrap::Connect(const FunctionCallbackInfo<Value>& args) {
   }
 
 
+  // connectMany(req, addresses, port[, delay]) races connects to the
+  // resolved `addresses`, see ConnectRace.  req.oncomplete gets the winning
+  // handle in place of the handle connect() reports.
+  void TCPWrap::ConnectMany(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope handle_scope(env->isolate());
+
+    if (!args[0]->IsObject() || !args[1]->IsArray() || !args[2]->IsUint32())
+      return env->ThrowTypeError("bad arguments to connectMany");
+
+    Local<Object> req_wrap_obj = args[0].As<Object>();
+    Local<Array> addresses = args[1].As<Array>();
+    int port = args[2]->Uint32Value();
+    uint64_t delay = args[3]->IsUint32() ? args[3]->Uint32Value() :
+                                           kConnectAttemptDelay;
+
+    if (addresses->Length() == 0 ||
+        addresses->Length() > ConnectRace::kMaxAddresses) {
+      return env->ThrowRangeError("between 1 and 16 addresses are required");
+    }
+
+    ConnectRace* race = new ConnectRace(env, req_wrap_obj, delay);
+    int err = 0;
+    for (uint32_t i = 0; i < addresses->Length() && err == 0; i++) {
+      node::Utf8Value ip_address(addresses->Get(i));
+      err = race->AddAddress(*ip_address, port);
+    }
+    if (err == 0)
+      err = race->Start();
+    else
+      race->Abort();
+
+    args.GetReturnValue().Set(err);
+  }
+
+
   // also used by udp_wrap.cc
   Local<Object> AddressToJS(Environment* env,
                             const sockaddr* addr,
@@ -511,6 +1181,30 @@ void TCPWrap::Connect(const FunctionCallbackInfo<Value>& args) {
 
     return scope.Escape(info);
   }
+
+
+  // Also used by ctcp_pool.cc and cudp_wrap.cc.
+  bool SameAddress(const sockaddr* a, const sockaddr* b) {
+    if (a->sa_family != b->sa_family)
+      return false;
+
+    if (a->sa_family == AF_INET) {
+      const sockaddr_in* a4 = reinterpret_cast<const sockaddr_in*>(a);
+      const sockaddr_in* b4 = reinterpret_cast<const sockaddr_in*>(b);
+      return a4->sin_port == b4->sin_port &&
+             memcmp(&a4->sin_addr, &b4->sin_addr, sizeof(a4->sin_addr)) == 0;
+    }
+
+    if (a->sa_family == AF_INET6) {
+      const sockaddr_in6* a6 = reinterpret_cast<const sockaddr_in6*>(a);
+      const sockaddr_in6* b6 = reinterpret_cast<const sockaddr_in6*>(b);
+      return a6->sin6_port == b6->sin6_port &&
+             a6->sin6_scope_id == b6->sin6_scope_id &&
+             memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+    }
+
+    return false;
+  }
 } //End Node Namespace
 
 //NODE_MODULE_CONTEXT_AWARE_BUILTIN(tcp_wrap, node::TCPWrap::Initialize)
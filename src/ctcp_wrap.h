@@ -27,6 +27,9 @@
 #include "cstream_wrap.h"
 
 namespace node {
+  class ZeroCopyCallbacks;
+  class TCPDispatcher;
+
   class TCPWrap : public StreamWrap {
    public:
     static v8::Local<v8::Object> Instantiate(Environment* env, AsyncWrap* parent);
@@ -48,7 +51,20 @@ namespace node {
     static void Listen(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void Connect(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void Connect6(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void ConnectMany(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void Open(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void SetZeroCopy(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void DispatchTo(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void SetDispatchMode(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void GetDispatchStats(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void PoolRelease(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void PoolAcquire(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void SetPoolOptions(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void GetPoolStats(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void GetTCPInfo(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void SetRTTSampler(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void GetRTTHistogram(
+        const v8::FunctionCallbackInfo<v8::Value>& args);
 
   #ifdef _WIN32
     static void SetSimultaneousAccepts(const v8::FunctionCallbackInfo<v8::Value>& args);
@@ -56,8 +72,13 @@ namespace node {
 
     static void OnConnection(uv_stream_t* handle, int status);
     static void AfterConnect(uv_connect_t* req, int status);
+    static void OnRTTSample(uv_timer_t* handle);
+    static void CloseRTTSampler(Environment* env, uv_handle_t* handle, void* arg);
+    static void OnRTTSamplerClose(uv_handle_t* handle);
 
     uv_tcp_t handle_;
+    ZeroCopyCallbacks* zerocopy_;  // Installed by setZeroCopy().
+    TCPDispatcher* dispatcher_;  // Created by dispatchTo().
   };
 }//End Node Namespace
 
@@ -0,0 +1,416 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#include "ctcp_zerocopy.h"
+#include "cnode_internal.h"
+#include "cnode_counters.h"
+#include "cenv.h"
+#include "cenv-inl.h"
+#include "cutil.h"
+#include "cutil-inl.h"
+
+#include <assert.h>
+#include <string.h>  // memset(), memcpy()
+#if defined(__linux__)
+#include <errno.h>
+#include <unistd.h>  // dup(), close()
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+
+// Not in older headers, the kernel side has been there since 4.14.
+#ifndef SO_ZEROCOPY
+# define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+# define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+# define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#endif  // defined(__linux__)
+
+namespace node {
+  struct ZeroCopyCallbacks::Pending {
+    uv_write_t req;  // uv_write() of what the socket didn't take.
+    QUEUE member;  // Member of ZeroCopyCallbacks::pending_.
+    ZeroCopyCallbacks* owner;  // NULL once the callbacks are gone.
+    WriteWrap* w;
+    uv_write_cb cb;
+    uint32_t last_id;  // Last zero-copy send of this write.
+    bool write_done;  // The uv_write() of the remainder, if any, is done.
+    int status;
+  };
+
+  // Polls a dup() of the socket, libuv allows only one watcher per fd. The
+  // kernel flags an error condition while the error queue holds
+  // notifications, so the poll fires exactly when there is something to
+  // reap and the loop can sleep otherwise.
+  struct ZeroCopyCallbacks::ErrorWatch {
+    uv_poll_t handle;
+    ZeroCopyCallbacks* owner;  // NULL once the callbacks are gone.
+    int fd;  // Closed with the handle.
+  };
+
+  static const size_t kMaxIovecs = 1024;  // IOV_MAX on Linux.
+
+  static inline void SkipEmpty(uv_buf_t** bufs, size_t* count) {
+    while (*count > 0 && (*bufs)[0].len == 0) {
+      (*bufs)++;
+      (*count)--;
+    }
+  }
+
+
+  ZeroCopyCallbacks::ZeroCopyCallbacks(StreamWrap* wrap, size_t threshold)
+      : StreamWrapCallbacks(wrap),
+        threshold_(threshold),
+        next_id_(0),
+        completed_(0),
+        watch_(NULL) {
+    QUEUE_INIT(&pending_);
+  }
+
+
+  ZeroCopyCallbacks::~ZeroCopyCallbacks() {
+    if (watch_ != NULL) {
+      watch_->owner = NULL;
+      uv_close(reinterpret_cast<uv_handle_t*>(&watch_->handle), OnWatchClose);
+      watch_ = NULL;
+    }
+
+    // Writes libuv still holds finish from OnWriteDone() on their own.
+    // Those only waiting for the kernel complete now if the stream lives on
+    // under other callbacks, or are dropped with it like ~StreamWrap does
+    // with corked ones.
+    bool alive = wrap()->GetHandle() != NULL;
+    RequestPool* pool = wrap()->env()->request_pool();
+    while (!QUEUE_EMPTY(&pending_)) {
+      QUEUE* q = QUEUE_HEAD(&pending_);
+      QUEUE_REMOVE(q);
+      QUEUE_INIT(q);
+      Pending* pending = ContainerOf(&Pending::member, q);
+      if (!pending->write_done) {
+        pending->owner = NULL;
+        continue;
+      }
+
+      WriteWrap* w = pending->w;
+      uv_write_cb cb = pending->cb;
+      int status = pending->status;
+      pool->Free(reinterpret_cast<char*>(pending));
+      if (alive) {
+        cb(&w->req_, status);
+      } else {
+        w->~WriteWrap();
+        pool->Free(reinterpret_cast<char*>(w));
+      }
+    }
+  }
+
+
+  int ZeroCopyCallbacks::Enable(uv_stream_t* stream) {
+  #if defined(__linux__)
+    int fd = stream->io_watcher.fd;
+    if (fd == -1)
+      return UV_EBADF;  // Not bound or connected yet.
+    int on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)))
+      return -errno;
+    return 0;
+  #else
+    return UV_ENOSYS;
+  #endif
+  }
+
+
+  bool ZeroCopyCallbacks::UseZeroCopy(uv_buf_t* bufs, size_t count) const {
+    if (threshold_ == 0)
+      return false;
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++)
+      bytes += bufs[i].len;
+    return bytes >= threshold_;
+  }
+
+
+  int ZeroCopyCallbacks::TryWrite(uv_buf_t** bufs, size_t* count) {
+    // Large writes stay asynchronous so the Buffer is kept until the
+    // kernel lets go of its pages, DoWrite() does the sending.
+    if (UseZeroCopy(*bufs, *count))
+      return 0;
+    return StreamWrapCallbacks::TryWrite(bufs, count);
+  }
+
+
+  int ZeroCopyCallbacks::DoWrite(WriteWrap* w,
+                                 uv_buf_t* bufs,
+                                 size_t count,
+                                 uv_stream_t* send_handle,
+                                 uv_write_cb cb) {
+  #if defined(__linux__)
+    uv_stream_t* stream = wrap()->stream();
+
+    // Anything already queued in libuv has to go out first.
+    if (send_handle != NULL ||
+        stream->write_queue_size != 0 ||
+        !UseZeroCopy(bufs, count)) {
+      return StreamWrapCallbacks::DoWrite(w, bufs, count, send_handle, cb);
+    }
+
+    uint32_t first_id = next_id_;
+    size_t bytes = 0;
+    int err = 0;
+
+    // Empty buffers would have sendmsg() return 0 without taking an id.
+    SkipEmpty(&bufs, &count);
+
+    while (count > 0) {
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = reinterpret_cast<struct iovec*>(bufs);
+      msg.msg_iovlen = count > kMaxIovecs ? kMaxIovecs : count;
+
+      ssize_t n = sendmsg(stream->io_watcher.fd, &msg, MSG_ZEROCOPY);
+      if (n == -1) {
+        if (errno == EINTR)
+          continue;
+        // A full socket buffer or optmem limit, the rest goes through libuv.
+        if (errno != EAGAIN && errno != ENOBUFS)
+          err = -errno;
+        break;
+      }
+      if (n == 0)
+        break;
+
+      next_id_++;
+      bytes += n;
+
+      // Skip what was sent.
+      size_t written = n;
+      while (written > 0) {
+        if (bufs[0].len > written) {
+          bufs[0].base += written;
+          bufs[0].len -= written;
+          written = 0;
+        } else {
+          written -= bufs[0].len;
+          bufs++;
+          count--;
+        }
+      }
+      SkipEmpty(&bufs, &count);
+    }
+
+    if (next_id_ == first_id) {
+      if (err)
+        return err;
+      return StreamWrapCallbacks::DoWrite(w, bufs, count, NULL, cb);
+    }
+
+    NODE_COUNT_NET_BYTES_SENT(bytes);
+
+    Environment* env = wrap()->env();
+    Pending* pending = reinterpret_cast<Pending*>(
+        env->request_pool()->Allocate(sizeof(Pending)));
+    pending->owner = this;
+    pending->w = w;
+    pending->cb = cb;
+    pending->last_id = next_id_ - 1;
+    pending->write_done = true;
+    pending->status = err;
+
+    if (err == 0 && count > 0) {
+      err = uv_write(&pending->req, stream, bufs, count, OnWriteDone);
+      if (err == 0) {
+        pending->write_done = false;
+        size_t rest = 0;
+        for (size_t i = 0; i < count; i++)
+          rest += bufs[i].len;
+        NODE_COUNT_NET_BYTES_SENT(rest);
+      } else {
+        pending->status = err;
+      }
+    }
+    QUEUE_INSERT_TAIL(&pending_, &pending->member);
+
+    Reap();
+    Watch();
+    wrap()->UpdateWriteQueueSize();
+
+    // Part of the data is already out, errors are reported on completion.
+    return 0;
+  #else
+    return StreamWrapCallbacks::DoWrite(w, bufs, count, send_handle, cb);
+  #endif
+  }
+
+
+  void ZeroCopyCallbacks::OnWriteDone(uv_write_t* req, int status) {
+    Pending* pending = ContainerOf(&Pending::req, req);
+    ZeroCopyCallbacks* callbacks = pending->owner;
+
+    pending->write_done = true;
+    if (pending->status == 0)
+      pending->status = status;
+
+    // The callbacks were replaced or destroyed meanwhile, nobody reaps the
+    // kernel's notifications anymore.
+    if (callbacks == NULL) {
+      WriteWrap* w = pending->w;
+      uv_write_cb cb = pending->cb;
+      status = pending->status;
+      w->env()->request_pool()->Free(reinterpret_cast<char*>(pending));
+      cb(&w->req_, status);
+      return;
+    }
+
+    callbacks->Reap();
+    callbacks->Complete();
+  }
+
+
+  // Counts the sends the kernel has released. Each notification covers a
+  // range of ids, TCP reports them in order. Returns whether the error
+  // queue held anything.
+  bool ZeroCopyCallbacks::Reap() {
+    bool reaped = false;
+  #if defined(__linux__)
+    int fd = wrap()->stream()->io_watcher.fd;
+    if (fd == -1)
+      return false;
+
+    char control[128];
+    for (;;) {
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+
+      if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+        if (errno == EINTR)
+          continue;
+        break;
+      }
+      reaped = true;
+
+      struct cmsghdr* cm;
+      for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+            !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+          continue;
+        }
+
+        struct sock_extended_err serr;
+        memcpy(&serr, CMSG_DATA(cm), sizeof(serr));
+        if (serr.ee_errno != 0 || serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+          continue;
+
+        completed_ += serr.ee_data - serr.ee_info + 1;
+      }
+    }
+  #endif
+    return reaped;
+  }
+
+
+  // Finishes writes in order, for as long as both their libuv part is done
+  // and the kernel has released their pages.
+  void ZeroCopyCallbacks::Complete() {
+    while (!QUEUE_EMPTY(&pending_)) {
+      QUEUE* q = QUEUE_HEAD(&pending_);
+      Pending* pending = ContainerOf(&Pending::member, q);
+      if (!pending->write_done ||
+          static_cast<int32_t>(completed_ - pending->last_id) <= 0) {
+        break;
+      }
+
+      QUEUE_REMOVE(q);
+      WriteWrap* w = pending->w;
+      uv_write_cb cb = pending->cb;
+      int status = pending->status;
+      wrap()->env()->request_pool()->Free(reinterpret_cast<char*>(pending));
+
+      cb(&w->req_, status);
+    }
+
+    if (QUEUE_EMPTY(&pending_) && watch_ != NULL)
+      uv_poll_stop(&watch_->handle);
+  }
+
+
+  // Waits for the kernel's notifications while writes are pending. Without
+  // a watch they are still reaped whenever a write starts or finishes.
+  void ZeroCopyCallbacks::Watch() {
+  #if defined(__linux__)
+    if (watch_ == NULL) {
+      int fd = dup(wrap()->stream()->io_watcher.fd);
+      if (fd == -1)
+        return;
+      ErrorWatch* watch = new ErrorWatch;
+      watch->owner = this;
+      watch->fd = fd;
+      if (uv_poll_init(wrap()->env()->event_loop(), &watch->handle, fd)) {
+        close(fd);
+        delete watch;
+        return;
+      }
+      watch_ = watch;
+    }
+
+    if (!uv_is_active(reinterpret_cast<uv_handle_t*>(&watch_->handle))) {
+      // Error conditions are always reported, priority data is about as
+      // rare as it gets on TCP.
+      uv_poll_start(&watch_->handle, UV_PRIORITIZED, OnErrorReady);
+    }
+  #endif
+  }
+
+
+  void ZeroCopyCallbacks::OnErrorReady(uv_poll_t* handle,
+                                       int status,
+                                       int events) {
+    ErrorWatch* watch = ContainerOf(&ErrorWatch::handle, handle);
+    ZeroCopyCallbacks* callbacks = watch->owner;
+
+    // libuv stops the poll when it reports the error condition. Only rearm
+    // it when the queue had something, a socket error, hangup or unread
+    // urgent data would otherwise keep firing. The stream deals with those
+    // itself.
+    uv_poll_stop(handle);
+    bool reaped = callbacks->Reap();
+    callbacks->Complete();
+    if (reaped && !QUEUE_EMPTY(&callbacks->pending_))
+      callbacks->Watch();
+  }
+
+
+  void ZeroCopyCallbacks::OnWatchClose(uv_handle_t* handle) {
+    ErrorWatch* watch =
+        ContainerOf(&ErrorWatch::handle, reinterpret_cast<uv_poll_t*>(handle));
+  #if defined(__linux__)
+    close(watch->fd);
+  #endif
+    delete watch;
+  }
+
+}//End Node Namespace
@@ -0,0 +1,83 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+#ifndef SRC_TCP_ZEROCOPY_H_
+#define SRC_TCP_ZEROCOPY_H_
+
+#include "cstream_wrap.h"
+#include "cqueue.h"
+
+#include "uv.h"
+#include <stdint.h>
+
+namespace node {
+  // MSG_ZEROCOPY sends for large writes on a TCP stream. Writes of at
+  // least `threshold` bytes are handed to sendmsg() with MSG_ZEROCOPY, the
+  // kernel then references the Buffer's pages instead of copying them, and
+  // whatever the socket doesn't take right away goes through uv_write() as
+  // usual. Such a write only completes once the kernel has released the
+  // pages, which it reports on the socket's error queue; the queue is
+  // drained after each write and whenever polling the socket shows an
+  // error condition.
+  class ZeroCopyCallbacks : public StreamWrapCallbacks {
+   public:
+    ZeroCopyCallbacks(StreamWrap* wrap, size_t threshold);
+    ~ZeroCopyCallbacks();
+
+    // SO_ZEROCOPY on the socket, fails on kernels without support.
+    static int Enable(uv_stream_t* stream);
+
+    inline void set_threshold(size_t threshold) {
+      threshold_ = threshold;
+    }
+
+    int TryWrite(uv_buf_t** bufs, size_t* count);
+    int DoWrite(WriteWrap* w,
+                uv_buf_t* bufs,
+                size_t count,
+                uv_stream_t* send_handle,
+                uv_write_cb cb);
+
+    // Defined in ctcp_zerocopy.cc.
+    struct Pending;
+    struct ErrorWatch;
+
+   private:
+    bool UseZeroCopy(uv_buf_t* bufs, size_t count) const;
+    bool Reap();
+    void Complete();
+    void Watch();
+
+    static void OnWriteDone(uv_write_t* req, int status);
+    static void OnErrorReady(uv_poll_t* handle, int status, int events);
+    static void OnWatchClose(uv_handle_t* handle);
+
+    size_t threshold_;
+    uint32_t next_id_;  // Id the kernel gives the next zero-copy send.
+    uint32_t completed_;  // Number of sends the kernel has released.
+    QUEUE pending_;  // Pending writes, in submission order.
+    ErrorWatch* watch_;  // Created on the first zero-copy send.
+  };
+
+}//End Node Namespace
+
+#endif //SRC_TCP_ZEROCOPY_H_
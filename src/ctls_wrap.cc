@@ -20,6 +20,7 @@
 // USE OR OTHER DEALINGS IN THE SOFTWARE
 #include "ctls_wrap.h"
 #include "cnode_crypto_bio.h"
+#include "cnode_crypto_ktls.h"
 #include "cnode_wrap.h"
 #include "cnode_buffer.h"
 #include "cnode_counters.h"
@@ -27,6 +28,12 @@
 
 #include "v8.h"
 #include "uv.h"
+
+#include <limits.h>  // INT_MAX
+#if defined(__linux__)
+#include <errno.h>
+#include <unistd.h>  // dup(), close()
+#endif
 namespace node {
   using crypto::SSLWrap;
   using crypto::SecureContext;
@@ -42,6 +49,7 @@ namespace node {
   using v8::Integer;
   using v8::Local;
   using v8::Null;
+  using v8::Number;
   using v8::Object;
   using v8::String;
   using v8::Value;
@@ -58,16 +66,30 @@ namespace node {
         enc_in_(NULL),
         enc_out_(NULL),
         clear_in_(NULL),
+        held_in_(NULL),
         write_size_(0),
         started_(false),
         established_(false),
         shutdown_(false),
         error_(NULL),
         cycle_depth_(0),
-        eof_(false) {
+        eof_(false),
+        async_handshake_(false),
+        handshake_work_(NULL),
+        held_nread_(0),
+        ktls_wanted_(false),
+        ktls_tx_(false),
+        ktls_rx_(false),
+        close_notify_req_(NULL),
+        close_notify_cb_(NULL),
+        close_notify_watch_(NULL) {
     node::Wrap(object(), this);
     MakeWeak(this);
 
+  #ifdef SSL_CTRL_SET_TLSEXT_SERVERNAME_CB
+    offload_sni_ = NULL;
+  #endif  // SSL_CTRL_SET_TLSEXT_SERVERNAME_CB
+
     // Initialize queue for clearIn writes
     QUEUE_INIT(&write_item_queue_);
     QUEUE_INIT(&pending_write_items_);
@@ -81,10 +103,44 @@ namespace node {
 
 
   TLSCallbacks::~TLSCallbacks() {
+    if (handshake_work_ != NULL) {
+      // The worker still owns ssl_ and the BIOs, wait for it unless the
+      // step never started
+      uv_req_t* req = reinterpret_cast<uv_req_t*>(&handshake_work_->req_);
+      if (uv_cancel(req) != 0)
+        uv_sem_wait(&handshake_work_->done_);
+      handshake_work_->callbacks_ = NULL;
+      handshake_work_ = NULL;
+      ReleaseStepContexts();
+    }
+
+    if (close_notify_watch_ != NULL) {
+      close_notify_watch_->owner = NULL;
+      uv_close(reinterpret_cast<uv_handle_t*>(&close_notify_watch_->handle),
+               OnCloseNotifyWatchClose);
+      close_notify_watch_ = NULL;
+    }
+
+    // A shutdown still waiting for the close_notify fails if the stream
+    // lives on under other callbacks, or is dropped with it
+    if (close_notify_req_ != NULL) {
+      ShutdownWrap* req_wrap = close_notify_req_;
+      close_notify_req_ = NULL;
+      if (wrap()->GetHandle() != NULL) {
+        req_wrap->req_.handle = wrap()->stream();
+        close_notify_cb_(&req_wrap->req_, UV_ECANCELED);
+      } else {
+        req_wrap->~ShutdownWrap();
+        env()->request_pool()->Free(reinterpret_cast<char*>(req_wrap));
+      }
+    }
+
     enc_in_ = NULL;
     enc_out_ = NULL;
     delete clear_in_;
     clear_in_ = NULL;
+    delete held_in_;
+    held_in_ = NULL;
 
     sc_ = NULL;
     sc_handle_.Reset();
@@ -189,6 +245,7 @@ namespace node {
 
     // Initialize ring for queud clear data
     clear_in_ = new NodeBIO();
+    held_in_ = new NodeBIO();
   }
 
 
@@ -272,6 +329,14 @@ namespace node {
     // a non-const SSL* in OpenSSL <= 0.9.7e.
     SSL* ssl = const_cast<SSL*>(ssl_);
     TLSCallbacks* c = static_cast<TLSCallbacks*>(SSL_get_app_data(ssl));
+
+    // Off the loop thread, replayed by FinishHandshake()
+    if (c->handshake_offloaded_) {
+      c->handshake_work_->info_ |=
+          where & (SSL_CB_HANDSHAKE_START | SSL_CB_HANDSHAKE_DONE);
+      return;
+    }
+
     Environment* env = c->env();
     HandleScope handle_scope(env->isolate());
     Context::Scope context_scope(env->context());
@@ -298,6 +363,24 @@ namespace node {
     if (!hello_parser_.IsEnded())
       return;
 
+    // enc_out_ belongs to the offloaded handshake step
+    if (handshake_work_ != NULL)
+      return;
+
+    if (ktls_tx_) {
+      // The kernel owns the write sequence, OpenSSL's own records (e.g. a
+      // renegotiation) can't follow
+      if (BIO_pending(enc_out_) != 0) {
+        NodeBIO::FromBIO(enc_out_)->Reset();
+        HandleScope handle_scope(env()->isolate());
+        Context::Scope context_scope(env()->context());
+        Local<Value> arg = Exception::Error(FIXED_ONE_BYTE_STRING(
+            env()->isolate(), "TLS records after kernel TLS offload"));
+        MakeCallback(env()->onerror_string(), 1, &arg);
+      }
+      return;
+    }
+
     // Write in progress
     if (write_size_ != 0)
       return;
@@ -314,6 +397,17 @@ namespace node {
     if (BIO_pending(enc_out_) == 0) {
       if (clear_in_->Length() == 0)
         InvokeQueued(0);
+
+      if (ktls_wanted_)
+        MaybeEnableKernelTLS();
+
+      // Idle connection, hand the BIO chunks back to the shared pool.
+      // OpenSSL drops its own record buffers via SSL_MODE_RELEASE_BUFFERS.
+      if (BIO_pending(enc_out_) == 0 && BIO_pending(enc_in_) == 0) {
+        NodeBIO::FromBIO(enc_in_)->Release();
+        NodeBIO::FromBIO(enc_out_)->Release();
+        clear_in_->Release();
+      }
       return;
     }
 
@@ -427,22 +521,66 @@ namespace node {
     if (eof_)
       return;
 
+    // Picked up again by FinishHandshake(), or the kernel decrypts
+    if (handshake_work_ != NULL || ktls_rx_)
+      return;
+
     HandleScope handle_scope(env()->isolate());
     Context::Scope context_scope(env()->context());
 
     assert(ssl_ != NULL);
 
-    char out[kClearOutChunkSize];
+    if (OffloadHandshake())
+      return;
+
     int read;
+    int err = SSL_ERROR_NONE;
+    Local<Value> arg;
     do {
-      read = SSL_read(ssl_, out, sizeof(out));
-      if (read > 0) {
-        Local<Value> argv[] = {
-          Integer::New(env()->isolate(), read),
-          Buffer::New(env(), out, read)
-        };
-        wrap()->MakeCallback(env()->onread_string(), ARRAY_SIZE(argv), argv);
+      // Decrypt as many records as fit straight into the slab, or into the
+      // stream's read buffer in read-into mode, and report them with one
+      // onread. JS may swap the read buffer from onread, so look it up
+      // every time.
+      const bool read_buffer = wrap()->has_read_buffer();
+      char* data;
+      size_t avail;
+      if (read_buffer) {
+        data = wrap()->ReadBufferSpace(&avail);
+        if (avail > INT_MAX)
+          avail = INT_MAX;
+      } else {
+        avail = kClearOutChunkSize;
+        data = env()->slab_allocator()->Allocate(avail);
+      }
+
+      size_t total = 0;
+      do {
+        read = SSL_read(ssl_, data + total, avail - total);
+        if (read > 0)
+          total += read;
+      } while (read > 0 && total < avail);
+
+      // The error belongs to this SSL_read, take it before onread can run
+      // anything that touches the SSL or the thread's error queue.
+      if (read == -1)
+        arg = GetSSLError(read, &err, NULL);
+
+      if (total == 0)
+        break;
+
+      // Committed before JS runs, onread may well read into the slab again.
+      Local<Value> argv[] = {
+        Integer::New(env()->isolate(), static_cast<int32_t>(total)),
+        Local<Value>()
+      };
+      if (read_buffer) {
+        size_t offset = wrap()->CommitReadBuffer(data, total);
+        argv[1] = Integer::NewFromUnsigned(env()->isolate(),
+                                           static_cast<uint32_t>(offset));
+      } else {
+        argv[1] = env()->slab_allocator()->Shrink(env(), data, total);
       }
+      wrap()->MakeCallback(env()->onread_string(), ARRAY_SIZE(argv), argv);
     } while (read > 0);
 
     int flags = SSL_get_shutdown(ssl_);
@@ -453,9 +591,6 @@ namespace node {
     }
 
     if (read == -1) {
-      int err;
-      Local<Value> arg = GetSSLError(read, &err, NULL);
-
       // Ignore ZERO_RETURN after EOF, it is basically not a error
       if (err == SSL_ERROR_ZERO_RETURN && eof_)
         return;
@@ -476,6 +611,10 @@ namespace node {
     if (!hello_parser_.IsEnded())
       return false;
 
+    // Stays in clear_in_ until the offloaded step is done
+    if (handshake_work_ != NULL)
+      return false;
+
     int written = 0;
     while (clear_in_->Length() > 0) {
       size_t avail = 0;
@@ -516,6 +655,9 @@ namespace node {
   }
 
   int TLSCallbacks::TryWrite(uv_buf_t** bufs, size_t* count) {
+    if (ktls_tx_)
+      return StreamWrapCallbacks::TryWrite(bufs, count);
+
     // TODO(indutny): Support it
     return 0;
   }
@@ -523,10 +665,23 @@ namespace node {
   int TLSCallbacks::DoWrite(WriteWrap* w, uv_buf_t* bufs, size_t count, uv_stream_t* send_handle, uv_write_cb cb) {
     assert(send_handle == NULL);
 
+    // The kernel encrypts
+    if (ktls_tx_)
+      return StreamWrapCallbacks::DoWrite(w, bufs, count, send_handle, cb);
+
     bool empty = true;
+    size_t i;
+
+    // Queue everything while a handshake step is offloaded
+    if (handshake_work_ != NULL) {
+      WriteItem* wi = new WriteItem(w, cb);
+      QUEUE_INSERT_TAIL(&write_item_queue_, &wi->member_);
+      for (i = 0; i < count; i++)
+        clear_in_->Write(bufs[i].base, bufs[i].len);
+      return 0;
+    }
 
     // Empty writes should not go through encryption process
-    size_t i;
     for (i = 0; i < count; i++)
       if (bufs[i].len > 0) {
         empty = false;
@@ -558,6 +713,16 @@ namespace node {
       return 0;
     }
 
+    // Several buffers (e.g. an uncorked batch) are coalesced in clear_in_
+    // so that they go out as full records instead of one record per buffer.
+    if (count > 1) {
+      for (i = 0; i < count; i++)
+        clear_in_->Write(bufs[i].base, bufs[i].len);
+      ClearIn();
+      EncOut();
+      return 0;
+    }
+
     int written = 0;
     for (i = 0; i < count; i++) {
       written = SSL_write(ssl_, bufs[i].base, bufs[i].len);
@@ -586,18 +751,56 @@ namespace node {
   }
 
   void TLSCallbacks::AfterWrite(WriteWrap* w) {
-  // Intentionally empty
+  if (!ktls_tx_)
+    return;
+  StreamWrapCallbacks::AfterWrite(w);
+
+  // A shutdown waiting for the queue to drain
+  if (close_notify_req_ != NULL &&
+      (close_notify_watch_ == NULL ||
+       !uv_is_active(reinterpret_cast<uv_handle_t*>(
+           &close_notify_watch_->handle)))) {
+    ResumeShutdown();
+  }
+}
+
+
+bool TLSCallbacks::WritesRaw() {
+  return ktls_tx_;
 }
 
 
 void TLSCallbacks::DoAlloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
+  if (ktls_rx_)
+    return StreamWrapCallbacks::DoAlloc(handle, suggested_size, buf);
+
   size_t size = 0;
-  buf->base = NodeBIO::FromBIO(enc_in_)->PeekWritable(&size);
+  NodeBIO* in = handshake_work_ != NULL ? held_in_ : NodeBIO::FromBIO(enc_in_);
+  buf->base = in->PeekWritable(&size);
   buf->len = size;
 }
 
 
 void TLSCallbacks::DoRead(uv_stream_t* handle, ssize_t nread, const uv_buf_t* buf, uv_handle_type pending) {
+    if (ktls_rx_) {
+      // The kernel fails reads at a non-data record, a close_notify
+      // alert in practice: end of stream
+      if (nread == UV_EIO)
+        nread = UV_EOF;
+      if (nread == UV_EOF)
+        eof_ = true;
+      return StreamWrapCallbacks::DoRead(handle, nread, buf, pending);
+    }
+
+    // Held back until the offloaded step returns
+    if (handshake_work_ != NULL) {
+      if (nread < 0)
+        held_nread_ = nread;
+      else
+        held_in_->Commit(nread);
+      return;
+    }
+
     if (nread < 0)  {
       // Error should be emitted only after all data was read
       ClearOut();
@@ -636,7 +839,17 @@ void TLSCallbacks::DoRead(uv_stream_t* handle, ssize_t nread, const uv_buf_t* bu
   }
 
   int TLSCallbacks::DoShutdown(ShutdownWrap* req_wrap, uv_shutdown_cb cb) {
-    if (SSL_shutdown(ssl_) == 0)
+    if (ktls_tx_) {
+      // The alert has to follow the data libuv still holds, and the FIN
+      // has to follow the alert
+      shutdown_ = true;
+      close_notify_req_ = req_wrap;
+      close_notify_cb_ = cb;
+      return ShutdownKernelTLS();
+    }
+
+    // A handshake in flight has no close_notify to send yet
+    if (handshake_work_ == NULL && SSL_shutdown(ssl_) == 0)
       SSL_shutdown(ssl_);
     shutdown_ = true;
     EncOut();
@@ -644,11 +857,348 @@ void TLSCallbacks::DoRead(uv_stream_t* handle, ssize_t nread, const uv_buf_t* bu
   }
 
 
+  struct TLSCallbacks::CloseNotifyWatch {
+    uv_poll_t handle;
+    TLSCallbacks* owner;  // NULL once the callbacks are gone
+    int fd;  // A dup() of the socket, closed with the handle
+  };
+
+
+  // Send the close_notify, then shut the socket down.  Returns 0 while it
+  // waits for the write queue or the send buffer, otherwise the result.
+  int TLSCallbacks::ShutdownKernelTLS() {
+    uv_stream_t* stream = wrap()->stream();
+    uv_handle_t* handle = reinterpret_cast<uv_handle_t*>(stream);
+
+    int err;
+    if (uv_is_closing(handle)) {
+      err = UV_ECANCELED;
+    } else {
+      // Picked up again by AfterWrite()
+      if (stream->write_queue_size != 0)
+        return 0;
+
+      uv_os_fd_t fd;
+      err = uv_fileno(handle, &fd);
+      if (err == 0)
+        err = KernelTLS::SendCloseNotify(fd);
+
+      // Picked up again by OnCloseNotifyWritable()
+      if (err == UV_EAGAIN && WatchCloseNotify(fd) == 0)
+        return 0;
+    }
+
+    ShutdownWrap* req_wrap = close_notify_req_;
+    close_notify_req_ = NULL;
+    if (err != 0)
+      return err;
+    return StreamWrapCallbacks::DoShutdown(req_wrap, close_notify_cb_);
+  }
+
+
+  void TLSCallbacks::ResumeShutdown() {
+    ShutdownWrap* req_wrap = close_notify_req_;
+    uv_shutdown_cb cb = close_notify_cb_;
+    int err = ShutdownKernelTLS();
+    if (err != 0) {
+      // Reported the way a failed uv_shutdown() would be
+      req_wrap->req_.handle = wrap()->stream();
+      cb(&req_wrap->req_, err);
+    }
+  }
+
+
+  int TLSCallbacks::WatchCloseNotify(int fd) {
+  #if defined(__linux__)
+    if (close_notify_watch_ == NULL) {
+      int watch_fd = dup(fd);
+      if (watch_fd == -1)
+        return -errno;
+      CloseNotifyWatch* watch = new CloseNotifyWatch;
+      watch->owner = this;
+      watch->fd = watch_fd;
+      int err = uv_poll_init(env()->event_loop(), &watch->handle, watch_fd);
+      if (err != 0) {
+        close(watch_fd);
+        delete watch;
+        return err;
+      }
+      close_notify_watch_ = watch;
+    }
+
+    return uv_poll_start(&close_notify_watch_->handle,
+                         UV_WRITABLE,
+                         OnCloseNotifyWritable);
+  #else
+    return UV_ENOSYS;
+  #endif
+  }
+
+
+  void TLSCallbacks::OnCloseNotifyWritable(uv_poll_t* handle,
+                                           int status,
+                                           int events) {
+    CloseNotifyWatch* watch = ContainerOf(&CloseNotifyWatch::handle, handle);
+
+    // One shot, a full buffer again re-arms it. A socket error shows up
+    // on the retry.
+    uv_poll_stop(handle);
+    watch->owner->ResumeShutdown();
+  }
+
+
+  void TLSCallbacks::OnCloseNotifyWatchClose(uv_handle_t* handle) {
+    CloseNotifyWatch* watch = ContainerOf(&CloseNotifyWatch::handle,
+                                          reinterpret_cast<uv_poll_t*>(handle));
+  #if defined(__linux__)
+    close(watch->fd);
+  #endif
+    delete watch;
+  }
+
+
+  void TLSCallbacks::MaybeEnableKernelTLS() {
+    // Only at a record boundary both ways, with nothing queued anywhere
+    if (!established_ || shutdown_ || eof_ || !wrap()->is_tcp())
+      return;
+    if (handshake_work_ != NULL ||
+        write_size_ != 0 ||
+        clear_in_->Length() != 0 ||
+        BIO_pending(enc_out_) != 0 ||
+        BIO_pending(enc_in_) != 0 ||
+        SSL_pending(ssl_) != 0 ||
+        ssl_->rstate != SSL_ST_READ_HEADER ||
+        ssl_->packet_length != 0 ||
+        ssl_->s3->rbuf.left != 0 ||
+        !QUEUE_EMPTY(&write_item_queue_) ||
+        !QUEUE_EMPTY(&pending_write_items_) ||
+        wrap()->stream()->write_queue_size != 0) {
+      return;
+    }
+
+    // One attempt, any failure keeps the user space path
+    ktls_wanted_ = false;
+    if (!KernelTLS::Supported(ssl_))
+      return;
+
+    uv_os_fd_t fd;
+    if (uv_fileno(reinterpret_cast<uv_handle_t*>(wrap()->stream()), &fd) != 0)
+      return;
+
+    // Both ways or not at all, except that receive keys a failed TX
+    // install left on the socket have to be honoured: the kernel decrypts
+    // from here on and OpenSSL keeps encrypting
+    bool rx;
+    int err = KernelTLS::Enable(ssl_, fd, &rx);
+    ktls_rx_ = rx;
+    ktls_tx_ = err == 0;
+  }
+
+
+  bool TLSCallbacks::OffloadHandshake() {
+    if (!async_handshake_ || !is_server() || SSL_is_init_finished(ssl_))
+      return false;
+
+    // Nothing for the state machine yet, or EncOutCb would race the worker
+    if (BIO_pending(enc_in_) == 0 || write_size_ != 0)
+      return false;
+
+    // The worker can't call into V8, keep steps that would on the loop
+  #ifdef OPENSSL_NPN_NEGOTIATED
+    if (!npn_protos_.IsEmpty())
+      return false;
+  #endif  // OPENSSL_NPN_NEGOTIATED
+  #ifdef NODE__HAVE_TLSEXT_STATUS_CB
+    if (!ocsp_response_.IsEmpty())
+      return false;
+  #endif  // NODE__HAVE_TLSEXT_STATUS_CB
+  #ifdef SSL_CTRL_SET_TLSEXT_SERVERNAME_CB
+    offload_sni_ = NULL;
+    Local<Value> ctx = object()->Get(env()->sni_context_string());
+    if (ctx->IsObject()) {
+      // Let SelectSNIContextCallback report a bad context
+      if (!env()->secure_context_constructor_template()->HasInstance(ctx))
+        return false;
+      sni_context_.Reset();
+      sni_context_.Reset(env()->isolate(), ctx);
+      offload_sni_ = Unwrap<SecureContext>(ctx.As<Object>());
+      // Other connections share the SSL_CTX, its callbacks are only ever
+      // set from the loop thread
+      InitNPN(offload_sni_);
+    }
+  #endif  // SSL_CTRL_SET_TLSEXT_SERVERNAME_CB
+
+    HandshakeWork* work = new HandshakeWork();
+    work->callbacks_ = this;
+    work->ret_ = 0;
+    work->err_ = SSL_ERROR_NONE;
+    work->info_ = 0;
+    work->error_count_ = 0;
+    if (uv_sem_init(&work->done_, 0)) {
+      delete work;
+      return false;
+    }
+
+    handshake_work_ = work;
+    handshake_offloaded_ = true;
+    int r = uv_queue_work(env()->event_loop(),
+                          &work->req_,
+                          HandshakeWorkCb,
+                          AfterHandshakeWorkCb);
+    if (r != 0) {
+      handshake_work_ = NULL;
+      handshake_offloaded_ = false;
+      uv_sem_destroy(&work->done_);
+      delete work;
+      return false;
+    }
+
+    // Keep the contexts the worker touches from being freed under it
+    sc_->StepStarted();
+  #ifdef SSL_CTRL_SET_TLSEXT_SERVERNAME_CB
+    if (offload_sni_ != NULL)
+      offload_sni_->StepStarted();
+  #endif  // SSL_CTRL_SET_TLSEXT_SERVERNAME_CB
+
+    return true;
+  }
+
+
+  void TLSCallbacks::ReleaseStepContexts() {
+    sc_->StepFinished();
+  #ifdef SSL_CTRL_SET_TLSEXT_SERVERNAME_CB
+    if (offload_sni_ != NULL)
+      offload_sni_->StepFinished();
+  #endif  // SSL_CTRL_SET_TLSEXT_SERVERNAME_CB
+  }
+
+
+  void TLSCallbacks::HandshakeWorkCb(uv_work_t* req) {
+    HandshakeWork* work = ContainerOf(&HandshakeWork::req_, req);
+    SSL* ssl = work->callbacks_->ssl_;
+
+    ERR_clear_error();
+    work->ret_ = SSL_do_handshake(ssl);
+    work->err_ = SSL_get_error(ssl, work->ret_);
+
+    unsigned long e;
+    while ((e = ERR_get_error()) != 0) {
+      if (work->error_count_ < HandshakeWork::kMaxErrors)
+        work->errors_[work->error_count_++] = e;
+    }
+
+    uv_sem_post(&work->done_);
+  }
+
+
+  void TLSCallbacks::AfterHandshakeWorkCb(uv_work_t* req, int status) {
+    HandshakeWork* work = ContainerOf(&HandshakeWork::req_, req);
+    TLSCallbacks* callbacks = work->callbacks_;
+
+    // Connection went away while the step was in flight
+    if (callbacks == NULL) {
+      uv_sem_destroy(&work->done_);
+      delete work;
+      return;
+    }
+
+    assert(status == 0);
+    callbacks->FinishHandshake(work);
+  }
+
+
+  void TLSCallbacks::FinishHandshake(HandshakeWork* work) {
+    assert(handshake_work_ == work);
+    handshake_work_ = NULL;
+    handshake_offloaded_ = false;
+    ReleaseStepContexts();
+
+    HandleScope handle_scope(env()->isolate());
+    Context::Scope context_scope(env()->context());
+
+    // Data that arrived meanwhile goes behind whatever OpenSSL left
+    NodeBIO* enc_in = NodeBIO::FromBIO(enc_in_);
+    while (held_in_->Length() > 0) {
+      size_t avail = 0;
+      char* data = held_in_->Peek(&avail);
+      enc_in->Write(data, avail);
+      held_in_->Read(NULL, avail);
+    }
+    held_in_->Release();
+
+    // Replay what the callbacks left for the loop thread
+    if (work->info_ != 0)
+      SSLInfoCallback(ssl_, work->info_, 1);
+    if (offloaded_sess_ != NULL) {
+      SSL_SESSION* sess = offloaded_sess_;
+      offloaded_sess_ = NULL;
+      NewSessionCallback(ssl_, sess);
+      SSL_SESSION_free(sess);
+    }
+
+    bool failed = work->ret_ <= 0 &&
+                  work->err_ != SSL_ERROR_WANT_READ &&
+                  work->err_ != SSL_ERROR_WANT_WRITE;
+    if (failed) {
+      for (int i = 0; i < work->error_count_; i++) {
+        unsigned long e = work->errors_[i];
+        ERR_PUT_error(ERR_GET_LIB(e),
+                      ERR_GET_FUNC(e),
+                      ERR_GET_REASON(e),
+                      __FILE__,
+                      __LINE__);
+      }
+    }
+    int ret = work->ret_;
+    uv_sem_destroy(&work->done_);
+    delete work;
+
+    if (failed) {
+      int err;
+      Local<Value> arg = GetSSLError(ret, &err, NULL);
+
+      if (!arg.IsEmpty() && !(err == SSL_ERROR_ZERO_RETURN && eof_)) {
+        // Flush the alert first, same as ClearOut()
+        if (BIO_pending(enc_out_) != 0)
+          EncOut();
+
+        MakeCallback(env()->onerror_string(), 1, &arg);
+        return;
+      }
+    }
+
+    Cycle();
+
+    if (held_nread_ != 0) {
+      ssize_t nread = held_nread_;
+      held_nread_ = 0;
+      DoRead(wrap()->stream(), nread, NULL, UV_UNKNOWN_HANDLE);
+    }
+  }
+
+
+  void TLSCallbacks::GetBIOPoolStats(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    Local<Object> info = Object::New(env->isolate());
+    info->Set(env->pooled_bytes_string(),
+              Number::New(env->isolate(),
+                          static_cast<double>(NodeBIOPool::pooled_bytes())));
+    info->Set(env->in_use_bytes_string(),
+              Number::New(env->isolate(),
+                          static_cast<double>(NodeBIOPool::in_use_bytes())));
+    args.GetReturnValue().Set(info);
+  }
+
+
   void TLSCallbacks::SetVerifyMode(const FunctionCallbackInfo<Value>& args) {
     Environment* env = Environment::GetCurrent(args.GetIsolate());
     HandleScope scope(env->isolate());
 
     TLSCallbacks* wrap = Unwrap<TLSCallbacks>(args.Holder());
+    if (wrap->ThrowIfHandshakeBusy("setVerifyMode"))
+      return;
 
     if (args.Length() < 2 || !args[0]->IsBoolean() || !args[1]->IsBoolean())
       return env->ThrowTypeError("Bad arguments, expected two booleans");
@@ -681,6 +1231,8 @@ void TLSCallbacks::DoRead(uv_stream_t* handle, ssize_t nread, const uv_buf_t* bu
     HandleScope scope(env->isolate());
 
     TLSCallbacks* wrap = Unwrap<TLSCallbacks>(args.Holder());
+    if (wrap->ThrowIfHandshakeBusy("enableSessionCallbacks"))
+      return;
 
     wrap->enable_session_callbacks();
     EnableHelloParser(args);
@@ -692,6 +1244,8 @@ void TLSCallbacks::DoRead(uv_stream_t* handle, ssize_t nread, const uv_buf_t* bu
     HandleScope scope(env->isolate());
 
     TLSCallbacks* wrap = Unwrap<TLSCallbacks>(args.Holder());
+    if (wrap->ThrowIfHandshakeBusy("enableHelloParser"))
+      return;
 
     NodeBIO::FromBIO(wrap->enc_in_)->set_initial(kMaxHelloLength);
     wrap->hello_parser_.Start(SSLWrap<TLSCallbacks>::OnClientHello,
@@ -700,6 +1254,42 @@ void TLSCallbacks::DoRead(uv_stream_t* handle, ssize_t nread, const uv_buf_t* bu
   }
 
 
+  void TLSCallbacks::EnableKernelTLS(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    TLSCallbacks* wrap = Unwrap<TLSCallbacks>(args.Holder());
+
+    // Installed at the next idle point after the handshake
+    wrap->ktls_wanted_ = !wrap->ktls_tx_ && !wrap->ktls_rx_;
+    if (wrap->ktls_wanted_)
+      wrap->MaybeEnableKernelTLS();
+  }
+
+
+  void TLSCallbacks::IsKernelTLS(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    TLSCallbacks* wrap = Unwrap<TLSCallbacks>(args.Holder());
+    args.GetReturnValue().Set(wrap->ktls_tx_);
+  }
+
+
+  void TLSCallbacks::EnableAsyncHandshake(
+      const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    TLSCallbacks* wrap = Unwrap<TLSCallbacks>(args.Holder());
+
+    if (!wrap->is_server())
+      return env->ThrowError("Async handshake is server only");
+
+    wrap->async_handshake_ = true;
+  }
+
+
   void TLSCallbacks::OnClientHelloParseEnd(void* arg) {
     TLSCallbacks* c = static_cast<TLSCallbacks*>(arg);
     c->Cycle();
@@ -712,6 +1302,8 @@ void TLSCallbacks::DoRead(uv_stream_t* handle, ssize_t nread, const uv_buf_t* bu
     HandleScope scope(env->isolate());
 
     TLSCallbacks* wrap = Unwrap<TLSCallbacks>(args.Holder());
+    if (wrap->ThrowIfHandshakeBusy("getServername"))
+      return;
 
     const char* servername = SSL_get_servername(wrap->ssl_,
                                                 TLSEXT_NAMETYPE_host_name);
@@ -728,6 +1320,8 @@ void TLSCallbacks::DoRead(uv_stream_t* handle, ssize_t nread, const uv_buf_t* bu
     HandleScope scope(env->isolate());
 
     TLSCallbacks* wrap = Unwrap<TLSCallbacks>(args.Holder());
+    if (wrap->ThrowIfHandshakeBusy("setServername"))
+      return;
 
     if (args.Length() < 1 || !args[0]->IsString())
       return env->ThrowTypeError("First argument should be a string");
@@ -754,6 +1348,16 @@ void TLSCallbacks::DoRead(uv_stream_t* handle, ssize_t nread, const uv_buf_t* bu
     if (servername == NULL)
       return SSL_TLSEXT_ERR_OK;
 
+    // Offloaded step, the context was resolved and set up by
+    // OffloadHandshake()
+    if (p->handshake_offloaded_) {
+      SecureContext* sc = p->offload_sni_;
+      if (sc == NULL)
+        return SSL_TLSEXT_ERR_NOACK;
+      SSL_set_SSL_CTX(s, sc->ctx_);
+      return SSL_TLSEXT_ERR_OK;
+    }
+
     HandleScope scope(env->isolate());
     // Call the SNI callback and use its return value as context
     Local<Object> object = p->object();
@@ -786,6 +1390,7 @@ void TLSCallbacks::DoRead(uv_stream_t* handle, ssize_t nread, const uv_buf_t* bu
     Environment* env = Environment::GetCurrent(context);
 
     NODE_SET_METHOD(target, "wrap", TLSCallbacks::Wrap);
+    NODE_SET_METHOD(target, "getBIOPoolStats", TLSCallbacks::GetBIOPoolStats);
 
     Local<FunctionTemplate> t = FunctionTemplate::New(env->isolate());
     t->InstanceTemplate()->SetInternalFieldCount(1);
@@ -796,6 +1401,9 @@ void TLSCallbacks::DoRead(uv_stream_t* handle, ssize_t nread, const uv_buf_t* bu
     NODE_SET_PROTOTYPE_METHOD(t, "setVerifyMode", SetVerifyMode);
     NODE_SET_PROTOTYPE_METHOD(t, "enableSessionCallbacks", EnableSessionCallbacks);
     NODE_SET_PROTOTYPE_METHOD(t, "enableHelloParser",  EnableHelloParser);
+    NODE_SET_PROTOTYPE_METHOD(t, "enableAsyncHandshake", EnableAsyncHandshake);
+    NODE_SET_PROTOTYPE_METHOD(t, "enableKernelTLS", EnableKernelTLS);
+    NODE_SET_PROTOTYPE_METHOD(t, "isKernelTLS", IsKernelTLS);
 
     SSLWrap<TLSCallbacks>::AddMethods(env, t);
 
@@ -58,6 +58,7 @@ class TLSCallbacks : public crypto::SSLWrap<TLSCallbacks>,
               uv_stream_t* send_handle,
               uv_write_cb cb);
   void AfterWrite(WriteWrap* w);
+  bool WritesRaw();
   void DoAlloc(uv_handle_t* handle,
                size_t suggested_size,
                uv_buf_t* buf);
@@ -70,7 +71,9 @@ class TLSCallbacks : public crypto::SSLWrap<TLSCallbacks>,
   void NewSessionDoneCb();
 
   protected:
-  static const int kClearOutChunkSize = 1024;
+  // Cleartext is decrypted into the slab in chunks of up to this size,
+  // several records per onread.
+  static const int kClearOutChunkSize = 64 * 1024;
 
   // Maximum number of bytes for hello parser
   static const int kMaxHelloLength = 16384;
@@ -101,8 +104,39 @@ class TLSCallbacks : public crypto::SSLWrap<TLSCallbacks>,
                v8::Handle<v8::Object> sc,
                StreamWrapCallbacks* old);
 
+  // One SSL_do_handshake() step running on the threadpool.  While it is in
+  // flight the loop thread leaves ssl_ and both BIOs alone: reads are held
+  // in held_in_, writes queue in clear_in_ and EncOut/ClearIn/ClearOut
+  // return early.
+  struct HandshakeWork {
+    static const int kMaxErrors = 8;
+
+    uv_work_t req_;
+    uv_sem_t done_;
+    // NULL once the connection is destroyed
+    TLSCallbacks* callbacks_;
+    int ret_;
+    int err_;
+    // SSLInfoCallback events to replay on the loop
+    int info_;
+    // OpenSSL's error queue is per thread, carried over by hand
+    unsigned long errors_[kMaxErrors];
+    int error_count_;
+  };
+
   static void SSLInfoCallback(const SSL* ssl_, int where, int ret);
   void InitSSL();
+  bool OffloadHandshake();
+  void ReleaseStepContexts();
+  void MaybeEnableKernelTLS();
+  int ShutdownKernelTLS();
+  void ResumeShutdown();
+  int WatchCloseNotify(int fd);
+  static void OnCloseNotifyWritable(uv_poll_t* handle, int status, int events);
+  static void OnCloseNotifyWatchClose(uv_handle_t* handle);
+  void FinishHandshake(HandshakeWork* work);
+  static void HandshakeWorkCb(uv_work_t* req);
+  static void AfterHandshakeWorkCb(uv_work_t* req, int status);
   void EncOut();
   static void EncOutCb(uv_write_t* req, int status);
   bool ClearIn();
@@ -130,12 +164,17 @@ class TLSCallbacks : public crypto::SSLWrap<TLSCallbacks>,
 
   static void Wrap(const v8::FunctionCallbackInfo<v8::Value>& args);
   static void Receive(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void GetBIOPoolStats(const v8::FunctionCallbackInfo<v8::Value>& args);
   static void Start(const v8::FunctionCallbackInfo<v8::Value>& args);
   static void SetVerifyMode(const v8::FunctionCallbackInfo<v8::Value>& args);
   static void EnableSessionCallbacks(
       const v8::FunctionCallbackInfo<v8::Value>& args);
   static void EnableHelloParser(
       const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void EnableAsyncHandshake(
+      const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void EnableKernelTLS(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void IsKernelTLS(const v8::FunctionCallbackInfo<v8::Value>& args);
 
   #ifdef SSL_CTRL_SET_TLSEXT_SERVERNAME_CB
   static void GetServername(const v8::FunctionCallbackInfo<v8::Value>& args);
@@ -148,6 +187,7 @@ class TLSCallbacks : public crypto::SSLWrap<TLSCallbacks>,
   BIO* enc_in_;
   BIO* enc_out_;
   NodeBIO* clear_in_;
+  NodeBIO* held_in_;
   uv_write_t write_req_;
   size_t write_size_;
   size_t write_queue_size_;
@@ -163,8 +203,31 @@ class TLSCallbacks : public crypto::SSLWrap<TLSCallbacks>,
   // after the `UV_EOF` on socket.
   bool eof_;
 
+  // Server handshakes run their private key operations on the threadpool
+  bool async_handshake_;
+  HandshakeWork* handshake_work_;
+  // Read error or EOF that arrived during an offloaded step
+  ssize_t held_nread_;
+
+  // Kernel TLS: requested, and installed per direction.  With ktls_tx_
+  // writes go to the socket as cleartext, with ktls_rx_ reads do too.
+  // ktls_tx_ always comes with ktls_rx_, ktls_rx_ alone is what a failed
+  // TX install leaves.
+  bool ktls_wanted_;
+  bool ktls_tx_;
+  bool ktls_rx_;
+
+  // Kernel TLS shutdown: the close_notify goes out once libuv's write
+  // queue is empty, and waits on a watch when the send buffer is full
+  struct CloseNotifyWatch;
+  ShutdownWrap* close_notify_req_;
+  uv_shutdown_cb close_notify_cb_;
+  CloseNotifyWatch* close_notify_watch_;
+
   #ifdef SSL_CTRL_SET_TLSEXT_SERVERNAME_CB
   v8::Persistent<v8::Value> sni_context_;
+  // SNI context resolved before a step is offloaded
+  crypto::SecureContext* offload_sni_;
   #endif  // SSL_CTRL_SET_TLSEXT_SERVERNAME_CB
 
   static size_t error_off_;
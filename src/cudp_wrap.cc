@@ -25,10 +25,27 @@
 #include "cutil-inl.h"
 #include "cnode_buffer.h"
 #include "creq_wrap.h"
+#include "csmalloc.h"
 
 #include <stdlib.h>
+#include <string.h>  // memmove()
+#if !defined(_WIN32)
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+// Not in older headers, the kernel side has been there since 4.18.
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#endif
 
 namespace node {
+  using v8::Array;
   using v8::Context;
   using v8::EscapableHandleScope;
   using v8::External;
@@ -40,9 +57,11 @@ namespace node {
   using v8::Integer;
   using v8::Local;
   using v8::Object;
+  using v8::Persistent;
   using v8::PropertyAttribute;
   using v8::PropertyCallbackInfo;
   using v8::String;
+  using v8::True;
   using v8::Uint32;
   using v8::Undefined;
   using v8::Value;
@@ -51,7 +70,18 @@ namespace node {
    public:
     SendWrap(Environment* env, Local<Object> req_wrap_obj, bool have_callback);
     inline bool have_callback() const;
+
+    void* operator new(size_t size, char* storage) { return storage; }
+
+    // This is just to keep the compiler happy. It should never be called, since
+    // we don't use exceptions in node.
+    void operator delete(void* ptr, char* storage) { assert(0); }
+
    private:
+    // Storage comes from the environment's RequestPool.
+    void* operator new(size_t size) { assert(0); }
+    void operator delete(void* ptr) { assert(0); }
+
     const bool have_callback_;
   };
 
@@ -69,21 +99,387 @@ namespace node {
   }
 
 
+  // One request for a whole sendBatch() or sendSegments().  Datagrams that
+  // can't be written right away each get a uv_udp_send_t, oncomplete runs
+  // once the last of them is done.  `failed` stands in for them when libuv
+  // refused the first one after part of the batch went out directly.
+  class BatchSendWrap : public ReqWrap<uv_udp_send_t> {
+   public:
+    BatchSendWrap(Environment* env,
+                  Local<Object> req_wrap_obj,
+                  bool have_callback,
+                  unsigned int count);
+    ~BatchSendWrap();
+
+    // The i-th libuv request, req_ comes first.
+    inline uv_udp_send_t* request(unsigned int i) {
+      return i == 0 ? &req_ : &extra_[i - 1];
+    }
+
+    const bool have_callback;
+    unsigned int pending;
+    unsigned int sent;  // Datagrams the kernel took.
+    int status;  // First error.
+    uv_timer_t failed;
+
+   private:
+    uv_udp_send_t* extra_;
+  };
+
+
+  BatchSendWrap::BatchSendWrap(Environment* env,
+                               Local<Object> req_wrap_obj,
+                               bool have_callback,
+                               unsigned int count)
+      : ReqWrap<uv_udp_send_t>(env, req_wrap_obj, AsyncWrap::PROVIDER_UDPWRAP),
+        have_callback(have_callback),
+        pending(0),
+        sent(0),
+        status(0),
+        extra_(count > 1 ? new uv_udp_send_t[count - 1] : NULL) {
+    Wrap(req_wrap_obj, this);
+  }
+
+
+  BatchSendWrap::~BatchSendWrap() {
+    delete[] extra_;
+  }
+
+
+  static const unsigned int kMaxBatchSend = 1024;
+
+
+  static int ParseAddress(int family,
+                          const char* ip,
+                          int port,
+                          sockaddr_storage* addr) {
+    if (family != AF_INET6) {
+      int err = uv_ip4_addr(ip, port, reinterpret_cast<sockaddr_in*>(addr));
+      if (err == 0 || family == AF_INET)
+        return err;
+    }
+    return uv_ip6_addr(ip, port, reinterpret_cast<sockaddr_in6*>(addr));
+  }
+
+
+  UDPAddressCache::UDPAddressCache() : next_(0) {
+    for (unsigned int i = 0; i < kEntries; i++)
+      entries_[i].family = -1;
+  }
+
+
+  int UDPAddressCache::Lookup(int family,
+                              const char* ip,
+                              int port,
+                              sockaddr_storage* addr) {
+    size_t length = strlen(ip);
+    const bool cacheable = length < kMaxAddressLength;
+
+    if (cacheable) {
+      for (unsigned int i = 0; i < kEntries; i++) {
+        Entry* entry = &entries_[i];
+        if (entry->family != family || memcmp(entry->ip, ip, length + 1) != 0)
+          continue;
+        *addr = entry->addr;
+        if (addr->ss_family == AF_INET6)
+          reinterpret_cast<sockaddr_in6*>(addr)->sin6_port = htons(port);
+        else
+          reinterpret_cast<sockaddr_in*>(addr)->sin_port = htons(port);
+        return 0;
+      }
+    }
+
+    int err = ParseAddress(family, ip, port, addr);
+    if (err == 0 && cacheable) {
+      Entry* entry = &entries_[next_];
+      next_ = (next_ + 1) % kEntries;
+      entry->family = family;
+      memcpy(entry->ip, ip, length + 1);
+      entry->addr = *addr;
+    }
+    return err;
+  }
+
+
   static void NewSendWrap(const FunctionCallbackInfo<Value>& args) {
     assert(args.IsConstructCall());
   }
 
 
+  // recvBatchStart(): datagrams are read with recvmmsg(2) from a dup of the
+  // socket, watched by its own poll handle while the UDP handle itself is
+  // not receiving.  Each recvmmsg() call makes one onmessages() callback.
+  class RecvBatch {
+   public:
+    static const unsigned int kMaxBatch = 1024;
+    static const size_t kDefaultSlotSize = 2048;
+    // Per datagram: offset, length, address index, truncated.
+    static const int kRecordSize = 4;
+    // Batches up to this size are copied out instead of pinning the slab.
+    static const size_t kCopyThreshold = 64 * 1024;
+
+    RecvBatch(UDPWrap* wrap, unsigned int batch, size_t slot_size);
+
+    // On failure the batch has already cleaned up after itself.
+    int Start();
+    // Stops reading, the batch deletes itself once the poll handle closed.
+    void Dispose();
+
+   private:
+    // Bounded so that one busy socket doesn't starve the loop.
+    static const int kMaxRounds = 4;
+    // How far back to look for a repeated sender.
+    static const uint32_t kSenderLookback = 16;
+
+    ~RecvBatch();
+
+    int ReadSome();
+    void Deliver(char* base, int count);
+    void ReportError(int err);
+
+    static void OnReadable(uv_poll_t* handle, int status, int events);
+    static void OnClose(uv_handle_t* handle);
+
+    UDPWrap* wrap_;
+    int fd_;
+    uv_poll_t poll_;
+    unsigned int batch_;
+    size_t slot_size_;
+  #if defined(__linux__)
+    mmsghdr* msgs_;
+    iovec* iovs_;
+    sockaddr_storage* addrs_;
+    unsigned int* senders_;  // Message of each entry in the address table.
+  #endif
+    // Uint32 external array reused by every onmessages() call.
+    Persistent<Object> records_;
+    uint32_t* records_data_;
+  };
+
+
+#if defined(__linux__)
+  RecvBatch::RecvBatch(UDPWrap* wrap, unsigned int batch, size_t slot_size)
+      : wrap_(wrap),
+        fd_(-1),
+        batch_(batch),
+        slot_size_(slot_size),
+        msgs_(new mmsghdr[batch]),
+        iovs_(new iovec[batch]),
+        addrs_(new sockaddr_storage[batch]),
+        senders_(new unsigned int[batch]),
+        records_data_(NULL) {
+  }
+
+
+  RecvBatch::~RecvBatch() {
+    if (fd_ != -1)
+      close(fd_);
+    delete[] msgs_;
+    delete[] iovs_;
+    delete[] addrs_;
+    delete[] senders_;
+    records_.Reset();
+  }
+
+
+  int RecvBatch::Start() {
+    int fd = wrap_->UVHandle()->io_watcher.fd;
+    if (fd == -1 || (fd_ = dup(fd)) == -1) {
+      int err = fd == -1 ? UV_EBADF : -errno;
+      delete this;
+      return err;
+    }
+
+    int err = uv_poll_init(wrap_->env()->event_loop(), &poll_, fd_);
+    if (err != 0) {
+      delete this;
+      return err;
+    }
+
+    Environment* env = wrap_->env();
+    size_t length = batch_ * kRecordSize;
+    Local<Object> records = Object::New(env->isolate());
+    smalloc::Alloc(env,
+                   records,
+                   length * sizeof(uint32_t),
+                   v8::kExternalUnsignedIntArray);
+    records->Set(env->length_string(),
+                 Integer::NewFromUnsigned(env->isolate(), length));
+    records_.Reset(env->isolate(), records);
+    records_data_ = static_cast<uint32_t*>(
+        records->GetIndexedPropertiesExternalArrayData());
+
+    err = uv_poll_start(&poll_, UV_READABLE, OnReadable);
+    if (err != 0)
+      Dispose();
+    return err;
+  }
+
+
+  void RecvBatch::Dispose() {
+    wrap_ = NULL;
+    uv_close(reinterpret_cast<uv_handle_t*>(&poll_), OnClose);
+  }
+
+
+  // Returns the number of datagrams read, zero once the socket is drained
+  // or after an error was reported.
+  int RecvBatch::ReadSome() {
+    Environment* env = wrap_->env();
+    char* base = env->slab_allocator()->Allocate(batch_ * slot_size_);
+
+    for (unsigned int i = 0; i < batch_; i++) {
+      iovs_[i].iov_base = base + i * slot_size_;
+      iovs_[i].iov_len = slot_size_;
+      memset(&msgs_[i], 0, sizeof(msgs_[i]));
+      msgs_[i].msg_hdr.msg_name = &addrs_[i];
+      msgs_[i].msg_hdr.msg_namelen = sizeof(addrs_[i]);
+      msgs_[i].msg_hdr.msg_iov = &iovs_[i];
+      msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int count;
+    do {
+      count = recvmmsg(fd_, msgs_, batch_, MSG_DONTWAIT, NULL);
+    } while (count == -1 && errno == EINTR);
+
+    if (count == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        ReportError(-errno);
+      return 0;
+    }
+
+    if (count > 0)
+      Deliver(base, count);
+    return count;
+  }
+
+
+  // onmessages(count, handle, buffer, records, addresses): the datagrams
+  // are packed into `buffer`, `records` is a Uint32 array with kRecordSize
+  // entries for each and `addresses` holds one rinfo object per distinct
+  // sender. The records array is the same every call, only valid until the
+  // next one.
+  void RecvBatch::Deliver(char* base, int count) {
+    Environment* env = wrap_->env();
+    Isolate* isolate = env->isolate();
+
+    uint32_t* records = records_data_;
+    Local<Array> addresses = Array::New(isolate);
+    uint32_t address_count = 0;
+    size_t offset = 0;
+
+    for (int i = 0; i < count; i++) {
+      size_t length = msgs_[i].msg_len;
+      char* data = base + i * slot_size_;
+      if (data != base + offset)
+        memmove(base + offset, data, length);
+
+      const sockaddr* addr = reinterpret_cast<const sockaddr*>(&addrs_[i]);
+      uint32_t index = address_count;
+      uint32_t first = address_count > kSenderLookback ?
+                       address_count - kSenderLookback : 0;
+      for (uint32_t j = address_count; j > first; j--) {
+        const sockaddr* seen =
+            reinterpret_cast<const sockaddr*>(&addrs_[senders_[j - 1]]);
+        if (SameAddress(addr, seen)) {
+          index = j - 1;
+          break;
+        }
+      }
+      if (index == address_count) {
+        senders_[address_count] = i;
+        addresses->Set(address_count++, AddressToJS(env, addr));
+      }
+
+      bool truncated = (msgs_[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+      records[i * kRecordSize] = offset;
+      records[i * kRecordSize + 1] = length;
+      records[i * kRecordSize + 2] = index;
+      records[i * kRecordSize + 3] = truncated;
+      offset += length;
+    }
+
+    Local<Value> argv[] = {
+      Integer::New(isolate, count),
+      wrap_->object(),
+      Undefined(isolate),
+      PersistentToLocal(isolate, records_),
+      addresses
+    };
+    // Small batches are copied so they don't keep the whole slab alive,
+    // nothing is committed and the next read reuses the space.
+    if (offset <= kCopyThreshold)
+      argv[2] = Buffer::New(env, base, offset);
+    else
+      argv[2] = env->slab_allocator()->Shrink(env, base, offset);
+
+    wrap_->MakeCallback(env->onmessages_string(), ARRAY_SIZE(argv), argv);
+  }
+
+
+  // Errors go through onmessage(), as with uv_udp_recv_start().
+  void RecvBatch::ReportError(int err) {
+    Environment* env = wrap_->env();
+    Local<Value> argv[] = {
+      Integer::New(env->isolate(), err),
+      wrap_->object(),
+      Undefined(env->isolate()),
+      Undefined(env->isolate())
+    };
+    wrap_->MakeCallback(env->onmessage_string(), ARRAY_SIZE(argv), argv);
+  }
+
+
+  void RecvBatch::OnReadable(uv_poll_t* handle, int status, int events) {
+    RecvBatch* batch = ContainerOf(&RecvBatch::poll_, handle);
+    UDPWrap* wrap = batch->wrap_;
+    if (wrap == NULL || wrap->GetHandle() == NULL)
+      return;
+
+    Environment* env = wrap->env();
+    HandleScope handle_scope(env->isolate());
+    Context::Scope context_scope(env->context());
+
+    if (status < 0) {
+      batch->ReportError(status);
+      return;
+    }
+
+    // Stop early once a round comes back short, or JS stopped the batch.
+    for (int round = 0; round < kMaxRounds; round++) {
+      int count = batch->ReadSome();
+      if (batch->wrap_ == NULL || static_cast<unsigned int>(count) < batch->batch_)
+        break;
+    }
+  }
+
+
+  void RecvBatch::OnClose(uv_handle_t* handle) {
+    RecvBatch* batch =
+        ContainerOf(&RecvBatch::poll_, reinterpret_cast<uv_poll_t*>(handle));
+    delete batch;
+  }
+#endif  // defined(__linux__)
+
+
   UDPWrap::UDPWrap(Environment* env, Handle<Object> object, AsyncWrap* parent)
       : HandleWrap(env,
                    object,
                    reinterpret_cast<uv_handle_t*>(&handle_),
-                   AsyncWrap::PROVIDER_UDPWRAP) {
+                   AsyncWrap::PROVIDER_UDPWRAP),
+        recv_batch_(NULL),
+        gso_unsupported_(false),
+        connected_(false) {
     int r = uv_udp_init(env->event_loop(), &handle_);
     assert(r == 0);  // can't fail anyway
   }
 
   UDPWrap::~UDPWrap() {
+  #if defined(__linux__)
+    if (recv_batch_ != NULL)
+      recv_batch_->Dispose();
+  #endif
   }
 
   void UDPWrap::Initialize(Handle<Object> target,
@@ -108,9 +504,16 @@ namespace node {
     NODE_SET_PROTOTYPE_METHOD(t, "send", Send);
     NODE_SET_PROTOTYPE_METHOD(t, "bind6", Bind6);
     NODE_SET_PROTOTYPE_METHOD(t, "send6", Send6);
+    NODE_SET_PROTOTYPE_METHOD(t, "sendBatch", SendBatch);
+    NODE_SET_PROTOTYPE_METHOD(t, "sendSegments", SendSegments);
+    NODE_SET_PROTOTYPE_METHOD(t, "connect", Connect);
+    NODE_SET_PROTOTYPE_METHOD(t, "disconnect", Disconnect);
+    NODE_SET_PROTOTYPE_METHOD(t, "sendConnected", SendConnected);
     NODE_SET_PROTOTYPE_METHOD(t, "close", Close);
     NODE_SET_PROTOTYPE_METHOD(t, "recvStart", RecvStart);
     NODE_SET_PROTOTYPE_METHOD(t, "recvStop", RecvStop);
+    NODE_SET_PROTOTYPE_METHOD(t, "recvBatchStart", RecvBatchStart);
+    NODE_SET_PROTOTYPE_METHOD(t, "recvBatchStop", RecvBatchStop);
     NODE_SET_PROTOTYPE_METHOD(t, "getsockname", GetSockName);
     NODE_SET_PROTOTYPE_METHOD(t, "addMembership", AddMembership);
     NODE_SET_PROTOTYPE_METHOD(t, "dropMembership", DropMembership);
@@ -278,24 +681,13 @@ namespace node {
 
     assert(length <= Buffer::Length(buffer_obj) - offset);
 
-    SendWrap* req_wrap = new SendWrap(env, req_wrap_obj, have_callback);
+    char* storage = env->request_pool()->Allocate(sizeof(SendWrap));
+    SendWrap* req_wrap = new(storage) SendWrap(env, req_wrap_obj, have_callback);
 
     uv_buf_t buf = uv_buf_init(Buffer::Data(buffer_obj) + offset,
                                length);
-    char addr[sizeof(sockaddr_in6)];
-    int err;
-
-    switch (family) {
-    case AF_INET:
-      err = uv_ip4_addr(*address, port, reinterpret_cast<sockaddr_in*>(&addr));
-      break;
-    case AF_INET6:
-      err = uv_ip6_addr(*address, port, reinterpret_cast<sockaddr_in6*>(&addr));
-      break;
-    default:
-      assert(0 && "unexpected address family");
-      abort();
-    }
+    sockaddr_storage addr;
+    int err = wrap->address_cache_.Lookup(family, *address, port, &addr);
 
     if (err == 0) {
       err = uv_udp_send(&req_wrap->req_,
@@ -307,8 +699,10 @@ namespace node {
     }
 
     req_wrap->Dispatched();
-    if (err)
-      delete req_wrap;
+    if (err) {
+      req_wrap->~SendWrap();
+      env->request_pool()->Free(storage);
+    }
 
     args.GetReturnValue().Set(err);
   }
@@ -322,11 +716,465 @@ namespace node {
     DoSend(args, AF_INET6);
   }
 
+
+  // connect(address, port) fixes the peer for sendConnected().  On Linux the
+  // socket is connect()ed too, the kernel then keeps the route and only
+  // delivers datagrams from that peer; an unbound socket is bound to the
+  // wildcard address first, as sendto() would.  Elsewhere libuv always
+  // passes the address and BSD kernels refuse that on connected sockets, so
+  // only the parsed address is kept.
+  void UDPWrap::Connect(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+
+    UDPWrap* wrap = Unwrap<UDPWrap>(args.Holder());
+
+    if (!args[0]->IsString() || !args[1]->IsUint32())
+      return env->ThrowTypeError("connect(address, port)");
+
+    node::Utf8Value address(args[0]);
+    const int port = args[1]->Uint32Value();
+
+    sockaddr_storage addr;
+    int err = ParseAddress(AF_UNSPEC, *address, port, &addr);
+
+  #if defined(__linux__)
+    if (err == 0 && wrap->handle_.io_watcher.fd == -1) {
+      sockaddr_storage any;
+      if (addr.ss_family == AF_INET6)
+        uv_ip6_addr("::", 0, reinterpret_cast<sockaddr_in6*>(&any));
+      else
+        uv_ip4_addr("0.0.0.0", 0, reinterpret_cast<sockaddr_in*>(&any));
+      err = uv_udp_bind(&wrap->handle_, reinterpret_cast<const sockaddr*>(&any), 0);
+    }
+
+    if (err == 0) {
+      socklen_t addrlen = addr.ss_family == AF_INET6 ? sizeof(sockaddr_in6) :
+                                                       sizeof(sockaddr_in);
+      if (connect(wrap->handle_.io_watcher.fd,
+                  reinterpret_cast<const sockaddr*>(&addr),
+                  addrlen) != 0) {
+        err = -errno;
+      }
+    }
+  #endif
+
+    if (err == 0) {
+      wrap->peer_ = addr;
+      wrap->connected_ = true;
+    }
+
+    args.GetReturnValue().Set(err);
+  }
+
+
+  void UDPWrap::Disconnect(const FunctionCallbackInfo<Value>& args) {
+    HandleScope scope(args.GetIsolate());
+    UDPWrap* wrap = Unwrap<UDPWrap>(args.Holder());
+
+    if (!wrap->connected_)
+      return args.GetReturnValue().Set(UV_ENOTCONN);
+
+  #if defined(__linux__)
+    sockaddr unspec;
+    memset(&unspec, 0, sizeof(unspec));
+    unspec.sa_family = AF_UNSPEC;
+    // Older kernels report EAFNOSUPPORT after dissolving the association.
+    if (connect(wrap->handle_.io_watcher.fd, &unspec, sizeof(unspec)) != 0 &&
+        errno != EAFNOSUPPORT) {
+      return args.GetReturnValue().Set(-errno);
+    }
+  #endif
+
+    wrap->connected_ = false;
+    args.GetReturnValue().Set(0);
+  }
+
+
+  // sendConnected(req, buffer, offset, length, haveCallback) sends to the
+  // connect()ed peer.  When the datagram can go out right away it is
+  // written with send(), req.async stays unset and oncomplete is not
+  // called, as with stream writes.
+  void UDPWrap::SendConnected(const FunctionCallbackInfo<Value>& args) {
+    HandleScope handle_scope(args.GetIsolate());
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+
+    UDPWrap* wrap = Unwrap<UDPWrap>(args.Holder());
+
+    assert(args[0]->IsObject());
+    assert(Buffer::HasInstance(args[1]));
+    assert(args[2]->IsUint32());
+    assert(args[3]->IsUint32());
+
+    Local<Object> req_wrap_obj = args[0].As<Object>();
+    Local<Object> buffer_obj = args[1].As<Object>();
+    size_t offset = args[2]->Uint32Value();
+    size_t length = args[3]->Uint32Value();
+    const bool have_callback = args[4]->IsTrue();
+
+    assert(length <= Buffer::Length(buffer_obj) - offset);
+
+    if (!wrap->connected_)
+      return args.GetReturnValue().Set(UV_ENOTCONN);
+
+    uv_buf_t buf = uv_buf_init(Buffer::Data(buffer_obj) + offset, length);
+
+  #if defined(__linux__)
+    // Only while nothing is queued, datagrams must leave in order.
+    if (wrap->handle_.send_queue_count == 0) {
+      ssize_t r;
+      do {
+        r = send(wrap->handle_.io_watcher.fd, buf.base, buf.len, 0);
+      } while (r == -1 && errno == EINTR);
+      if (r != -1)
+        return args.GetReturnValue().Set(0);
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        return args.GetReturnValue().Set(-errno);
+    }
+  #endif
+
+    char* storage = env->request_pool()->Allocate(sizeof(SendWrap));
+    SendWrap* req_wrap = new(storage) SendWrap(env, req_wrap_obj, have_callback);
+
+    int err = uv_udp_send(&req_wrap->req_,
+                          &wrap->handle_,
+                          &buf,
+                          1,
+                          reinterpret_cast<const sockaddr*>(&wrap->peer_),
+                          OnSend);
+
+    req_wrap->Dispatched();
+    if (err) {
+      req_wrap->~SendWrap();
+      env->request_pool()->Free(storage);
+    } else {
+      req_wrap_obj->Set(env->async(), True(env->isolate()));
+    }
+
+    args.GetReturnValue().Set(err);
+  }
+
+  // sendBatch(req, entries, haveCallback): `entries` is a flat array of
+  // (buffer, port, address) triples.  The request must keep the buffers
+  // alive until oncomplete(status, sent), `sent` counts the datagrams that
+  // went out.  An error returned right away means none did.
+  void UDPWrap::SendBatch(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope handle_scope(env->isolate());
+
+    UDPWrap* wrap = Unwrap<UDPWrap>(args.Holder());
+
+    if (!args[0]->IsObject() || !args[1]->IsArray())
+      return env->ThrowTypeError("bad arguments to sendBatch");
+
+    Local<Object> req_wrap_obj = args[0].As<Object>();
+    Local<Array> entries = args[1].As<Array>();
+    const bool have_callback = args[2]->IsTrue();
+
+    uint32_t length = entries->Length();
+    if (length == 0 || length % 3 != 0 || length / 3 > kMaxBatchSend)
+      return env->ThrowRangeError("entries must be 1 to 1024 triples");
+
+    unsigned int count = length / 3;
+    uv_buf_t* bufs = new uv_buf_t[count];
+    sockaddr_storage* addrs = new sockaddr_storage[count];
+
+    int err = 0;
+    for (unsigned int i = 0; i < count && err == 0; i++) {
+      Local<Value> buffer = entries->Get(i * 3);
+      if (!Buffer::HasInstance(buffer)) {
+        delete[] bufs;
+        delete[] addrs;
+        return env->ThrowTypeError("entries must start with a Buffer");
+      }
+      bufs[i] = uv_buf_init(Buffer::Data(buffer), Buffer::Length(buffer));
+      node::Utf8Value address(entries->Get(i * 3 + 2));
+      err = wrap->address_cache_.Lookup(AF_UNSPEC,
+                                        *address,
+                                        entries->Get(i * 3 + 1)->Uint32Value(),
+                                        &addrs[i]);
+    }
+
+    if (err == 0) {
+      BatchSendWrap* req_wrap =
+          new BatchSendWrap(env, req_wrap_obj, have_callback, count);
+      req_wrap->Dispatched();
+      err = wrap->SubmitBatch(req_wrap, bufs, addrs, count, 0);
+      if (err)
+        delete req_wrap;
+    }
+
+    // libuv keeps its own copies of both.
+    delete[] bufs;
+    delete[] addrs;
+
+    args.GetReturnValue().Set(err);
+  }
+
+
+  // sendSegments(req, buffer, segmentSize, port, address, haveCallback)
+  // sends `buffer` to one destination as datagrams of segmentSize bytes,
+  // the last may be shorter.  Uses UDP_SEGMENT where the kernel has it.
+  void UDPWrap::SendSegments(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope handle_scope(env->isolate());
+
+    UDPWrap* wrap = Unwrap<UDPWrap>(args.Holder());
+
+    if (!args[0]->IsObject() || !Buffer::HasInstance(args[1]) ||
+        !args[2]->IsUint32() || !args[3]->IsUint32() || !args[4]->IsString()) {
+      return env->ThrowTypeError("bad arguments to sendSegments");
+    }
+
+    Local<Object> req_wrap_obj = args[0].As<Object>();
+    char* data = Buffer::Data(args[1]);
+    size_t length = Buffer::Length(args[1]);
+    size_t segment_size = args[2]->Uint32Value();
+    const int port = args[3]->Uint32Value();
+    node::Utf8Value address(args[4]);
+    const bool have_callback = args[5]->IsTrue();
+
+    if (segment_size == 0 || segment_size > 65507)
+      return env->ThrowRangeError("segmentSize must be between 1 and 65507");
+    size_t count = length == 0 ? 1 : (length + segment_size - 1) / segment_size;
+    if (count > kMaxBatchSend)
+      return env->ThrowRangeError("at most 1024 segments per call");
+
+    sockaddr_storage addr;
+    int err = wrap->address_cache_.Lookup(AF_UNSPEC, *address, port, &addr);
+    if (err == 0) {
+      uv_buf_t* bufs = new uv_buf_t[count];
+      sockaddr_storage* addrs = new sockaddr_storage[count];
+      for (size_t i = 0; i < count; i++) {
+        size_t offset = i * segment_size;
+        size_t size = length - offset < segment_size ? length - offset :
+                                                       segment_size;
+        bufs[i] = uv_buf_init(data + offset, size);
+        addrs[i] = addr;
+      }
+
+      BatchSendWrap* req_wrap =
+          new BatchSendWrap(env, req_wrap_obj, have_callback, count);
+      req_wrap->Dispatched();
+      err = wrap->SubmitBatch(req_wrap, bufs, addrs, count, segment_size);
+      if (err)
+        delete req_wrap;
+
+      delete[] bufs;
+      delete[] addrs;
+    }
+
+    args.GetReturnValue().Set(err);
+  }
+
+
+  // Datagrams are written directly only while libuv has nothing queued, and
+  // never the last one: its uv_udp_send() callback completes the request.
+  // Whatever a direct write leaves over, EAGAIN or an error, goes through
+  // libuv too and is reported from there.  Errors are only returned while
+  // nothing has been sent yet.
+  int UDPWrap::SubmitBatch(BatchSendWrap* req_wrap,
+                           const uv_buf_t* bufs,
+                           const sockaddr_storage* addrs,
+                           unsigned int count,
+                           size_t segment_size) {
+    unsigned int sent = 0;
+    if (handle_.send_queue_count == 0 && count > 1) {
+      if (segment_size != 0 && !gso_unsupported_)
+        sent = SendGSO(bufs, addrs, count - 1, segment_size);
+      sent += SendMany(bufs + sent, addrs + sent, count - 1 - sent);
+    }
+
+    unsigned int requests = 0;
+    for (unsigned int i = sent; i < count; i++) {
+      uv_udp_send_t* req = req_wrap->request(requests);
+      req->data = req_wrap;
+      int err = uv_udp_send(req,
+                            &handle_,
+                            &bufs[i],
+                            1,
+                            reinterpret_cast<const sockaddr*>(&addrs[i]),
+                            OnBatchSend);
+      if (err) {
+        req_wrap->status = err;
+        if (requests == 0) {
+          if (sent == 0)
+            return err;
+          // Part of the batch is out, oncomplete reports the error on the
+          // next loop iteration like any other.
+          uv_timer_init(env()->event_loop(), &req_wrap->failed);
+          uv_timer_start(&req_wrap->failed, OnBatchFailed, 0, 0);
+          requests = 1;
+        }
+        break;
+      }
+      requests++;
+    }
+
+    req_wrap->sent = sent;
+    req_wrap->pending = requests;
+    return 0;
+  }
+
+
+  static socklen_t AddressLength(const sockaddr_storage* addr) {
+    return addr->ss_family == AF_INET6 ? sizeof(sockaddr_in6) :
+                                         sizeof(sockaddr_in);
+  }
+
+
+  // sendmmsg(2) as far as it goes, returns the number of datagrams sent.
+  unsigned int UDPWrap::SendMany(const uv_buf_t* bufs,
+                                 const sockaddr_storage* addrs,
+                                 unsigned int count) {
+  #if defined(__linux__)
+    if (count == 0)
+      return 0;
+
+    mmsghdr* msgs = new mmsghdr[count];
+    memset(msgs, 0, count * sizeof(msgs[0]));
+    for (unsigned int i = 0; i < count; i++) {
+      msghdr* hdr = &msgs[i].msg_hdr;
+      hdr->msg_name = const_cast<sockaddr_storage*>(&addrs[i]);
+      hdr->msg_namelen = AddressLength(&addrs[i]);
+      // uv_buf_t is ABI compatible with struct iovec on unices.
+      hdr->msg_iov = reinterpret_cast<iovec*>(const_cast<uv_buf_t*>(&bufs[i]));
+      hdr->msg_iovlen = 1;
+    }
+
+    unsigned int sent = 0;
+    while (sent < count) {
+      int r;
+      do {
+        r = sendmmsg(handle_.io_watcher.fd, msgs + sent, count - sent, 0);
+      } while (r == -1 && errno == EINTR);
+      if (r <= 0)
+        break;
+      sent += r;
+    }
+
+    delete[] msgs;
+    return sent;
+  #else
+    return 0;
+  #endif
+  }
+
+
+  // Full-size segments to addrs[0] with UDP_SEGMENT, as few sendmsg() calls
+  // as the kernel's limits allow.  Returns the number of segments sent.
+  unsigned int UDPWrap::SendGSO(const uv_buf_t* bufs,
+                                const sockaddr_storage* addr,
+                                unsigned int count,
+                                size_t segment_size) {
+  #if defined(__linux__)
+    static const unsigned int kMaxSegments = 64;
+    static const size_t kMaxPayload = 65000;
+
+    unsigned int per_call = kMaxPayload / segment_size;
+    if (per_call > kMaxSegments)
+      per_call = kMaxSegments;
+    if (per_call < 2)
+      return 0;
+
+    unsigned int sent = 0;
+    while (sent < count) {
+      unsigned int n = count - sent < per_call ? count - sent : per_call;
+
+      // The segments are consecutive slices of one buffer.
+      iovec iov;
+      iov.iov_base = bufs[sent].base;
+      iov.iov_len = n * segment_size;
+
+      char control[CMSG_SPACE(sizeof(uint16_t))];
+      memset(control, 0, sizeof(control));
+      msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_name = const_cast<sockaddr_storage*>(addr);
+      msg.msg_namelen = AddressLength(addr);
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+
+      cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t gso_size = static_cast<uint16_t>(segment_size);
+      memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+
+      ssize_t r;
+      do {
+        r = sendmsg(handle_.io_watcher.fd, &msg, 0);
+      } while (r == -1 && errno == EINTR);
+
+      if (r == -1) {
+        // Old kernel or a device without segmentation offload, sendmmsg()
+        // from now on.
+        if (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT ||
+            errno == EOPNOTSUPP) {
+          gso_unsupported_ = true;
+        }
+        break;
+      }
+      sent += n;
+    }
+
+    return sent;
+  #else
+    return 0;
+  #endif
+  }
+
+
+  void UDPWrap::OnBatchSend(uv_udp_send_t* req, int status) {
+    BatchSendWrap* req_wrap = static_cast<BatchSendWrap*>(req->data);
+    if (status < 0 && req_wrap->status == 0)
+      req_wrap->status = status;
+    if (status >= 0)
+      req_wrap->sent++;
+    if (--req_wrap->pending > 0)
+      return;
+    FinishBatch(req_wrap);
+  }
+
+
+  void UDPWrap::OnBatchFailed(uv_timer_t* handle) {
+    uv_close(reinterpret_cast<uv_handle_t*>(handle), OnBatchFailedClose);
+  }
+
+
+  void UDPWrap::OnBatchFailedClose(uv_handle_t* handle) {
+    uv_timer_t* timer = reinterpret_cast<uv_timer_t*>(handle);
+    BatchSendWrap* req_wrap = ContainerOf(&BatchSendWrap::failed, timer);
+    FinishBatch(req_wrap);
+  }
+
+
+  void UDPWrap::FinishBatch(BatchSendWrap* req_wrap) {
+    Environment* env = req_wrap->env();
+    if (req_wrap->have_callback) {
+      HandleScope handle_scope(env->isolate());
+      Context::Scope context_scope(env->context());
+      Local<Value> argv[] = {
+        Integer::New(env->isolate(), req_wrap->status),
+        Integer::NewFromUnsigned(env->isolate(), req_wrap->sent)
+      };
+      req_wrap->MakeCallback(env->oncomplete_string(), ARRAY_SIZE(argv), argv);
+    }
+    delete req_wrap;
+  }
+
+
   void UDPWrap::RecvStart(const FunctionCallbackInfo<Value>& args) {
     Environment* env = Environment::GetCurrent(args.GetIsolate());
     HandleScope scope(env->isolate());
     UDPWrap* wrap = Unwrap<UDPWrap>(args.Holder());
 
+    if (wrap->recv_batch_ != NULL)
+      return args.GetReturnValue().Set(UV_EBUSY);
+
     int err = uv_udp_recv_start(&wrap->handle_, OnAlloc, OnRecv);
     // UV_EALREADY means that the socket is already bound but that's okay
     if (err == UV_EALREADY)
@@ -343,6 +1191,54 @@ namespace node {
     args.GetReturnValue().Set(r);
   }
 
+  // recvBatchStart(batch[, slotSize]) switches to batched receive, see
+  // RecvBatch.  Datagrams larger than slotSize are truncated and flagged.
+  // Linux only, the socket must be bound.
+  void UDPWrap::RecvBatchStart(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+    UDPWrap* wrap = Unwrap<UDPWrap>(args.Holder());
+
+    if (!args[0]->IsUint32() || args[0]->Uint32Value() == 0 ||
+        args[0]->Uint32Value() > RecvBatch::kMaxBatch) {
+      return env->ThrowRangeError("batch must be between 1 and 1024");
+    }
+    size_t slot_size = RecvBatch::kDefaultSlotSize;
+    if (args[1]->IsUint32()) {
+      slot_size = args[1]->Uint32Value();
+      if (slot_size == 0 || slot_size > 65536)
+        return env->ThrowRangeError("slotSize must be between 1 and 65536");
+    }
+
+  #if defined(__linux__)
+    if (wrap->recv_batch_ != NULL)
+      return args.GetReturnValue().Set(UV_EBUSY);
+
+    uv_udp_recv_stop(&wrap->handle_);
+    RecvBatch* batch = new RecvBatch(wrap, args[0]->Uint32Value(), slot_size);
+    int err = batch->Start();
+    if (err == 0)
+      wrap->recv_batch_ = batch;
+    args.GetReturnValue().Set(err);
+  #else
+    args.GetReturnValue().Set(UV_ENOTSUP);
+  #endif
+  }
+
+  void UDPWrap::RecvBatchStop(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args.GetIsolate());
+    HandleScope scope(env->isolate());
+    UDPWrap* wrap = Unwrap<UDPWrap>(args.Holder());
+
+  #if defined(__linux__)
+    if (wrap->recv_batch_ != NULL) {
+      wrap->recv_batch_->Dispose();
+      wrap->recv_batch_ = NULL;
+    }
+  #endif
+    args.GetReturnValue().Set(0);
+  }
+
   void UDPWrap::GetSockName(const FunctionCallbackInfo<Value>& args) {
     HandleScope handle_scope(args.GetIsolate());
     Environment* env = Environment::GetCurrent(args.GetIsolate());
@@ -369,27 +1265,24 @@ namespace node {
   // TODO(bnoordhuis) share with StreamWrap::AfterWrite() in stream_wrap.cc
   void UDPWrap::OnSend(uv_udp_send_t* req, int status) {
     SendWrap* req_wrap = static_cast<SendWrap*>(req->data);
+    Environment* env = req_wrap->env();
     if (req_wrap->have_callback()) {
-      Environment* env = req_wrap->env();
       HandleScope handle_scope(env->isolate());
       Context::Scope context_scope(env->context());
       Local<Value> arg = Integer::New(env->isolate(), status);
       req_wrap->MakeCallback(env->oncomplete_string(), 1, &arg);
     }
-    delete req_wrap;
+    req_wrap->~SendWrap();
+    env->request_pool()->Free(reinterpret_cast<char*>(req_wrap));
   }
 
 
   void UDPWrap::OnAlloc(uv_handle_t* handle,
                         size_t suggested_size,
                         uv_buf_t* buf) {
-    buf->base = static_cast<char*>(malloc(suggested_size));
+    UDPWrap* wrap = static_cast<UDPWrap*>(handle->data);
+    buf->base = wrap->env()->slab_allocator()->Allocate(suggested_size);
     buf->len = suggested_size;
-
-    if (buf->base == NULL && suggested_size > 0) {
-      FatalError("node::UDPWrap::OnAlloc(uv_handle_t*, size_t, uv_buf_t*)",
-                 "Out Of Memory");
-    }
   }
 
   void UDPWrap::OnRecv(uv_udp_t* handle,
@@ -398,8 +1291,6 @@ namespace node {
                        const struct sockaddr* addr,
                        unsigned int flags) {
     if (nread == 0 && addr == NULL) {
-      if (buf->base != NULL)
-        free(buf->base);
       return;
     }
 
@@ -418,14 +1309,15 @@ namespace node {
     };
 
     if (nread < 0) {
-      if (buf->base != NULL)
-        free(buf->base);
       wrap->MakeCallback(env->onmessage_string(), ARRAY_SIZE(argv), argv);
       return;
     }
 
-    char* base = static_cast<char*>(realloc(buf->base, nread));
-    argv[2] = Buffer::Use(env, base, nread);
+    // Empty datagrams still get a Buffer, it just doesn't pin the slab.
+    if (nread == 0)
+      argv[2] = Buffer::New(env, static_cast<size_t>(0));
+    else
+      argv[2] = env->slab_allocator()->Shrink(env, buf->base, nread);
     argv[3] = AddressToJS(env, addr);
     wrap->MakeCallback(env->onmessage_string(), ARRAY_SIZE(argv), argv);
   }
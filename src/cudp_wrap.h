@@ -30,6 +30,32 @@
 #include "uv.h"
 
 namespace node {
+  class RecvBatch;
+  class BatchSendWrap;
+
+  // Parsed destinations for unconnected sends, keyed by family and address
+  // string.  Programs tend to talk to a handful of peers.
+  class UDPAddressCache {
+   public:
+    UDPAddressCache();
+
+    // Like uv_ip4_addr()/uv_ip6_addr(), AF_UNSPEC tries both.
+    int Lookup(int family, const char* ip, int port, sockaddr_storage* addr);
+
+   private:
+    static const unsigned int kEntries = 8;
+    static const size_t kMaxAddressLength = 64;
+
+    struct Entry {
+      int family;
+      char ip[kMaxAddressLength];
+      sockaddr_storage addr;
+    };
+
+    Entry entries_[kEntries];
+    unsigned int next_;  // Slot replaced next.
+  };
+
   class UDPWrap: public HandleWrap {
    public:
     static void Initialize(v8::Handle<v8::Object> target, v8::Handle<v8::Value> unused, v8::Handle<v8::Context> context);
@@ -39,8 +65,15 @@ namespace node {
     static void Send(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void Bind6(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void Send6(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void SendBatch(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void SendSegments(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void Connect(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void Disconnect(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void SendConnected(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void RecvStart(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void RecvStop(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void RecvBatchStart(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void RecvBatchStop(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void GetSockName(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void AddMembership(const v8::FunctionCallbackInfo<v8::Value>& args);
     static void DropMembership(const v8::FunctionCallbackInfo<v8::Value>& args);
@@ -62,9 +95,32 @@ namespace node {
 
     static void OnAlloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
     static void OnSend(uv_udp_send_t* req, int status);
+
+    // Batch sends
+    int SubmitBatch(BatchSendWrap* req_wrap,
+                    const uv_buf_t* bufs,
+                    const sockaddr_storage* addrs,
+                    unsigned int count,
+                    size_t segment_size);
+    unsigned int SendMany(const uv_buf_t* bufs,
+                          const sockaddr_storage* addrs,
+                          unsigned int count);
+    unsigned int SendGSO(const uv_buf_t* bufs,
+                         const sockaddr_storage* addr,
+                         unsigned int count,
+                         size_t segment_size);
+    static void OnBatchSend(uv_udp_send_t* req, int status);
+    static void OnBatchFailed(uv_timer_t* handle);
+    static void OnBatchFailedClose(uv_handle_t* handle);
+    static void FinishBatch(BatchSendWrap* req_wrap);
     static void OnRecv(uv_udp_t* handle, ssize_t nread, const uv_buf_t* buf, const struct sockaddr* addr, unsigned int flags);
 
     uv_udp_t handle_;
+    RecvBatch* recv_batch_;  // Batched receive, if started.
+    bool gso_unsupported_;  // UDP_SEGMENT was refused once.
+    bool connected_;
+    sockaddr_storage peer_;  // Valid while connected_.
+    UDPAddressCache address_cache_;
   };
 
 }//End Node Namespace
@@ -0,0 +1,82 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+// connectMany() races the addresses it's given. The first one here is
+// blackholed, the loopback listener has to win long before that connect
+// would time out, and every address failing reports the last error.
+
+var common = require('../common');
+var assert = require('assert');
+
+var tcp_wrap = process.binding('tcp_wrap');
+var TCP = tcp_wrap.TCP;
+var TCPConnectWrap = tcp_wrap.TCPConnectWrap;
+
+var BLACKHOLE = '10.255.255.1';  // Not routed, SYNs go nowhere.
+var DELAY = 50;
+
+var server = new TCP();
+assert.equal(server.bind('127.0.0.1', common.PORT), 0);
+assert.equal(server.listen(16), 0);
+server.onconnection = common.mustCall(function(err, client) {
+  assert.equal(err, 0);
+  client.close();
+  server.close();
+  refused();
+});
+
+var start = Date.now();
+var req = new TCPConnectWrap();
+req.oncomplete = common.mustCall(function(status, handle, req_, r, w) {
+  assert.equal(status, 0);
+  assert.ok(handle instanceof TCP);
+  assert.equal(req_, req);
+  assert.ok(r && w);
+
+  var peer = {};
+  assert.equal(handle.getpeername(peer), 0);
+  assert.equal(peer.address, '127.0.0.1');
+  assert.equal(peer.port, common.PORT);
+
+  // One stagger step, not a connect timeout.
+  assert.ok(Date.now() - start < 2000);
+  handle.close();
+});
+assert.equal(tcp_wrap.connectMany(req,
+                                  [BLACKHOLE, '127.0.0.1'],
+                                  common.PORT,
+                                  DELAY), 0);
+
+// With nothing listening anymore every attempt fails.
+function refused() {
+  var req = new TCPConnectWrap();
+  req.oncomplete = common.mustCall(function(status, handle) {
+    assert.ok(status < 0);
+    assert.equal(handle, undefined);
+  });
+  assert.equal(tcp_wrap.connectMany(req, ['127.0.0.1'], common.PORT, DELAY),
+               0);
+}
+
+assert.throws(function() {
+  tcp_wrap.connectMany(new TCPConnectWrap(), [], common.PORT);
+}, RangeError);
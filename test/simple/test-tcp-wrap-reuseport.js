@@ -0,0 +1,92 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+// Listeners bound with reusePort share the port and the kernel spreads
+// incoming connections across them, as the listener shards rely on.
+
+var common = require('../common');
+var assert = require('assert');
+
+var tcp_wrap = process.binding('tcp_wrap');
+var TCP = tcp_wrap.TCP;
+var TCPConnectWrap = tcp_wrap.TCPConnectWrap;
+
+if (process.platform !== 'linux') {
+  console.error('Skipping: SO_REUSEPORT load balancing is Linux only');
+  process.exit(0);
+}
+
+var LISTENERS = 4;
+var CONNECTIONS = 200;
+
+var listeners = [];
+var accepted = [];
+var connected = 0;
+
+function onconnection(index) {
+  return function(err, client) {
+    assert.equal(err, 0);
+    accepted[index]++;
+    client.close();
+    if (sum(accepted) === CONNECTIONS)
+      listeners.forEach(function(listener) { listener.close(); });
+  };
+}
+
+function sum(counts) {
+  return counts.reduce(function(a, b) { return a + b; }, 0);
+}
+
+for (var i = 0; i < LISTENERS; i++) {
+  var listener = new TCP();
+  assert.equal(listener.bind('127.0.0.1', common.PORT, true), 0);
+  assert.equal(listener.listen(CONNECTIONS), 0);
+  listener.onconnection = onconnection(i);
+  listeners.push(listener);
+  accepted.push(0);
+}
+
+function connect() {
+  var client = new TCP();
+  var req = new TCPConnectWrap();
+  req.oncomplete = function(status, handle) {
+    assert.equal(status, 0);
+    assert.equal(handle, client);
+    connected++;
+    client.close();
+  };
+  assert.equal(client.connect(req, '127.0.0.1', common.PORT), 0);
+}
+
+for (var i = 0; i < CONNECTIONS; i++)
+  connect();
+
+process.on('exit', function() {
+  assert.equal(connected, CONNECTIONS);
+  assert.equal(sum(accepted), CONNECTIONS);
+
+  // Each source port hashes to a listener, every one gets a fair share.
+  var fair = CONNECTIONS / LISTENERS;
+  accepted.forEach(function(count) {
+    assert.ok(count > fair / 2, 'uneven spread: ' + accepted.join(', '));
+  });
+});
@@ -0,0 +1,127 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+
+// setZeroCopy() sends writes at or above the threshold with MSG_ZEROCOPY and
+// leaves the smaller ones on the normal path. Mixing the two over loopback,
+// every write has to complete in the order it was queued and the peer has to
+// see exactly the bytes that were sent.
+
+var common = require('../common');
+var assert = require('assert');
+
+if (process.platform !== 'linux') {
+  console.error('Skipping: MSG_ZEROCOPY is Linux only');
+  process.exit(0);
+}
+
+var tcp_wrap = process.binding('tcp_wrap');
+var stream_wrap = process.binding('stream_wrap');
+var TCP = tcp_wrap.TCP;
+var TCPConnectWrap = tcp_wrap.TCPConnectWrap;
+var WriteWrap = stream_wrap.WriteWrap;
+var ShutdownWrap = stream_wrap.ShutdownWrap;
+
+var THRESHOLD = 16 * 1024;
+var SIZES = [256 * 1024, 100, THRESHOLD, THRESHOLD - 1, 512 * 1024, 1];
+
+var chunks = [];
+for (var i = 0; i < SIZES.length; i++) {
+  chunks[i] = new Buffer(SIZES[i]);
+  for (var j = 0; j < SIZES[i]; j++)
+    chunks[i][j] = (i * 31 + j) & 0xff;
+}
+var expected = Buffer.concat(chunks);
+
+var skipped = false;
+var completed = [];
+var received = [];
+var receivedBytes = 0;
+
+var server = new TCP();
+assert.equal(server.bind('127.0.0.1', common.PORT), 0);
+assert.equal(server.listen(16), 0);
+server.onconnection = common.mustCall(function(err, peer) {
+  assert.equal(err, 0);
+  server.close();
+  peer.onread = function(nread, buffer) {
+    if (nread > 0) {
+      // The slab is reused, keep a copy.
+      var copy = new Buffer(nread);
+      buffer.copy(copy, 0, 0, nread);
+      received.push(copy);
+      receivedBytes += nread;
+      return;
+    }
+    assert.equal(nread, process.binding('uv').UV_EOF);
+    peer.close();
+  };
+  assert.equal(peer.readStart(), 0);
+});
+
+var req = new TCPConnectWrap();
+req.oncomplete = common.mustCall(function(status, handle) {
+  assert.equal(status, 0);
+
+  var err = handle.setZeroCopy(THRESHOLD);
+  if (err !== 0) {
+    console.error('Skipping: setZeroCopy() failed with ' + err);
+    skipped = true;
+    handle.close();
+    server.close();
+    process.exit(0);
+  }
+
+  SIZES.forEach(function(size, index) {
+    var w = new WriteWrap();
+    w.oncomplete = function(status, handle_, req_) {
+      assert.equal(status, 0);
+      assert.equal(handle_, handle);
+      assert.equal(req_, w);
+      completed.push(index);
+    };
+    assert.equal(handle.writeBuffer(w, chunks[index]), 0);
+    // Done synchronously, oncomplete won't be called.
+    if (!w.async)
+      completed.push(index);
+  });
+
+  var shutdown = new ShutdownWrap();
+  shutdown.oncomplete = common.mustCall(function(status) {
+    assert.equal(status, 0);
+    handle.close();
+  });
+  assert.equal(handle.shutdown(shutdown), 0);
+});
+assert.equal(new TCP().connect(req, '127.0.0.1', common.PORT), 0);
+
+process.on('exit', function() {
+  if (skipped)
+    return;
+  assert.deepEqual(completed, SIZES.map(function(_, i) { return i; }));
+  assert.equal(receivedBytes, expected.length);
+  var actual = Buffer.concat(received);
+  for (var i = 0; i < expected.length; i++) {
+    if (actual[i] !== expected[i])
+      assert.fail(actual[i], expected[i], 'byte ' + i + ' differs', '!==');
+  }
+});
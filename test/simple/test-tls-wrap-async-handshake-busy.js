@@ -0,0 +1,128 @@
+// Copyright(c) 2015
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the
+// following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+// NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+// USE OR OTHER DEALINGS IN THE SOFTWARE
+
+
+// While an offloaded handshake step runs on the threadpool the SSL belongs
+// to the worker: the methods reading or changing it throw EBUSY until the
+// step is back on the loop, and the handshake still completes.
+
+var common = require('../common');
+var assert = require('assert');
+var fs = require('fs');
+var path = require('path');
+
+var tcp_wrap = process.binding('tcp_wrap');
+var tls_wrap = process.binding('tls_wrap');
+var SecureContext = process.binding('crypto').SecureContext;
+var TCP = tcp_wrap.TCP;
+var TCPConnectWrap = tcp_wrap.TCPConnectWrap;
+
+var keys = path.join(common.fixturesDir, 'keys');
+
+var serverCtx = new SecureContext();
+serverCtx.init();
+serverCtx.setKey(fs.readFileSync(path.join(keys, 'agent1-key.pem')));
+serverCtx.setCert(fs.readFileSync(path.join(keys, 'agent1-cert.pem')));
+
+var clientCtx = new SecureContext();
+clientCtx.init();
+
+function isBusy(err) {
+  return err instanceof Error && err.code === 'EBUSY';
+}
+
+function noError(err) {
+  throw err;
+}
+
+var server = new TCP();
+assert.equal(server.bind('127.0.0.1', common.PORT), 0);
+assert.equal(server.listen(16), 0);
+server.onconnection = common.mustCall(function(err, client) {
+  assert.equal(err, 0);
+  server.close();
+
+  // Take the ClientHello in the clear, then hand it to the TLS side in one
+  // go so the offloaded step starts synchronously inside receive()
+  client.onread = common.mustCall(function(nread, hello) {
+    assert.ok(nread > 0);
+    client.readStop();
+
+    var tls = tls_wrap.wrap(client, serverCtx, true);
+    tls.enableAsyncHandshake();
+    tls.onerror = noError;
+    tls.onhandshakedone = common.mustCall(function() {
+      // Back on the loop, the SSL is ours again
+      assert.ok(tls.isInitFinished());
+      assert.ok(tls.getCurrentCipher());
+      assert.ok(tls.getSession());
+    });
+    client.onread = function(nread) {
+      if (nread < 0)
+        client.close();
+    };
+
+    tls.receive(hello);
+
+    ['getSession',
+     'getCurrentCipher',
+     'getPeerCertificate',
+     'isSessionReused',
+     'verifyError',
+     'renegotiate'].forEach(function(method) {
+      assert.throws(function() {
+        tls[method]();
+      }, isBusy, method);
+    });
+    assert.throws(function() {
+      tls.setVerifyMode(false, false);
+    }, isBusy, 'setVerifyMode');
+
+    // Read by the worker when it picks the step's callbacks
+    assert.throws(function() {
+      tls.setOCSPResponse(new Buffer('ocsp'));
+    }, isBusy, 'setOCSPResponse');
+    if (typeof tls.setNPNProtocols === 'function') {
+      assert.throws(function() {
+        tls.setNPNProtocols(new Buffer('\bhttp/1.1'));
+      }, isBusy, 'setNPNProtocols');
+    }
+
+    client.readStart();
+  });
+  client.readStart();
+});
+
+var socket = new TCP();
+var req = new TCPConnectWrap();
+req.oncomplete = common.mustCall(function(status, handle) {
+  assert.equal(status, 0);
+
+  var tls = tls_wrap.wrap(socket, clientCtx, false);
+  tls.onerror = noError;
+  tls.onhandshakedone = common.mustCall(function() {
+    socket.close();
+  });
+  socket.onread = function() {};
+  socket.readStart();
+  tls.start();
+});
+assert.equal(socket.connect(req, '127.0.0.1', common.PORT), 0);